@@ -0,0 +1,408 @@
+#include <math.h>
+
+#include "animation.h"
+#include "noise.h"
+#include "util.h"
+
+// advanceCircleAnimation --
+//
+// Advance the simulation one time step.  Updates all circle positions
+// and velocities
+void
+advanceCircleAnimation(
+    SceneName sceneName,
+    int numCircles,
+    float* position,
+    float* velocity,
+    float* radius)
+{
+    // only the snowflake scene has animation
+
+    if (sceneName == SNOWFLAKES) {
+
+        const float dt = 1.f / 60.f;
+        const float kGravity = -1.8f; // sorry Newton
+        const float kDragCoeff = 2.f;
+
+        for (int i=0; i<numCircles; i++) {
+
+            int index3 = 3 * i;
+
+            // hack to make farther circles move more slowly, giving the
+            // illusion of parallax
+            float forceScaling = CLAMP(1.f - position[index3+2], .1f, 1.f);
+
+            // add some noise to the motion to make the snow flutter
+            float noiseInput[3];
+            float noiseForce[2];
+            noiseInput[0] = 10.f * position[index3];
+            noiseInput[1] = 10.f * position[index3+1];
+            noiseInput[2] = 255.f * position[index3+2];
+            vec2CellNoise(noiseInput, noiseForce, i);
+            noiseForce[0] *= 7.5f;
+            noiseForce[1] *= 5.f;
+
+            // drag
+            float dragForce[3];
+            dragForce[0] = -1.f * kDragCoeff * velocity[index3];
+            dragForce[1] = -1.f * kDragCoeff * velocity[index3+1];
+
+            // update positions
+            position[index3]   += velocity[index3] * dt;
+            position[index3+1] += velocity[index3+1] * dt;
+            position[index3+2] += velocity[index3+2] * dt;
+
+            // update forces
+            velocity[index3]   += forceScaling * (noiseForce[0] + dragForce[0]) * dt;
+            velocity[index3+1] += forceScaling * (kGravity + noiseForce[1] + dragForce[1]) * dt;
+
+            // if the snowflake has moved off the left, right or bottom of
+            // the screen, place it back at the top and give it a
+            // pseudorandom x position and velocity.
+            if ( (position[index3+1] + radius[i] < 0.f) ||
+                 (position[index3]+radius[i]) < -0.f ||
+                 (position[index3]-radius[i]) > 1.f)
+            {
+                noiseInput[0] = 255.f * position[index3];
+                noiseInput[1] = 255.f * position[index3+1];
+                noiseInput[2] = 255.f * position[index3+2];
+                vec2CellNoise(noiseInput, noiseForce, i);
+
+                position[index3] = .5f + .5f * noiseForce[0];
+                position[index3+1] = 1.35f + radius[i];
+
+                // restart from 0 vertical velocity.  Choose a
+                // pseudo-random horizontal velocity.
+                velocity[index3] = 2.f * noiseForce[1];
+                velocity[index3+1] = 0.f;
+            }
+        }
+    } else if (sceneName == BOUNCING_BALLS) {
+        const float dt = 1.f / 60.f;
+        const float kGravity = -2.8f; // sorry Newton
+        const float kDragCoeff = -0.8f; 
+        const float epsilon = 0.001f; 
+
+        for (int i=0; i<numCircles; i++) {
+            int index3 = 3 * i;
+
+            // reverse velocity if center position < 0
+            float oldVelocity = velocity[index3+1]; 
+            float oldPosition = position[index3+1]; 
+
+            if (oldVelocity == 0.f && oldPosition == 0.f) { // stop-condition 
+                continue; 
+            }
+
+            if (position[index3+1] < 0 && oldVelocity < 0.f) { // bounce ball 
+                velocity[index3+1] *= kDragCoeff; 
+            }
+
+            // update velocity: v = u + at (only along y-axis)
+            velocity[index3+1] += kGravity * dt; 
+
+            // update positions (only along y-axis)
+            position[index3+1] += velocity[index3+1] * dt;
+
+            if (fabsf(velocity[index3+1] - oldVelocity) < epsilon 
+                    && oldPosition < 0.0f 
+                    && fabsf(position[index3+1]-oldPosition) < epsilon) { // stop ball 
+                velocity[index3+1] = 0.f; 
+                position[index3+1] = 0.f; 
+            } 
+        }
+    } else if (sceneName == HYPNOSIS) { 
+        float cutOff = 0.5f;  
+        for (int i = 0; i < numCircles; i++) { // update radius 
+            // place circle back in center after reaching threshold radisus 
+            if (radius[i] > cutOff) { 
+                radius[i] = 0.02f; 
+            } else { 
+                radius[i] += 0.01f; 
+            }
+        }
+    } else if (sceneName == FIREWORKS) {
+        const float dt = 1.f / 60.f;
+        const float pi = 3.14159;
+        const float maxDist = 0.25f; 
+
+        for (int i = 0; i < NUM_FIREWORKS; i++) { 
+            int index3i = 3 * i;
+            // fire-work center
+            float cx = position[index3i]; 
+            float cy = position[index3i+1]; 
+            for (int j = 0; j < NUM_SPARKS; j++) { 
+                int sIdx = NUM_FIREWORKS + i * NUM_SPARKS + j;
+                int index3j = 3 * sIdx;
+                
+                // update position
+                position[index3j] += velocity[index3j] * dt;  
+                position[index3j+1] += velocity[index3j+1] * dt; 
+
+                // fire-work sparks
+                float sx = position[index3j]; 
+                float sy = position[index3j+1];
+
+                // compute vector from firework-spark
+                float cxsx = sx - cx; 
+                float cysy = sy - cy;
+    
+                // compute distance from fire-work 
+                float dist = sqrt(cxsx * cxsx + cysy * cysy);
+                if (dist > maxDist) { // restore to starting position 
+                    // random starting position on fire-work's rim
+                    float angle = (j * 2 * pi)/NUM_SPARKS;
+                    float sinA = sin(angle); 
+                    float cosA = cos(angle); 
+                    float x = cosA * radius[i]; 
+                    float y = sinA * radius[i]; 
+
+                    position[index3j] = position[index3i] + x;  
+                    position[index3j+1] = position[index3i+1] + y;  
+                    position[index3j+2] = 0.0f; 
+
+                    // travel scaled unit length 
+                    velocity[index3j] = cosA/5.0;  
+                    velocity[index3j+1] = sinA/5.0; 
+                    velocity[index3j+2] = 0.0f;  
+                } 
+            }
+        } 
+
+    } 
+}
+
+
+// Snowflakes are updated in blocks of this many particles: a block goes
+// through the noise, integration and respawn passes while it is in
+// cache, and blocks are split across cores
+#define SNOW_BLOCK 1024
+
+CircleAnimation::CircleAnimation() {
+    sceneName = CIRCLE_RGB;
+    numCircles = 0;
+}
+
+void
+CircleAnimation::load(
+    SceneName scene,
+    int n,
+    const float* position,
+    const float* velocity,
+    const float* radius)
+{
+    sceneName = scene;
+    numCircles = n;
+
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+    velX.resize(n);
+    velY.resize(n);
+    velZ.resize(n);
+    radii.resize(n);
+
+    #pragma omp parallel for schedule(static)
+    for (int i=0; i<n; i++) {
+        x[i] = position[3*i];
+        y[i] = position[3*i+1];
+        z[i] = position[3*i+2];
+        velX[i] = velocity[3*i];
+        velY[i] = velocity[3*i+1];
+        velZ[i] = velocity[3*i+2];
+        radii[i] = radius[i];
+    }
+
+    // same expressions as advanceCircleAnimation
+    const float pi = 3.14159;
+    for (int j=0; j<NUM_SPARKS; j++) {
+        float angle = (j * 2 * pi)/NUM_SPARKS;
+        sparkSin[j] = sin(angle);
+        sparkCos[j] = cos(angle);
+        sparkVelX[j] = sparkCos[j]/5.0;
+        sparkVelY[j] = sparkSin[j]/5.0;
+    }
+}
+
+// advanceSnowflakes --
+//
+// Snowflakes [start, end): the noise lookups first, batched with
+// vec2CellNoiseBatch, then the integration as one vectorized loop that
+// also flags the flakes that left the screen, then the (rare) respawns.
+void
+CircleAnimation::advanceSnowflakes(int start, int end) {
+
+    const float dt = 1.f / 60.f;
+    const float kGravity = -1.8f; // sorry Newton
+    const float kDragCoeff = 2.f;
+
+    float noiseX[SNOW_BLOCK], noiseY[SNOW_BLOCK];
+    int offscreen[SNOW_BLOCK];
+
+    float* px = &x[start];
+    float* py = &y[start];
+    float* pz = &z[start];
+    float* vx = &velX[start];
+    float* vy = &velY[start];
+    const float* vz = &velZ[start];
+    const float* rad = &radii[start];
+    int count = end - start;
+
+    vec2CellNoiseBatch(count, px, py, pz, 10.f, 10.f, 255.f, start, noiseX, noiseY);
+
+    #pragma omp simd
+    for (int i=0; i<count; i++) {
+
+        // CLAMP(1.f - z, .1f, 1.f), spelled out so the loop has no
+        // references to temporaries
+        float forceScaling = 1.f - pz[i];
+        forceScaling = 1.f < forceScaling ? 1.f : forceScaling;
+        forceScaling = .1f < forceScaling ? forceScaling : .1f;
+        float noiseForceX = noiseX[i] * 7.5f;
+        float noiseForceY = noiseY[i] * 5.f;
+        float dragForceX = -1.f * kDragCoeff * vx[i];
+        float dragForceY = -1.f * kDragCoeff * vy[i];
+
+        px[i] += vx[i] * dt;
+        py[i] += vy[i] * dt;
+        pz[i] += vz[i] * dt;
+
+        vx[i] += forceScaling * (noiseForceX + dragForceX) * dt;
+        vy[i] += forceScaling * (kGravity + noiseForceY + dragForceY) * dt;
+
+        offscreen[i] = (py[i] + rad[i] < 0.f) |
+                       ((px[i] + rad[i]) < -0.f) |
+                       ((px[i] - rad[i]) > 1.f);
+    }
+
+    for (int i=0; i<count; i++) {
+        if (!offscreen[i])
+            continue;
+
+        float noiseInput[3];
+        float noiseForce[2];
+        noiseInput[0] = 255.f * px[i];
+        noiseInput[1] = 255.f * py[i];
+        noiseInput[2] = 255.f * pz[i];
+        vec2CellNoise(noiseInput, noiseForce, start + i);
+
+        px[i] = .5f + .5f * noiseForce[0];
+        py[i] = 1.35f + rad[i];
+        vx[i] = 2.f * noiseForce[1];
+        vy[i] = 0.f;
+    }
+}
+
+void
+CircleAnimation::advanceBouncingBalls() {
+
+    const float dt = 1.f / 60.f;
+    const float kGravity = -2.8f; // sorry Newton
+    const float kDragCoeff = -0.8f;
+    const float epsilon = 0.001f;
+
+    float* py = y.data();
+    float* vy = velY.data();
+
+    #pragma omp simd
+    for (int i=0; i<numCircles; i++) {
+
+        // every value is computed and the results selected, so the loop
+        // has no branches
+        float oldVelocity = vy[i];
+        float oldPosition = py[i];
+        bool stopped = (oldVelocity == 0.f) & (oldPosition == 0.f);
+
+        // bounce, then v = u + at and the position (only along y-axis)
+        float bounced = oldVelocity * kDragCoeff;
+        float velocity = (oldPosition < 0) & (oldVelocity < 0.f) ? bounced : oldVelocity;
+        velocity += kGravity * dt;
+        float position = oldPosition + velocity * dt;
+
+        bool stop = (fabsf(velocity - oldVelocity) < epsilon)
+                  & (oldPosition < 0.0f)
+                  & (fabsf(position - oldPosition) < epsilon);
+
+        vy[i] = stopped ? oldVelocity : (stop ? 0.f : velocity);
+        py[i] = stopped ? oldPosition : (stop ? 0.f : position);
+    }
+}
+
+void
+CircleAnimation::advanceHypnosis() {
+
+    const float cutOff = 0.5f;
+    float* rad = radii.data();
+
+    #pragma omp simd
+    for (int i=0; i<numCircles; i++) {
+        float grown = rad[i] + 0.01f;
+        rad[i] = rad[i] > cutOff ? 0.02f : grown;
+    }
+}
+
+void
+CircleAnimation::advanceFireworks() {
+
+    const float dt = 1.f / 60.f;
+    const float maxDist = 0.25f;
+
+    for (int i=0; i<NUM_FIREWORKS; i++) {
+
+        // fire-work center
+        float cx = x[i];
+        float cy = y[i];
+        float rad = radii[i];
+
+        float* sx = &x[NUM_FIREWORKS + i * NUM_SPARKS];
+        float* sy = &y[NUM_FIREWORKS + i * NUM_SPARKS];
+        float* sz = &z[NUM_FIREWORKS + i * NUM_SPARKS];
+        float* vx = &velX[NUM_FIREWORKS + i * NUM_SPARKS];
+        float* vy = &velY[NUM_FIREWORKS + i * NUM_SPARKS];
+        float* vz = &velZ[NUM_FIREWORKS + i * NUM_SPARKS];
+
+        #pragma omp simd
+        for (int j=0; j<NUM_SPARKS; j++) {
+
+            float posX = sx[j] + vx[j] * dt;
+            float posY = sy[j] + vy[j] * dt;
+
+            float cxsx = posX - cx;
+            float cysy = posY - cy;
+            float dist = sqrt(cxsx * cxsx + cysy * cysy);
+
+            // past maxDist, restart from the fire-work's rim
+            bool restart = dist > maxDist;
+            float rimX = cx + sparkCos[j] * rad;
+            float rimY = cy + sparkSin[j] * rad;
+            sx[j] = restart ? rimX : posX;
+            sy[j] = restart ? rimY : posY;
+            sz[j] = restart ? 0.f : sz[j];
+            vx[j] = restart ? sparkVelX[j] : vx[j];
+            vy[j] = restart ? sparkVelY[j] : vy[j];
+            vz[j] = restart ? 0.f : vz[j];
+        }
+    }
+}
+
+// advance --
+//
+// One time step of the scene, the same update as
+// advanceCircleAnimation.
+void
+CircleAnimation::advance() {
+
+    if (sceneName == SNOWFLAKES) {
+        int numBlocks = (numCircles + SNOW_BLOCK - 1) / SNOW_BLOCK;
+
+        #pragma omp parallel for schedule(static)
+        for (int block=0; block<numBlocks; block++)
+            advanceSnowflakes(block * SNOW_BLOCK, std::min((block + 1) * SNOW_BLOCK, numCircles));
+    } else if (sceneName == BOUNCING_BALLS) {
+        advanceBouncingBalls();
+    } else if (sceneName == HYPNOSIS) {
+        advanceHypnosis();
+    } else if (sceneName == FIREWORKS) {
+        advanceFireworks();
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef __ANIMATION_H__
+#define __ANIMATION_H__
+
+#include <vector>
+
+#include "circleRenderer.h"
+
+// Advance the simulation of the scene one time step, updating the
+// circle arrays (3 floats per circle for position and velocity) in
+// place.  Shared by the CPU renderers so they animate identically.
+void
+advanceCircleAnimation(
+    SceneName sceneName,
+    int numCircles,
+    float* position,
+    float* velocity,
+    float* radius);
+
+
+// Particle update engine with the same results as
+// advanceCircleAnimation, bit for bit.  load() copies the circles into
+// planar (SoA) arrays, which advance() updates with vectorized loops,
+// split across cores for the large scenes.  Renderers read the current
+// state through the accessors.
+class CircleAnimation {
+
+private:
+
+    SceneName sceneName;
+    int numCircles;
+
+    std::vector<float> x, y, z;
+    std::vector<float> velX, velY, velZ;
+    std::vector<float> radii;
+
+    // fireworks: rim direction and velocity each spark restarts with
+    float sparkCos[NUM_SPARKS], sparkSin[NUM_SPARKS];
+    float sparkVelX[NUM_SPARKS], sparkVelY[NUM_SPARKS];
+
+    void advanceSnowflakes(int start, int end);
+
+    void advanceBouncingBalls();
+
+    void advanceHypnosis();
+
+    void advanceFireworks();
+
+public:
+
+    CircleAnimation();
+
+    void load(SceneName sceneName, int numCircles, const float* position,
+              const float* velocity, const float* radius);
+
+    void advance();
+
+    const float* getX() const { return x.data(); }
+    const float* getY() const { return y.data(); }
+    const float* getZ() const { return z.data(); }
+    const float* getRadius() const { return radii.data(); }
+    const float* getVelX() const { return velX.data(); }
+    const float* getVelY() const { return velY.data(); }
+    const float* getVelZ() const { return velZ.data(); }
+};
+
+#endif
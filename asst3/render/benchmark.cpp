@@ -1,24 +1,30 @@
+#include <algorithm>
 #include <string>
+#include <vector>
 #include <math.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "circleRenderer.h"
+#include "cpuParallelRenderer.h"
 #include "cycleTimer.h"
+#include "frameWriter.h"
 #include "image.h"
+#include "noise.h"
 #include "ppm.h"
+#include "refRenderer.h"
+#include "sceneLoader.h"
 
 
-static void compare_images(const Image* ref_image, const Image* cuda_image) {
+// Counts the color values of cuda_image that differ from ref_image by
+// more than the tolerance, printing each, and stops counting past 5.
+static int count_mismatches(const Image* ref_image, const Image* cuda_image) {
     int i;
 
     int mismatch_count = 0;
-    
-    if (ref_image->width != cuda_image->width || ref_image->height != cuda_image->height) {
-        printf ("Error : width or height of reference and cuda not matching\n");
-        printf ("Cuda : width = %d, height = %d\n", cuda_image->width, cuda_image->height);
-        printf ("Ref : width = %d, height = %d\n", ref_image->width, ref_image->height);
-        exit (1);
-    }
-    
+
     for (i = 0 ; i < 4 * ref_image->width * ref_image->height; i++) {
         // Compare with floating point error tolerance of 0.1f and ignore alpha
         if (fabs(ref_image->data[i] - cuda_image->data[i]) > 0.1f && i%4 != 3) {
@@ -40,13 +46,28 @@ static void compare_images(const Image* ref_image, const Image* cuda_image) {
         }
 
         // Ignore 5 errors - may come up because of rounding in distance calculation
-        if (mismatch_count > 5) {
-            printf ("ERROR : Mismatch detected between reference and actual\n");
-            exit (1);
-        }
+        if (mismatch_count > 5)
+            break;
 
     }
 
+    return mismatch_count;
+}
+
+static void compare_images(const Image* ref_image, const Image* cuda_image) {
+
+    if (ref_image->width != cuda_image->width || ref_image->height != cuda_image->height) {
+        printf ("Error : width or height of reference and cuda not matching\n");
+        printf ("Cuda : width = %d, height = %d\n", cuda_image->width, cuda_image->height);
+        printf ("Ref : width = %d, height = %d\n", ref_image->width, ref_image->height);
+        exit (1);
+    }
+
+    if (count_mismatches(ref_image, cuda_image) > 5) {
+        printf ("ERROR : Mismatch detected between reference and actual\n");
+        exit (1);
+    }
+
     printf ("***************** Correctness check passed **************************\n");
 }
 
@@ -55,7 +76,8 @@ startBenchmark(
     CircleRenderer* renderer,
     int startFrame,
     int totalFrames,
-    const std::string& frameFilename)
+    const std::string& frameFilename,
+    bool writePNG)
 {
 
     double totalClearTime = 0.f;
@@ -66,10 +88,15 @@ startBenchmark(
     double startTime= 0.f;
 
     bool dumpFrames = frameFilename.length() > 0;
+    const char* extension = writePNG ? "png" : "ppm";
 
     printf("\nRunning benchmark, %d frames, beginning at frame %d ...\n", totalFrames, startFrame);
     if (dumpFrames)
-        printf("Dumping frames to %s_xxx.ppm\n", frameFilename.c_str());
+        printf("Dumping frames to %s_xxx.%s\n", frameFilename.c_str(), extension);
+
+    // frames are written while the next ones render; File IO is the time
+    // the render loop spends handing them over, plus the final flush
+    FrameWriter frameWriter(writePNG);
 
     for (int frame=0; frame<startFrame + totalFrames; frame++) {
 
@@ -93,8 +120,8 @@ startBenchmark(
         if (frame >= startFrame) {
             if (dumpFrames) {
                 char filename[1024];
-                sprintf(filename, "%s_%04d.ppm", frameFilename.c_str(), frame);
-                writePPMImage(renderer->getImage(), filename);
+                sprintf(filename, "%s_%04d.%s", frameFilename.c_str(), frame, extension);
+                frameWriter.write(renderer->getImage(), filename);
                 //renderer->dumpParticles("snow.par");
             }
 
@@ -107,6 +134,10 @@ startBenchmark(
         }
     }
 
+    double startFlushTime = CycleTimer::currentSeconds();
+    frameWriter.flush();
+    totalFileSaveTime += CycleTimer::currentSeconds() - startFlushTime;
+
     double endTime = CycleTimer::currentSeconds();
     totalTime = endTime - startTime;
 
@@ -198,3 +229,265 @@ CheckBenchmark(
     printf("Overall:  %.4f sec (note units are seconds)\n", totalTime);
 
 }
+
+
+// Frame times of one renderer on one scene and image size
+struct SuiteResult {
+    const char* renderer;
+    SceneName sceneName;
+    int imageSize;
+    int numCircles;
+    std::vector<double> clearTimes;
+    std::vector<double> advanceTimes;
+    std::vector<double> renderTimes;
+    std::vector<double> frameTimes;
+    int mismatches;                     // worst frame against RefRenderer, counted up to 6
+};
+
+// nearest rank percentile, p in (0, 1], of at least one time
+static double
+percentile(std::vector<double> times, double p) {
+    if (times.empty()) {
+        fprintf(stderr, "Error: percentile of no frame times\n");
+        exit(1);
+    }
+    std::sort(times.begin(), times.end());
+    size_t rank = static_cast<size_t>(ceil(p * times.size()));
+    return times[std::max(rank, static_cast<size_t>(1)) - 1];
+}
+
+static void
+writeTimesJSON(FILE* fp, const char* name, const std::vector<double>& times) {
+    fprintf(fp, "\"%s\": {\"median\": %.6f, \"p99\": %.6f}", name,
+            1000. * percentile(times, .5), 1000. * percentile(times, .99));
+}
+
+static void
+writeSuiteJSON(const std::string& jsonFilename, int startFrame, int totalFrames,
+               const std::vector<SuiteResult>& results) {
+
+    FILE* fp = fopen(jsonFilename.c_str(), "w");
+    if (!fp) {
+        fprintf(stderr, "Error: could not open %s for write\n", jsonFilename.c_str());
+        exit(1);
+    }
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"start_frame\": %d,\n", startFrame);
+    fprintf(fp, "  \"frames\": %d,\n", totalFrames);
+    fprintf(fp, "  \"threads\": %d,\n", omp_get_max_threads());
+    fprintf(fp, "  \"reference\": \"cpuref\",\n");
+    fprintf(fp, "  \"results\": [\n");
+
+    for (size_t i=0; i<results.size(); i++) {
+
+        const SuiteResult& r = results[i];
+        double pixels = static_cast<double>(r.imageSize) * r.imageSize;
+        double medianFrameTime = percentile(r.frameTimes, .5);
+
+        fprintf(fp, "    {\"renderer\": \"%s\", \"scene\": \"%s\", \"size\": %d, \"circles\": %d,\n",
+                r.renderer, sceneNameString(r.sceneName), r.imageSize, r.numCircles);
+        fprintf(fp, "     ");
+        writeTimesJSON(fp, "clear_ms", r.clearTimes);
+        fprintf(fp, ", ");
+        writeTimesJSON(fp, "advance_ms", r.advanceTimes);
+        fprintf(fp, ",\n     ");
+        writeTimesJSON(fp, "render_ms", r.renderTimes);
+        fprintf(fp, ", ");
+        writeTimesJSON(fp, "frame_ms", r.frameTimes);
+        fprintf(fp, ",\n");
+        fprintf(fp, "     \"pixels_per_sec\": %.6g, \"circle_pixels_per_sec\": %.6g,\n",
+                pixels / medianFrameTime, r.numCircles * pixels / medianFrameTime);
+        fprintf(fp, "     \"mismatches\": %d, \"correct\": %s}%s\n", r.mismatches,
+                r.mismatches > 5 ? "false" : "true", i + 1 < results.size() ? "," : "");
+    }
+
+    fprintf(fp, "  ]\n");
+    fprintf(fp, "}\n");
+
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "Error: could not write %s\n", jsonFilename.c_str());
+        exit(1);
+    }
+}
+
+// startBenchmarkSuite --
+//
+// Runs every CPU renderer on every scene and image size for frames
+// [startFrame, startFrame + totalFrames), and writes the median and 99th
+// percentile of each stage's time, plus pixel and circle x pixel
+// throughput at the median frame time, to a JSON file.  The renderers
+// advance in lockstep, so every frame of the multicore renderers is
+// checked against RefRenderer with the tolerance of compare_images.
+// Returns false if any check failed.
+bool
+startBenchmarkSuite(
+    const std::vector<SceneName>& scenes,
+    const std::vector<int>& sizes,
+    int startFrame,
+    int totalFrames,
+    const std::string& jsonFilename)
+{
+    const int numRenderers = 3;
+    const char* rendererNames[numRenderers] = {"cpuref", "cpupar", "cpuhalf"};
+
+    std::vector<SuiteResult> results;
+    bool allCorrect = true;
+
+    printf("\nRunning benchmark suite, %d frames, beginning at frame %d ...\n", totalFrames, startFrame);
+
+    for (size_t s=0; s<scenes.size(); s++) {
+
+        // snowsingle renders the particles in snow.par, if there are any
+        if (scenes[s] == SNOWFLAKES_SINGLE_FRAME) {
+            FILE* file = fopen("snow.par", "r");
+            if (!file) {
+                printf("Skipping %s: no snow.par\n", sceneNameString(scenes[s]));
+                continue;
+            }
+            fclose(file);
+        }
+
+        int numCircles;
+        float* position;
+        float* velocity;
+        float* color;
+        float* radius;
+        loadCircleScene(scenes[s], numCircles, position, velocity, color, radius);
+        delete [] position;
+        delete [] velocity;
+        delete [] color;
+        delete [] radius;
+
+        for (size_t z=0; z<sizes.size(); z++) {
+
+            CircleRenderer* renderers[numRenderers] = {
+                new RefRenderer(), new CpuParallelRenderer(), new CpuParallelRenderer(TILE_PIXELS_HALF) };
+            SuiteResult runs[numRenderers];
+
+            for (int r=0; r<numRenderers; r++) {
+                renderers[r]->allocOutputImage(sizes[z], sizes[z]);
+                renderers[r]->loadScene(scenes[s]);
+                renderers[r]->setup();
+
+                runs[r].renderer = rendererNames[r];
+                runs[r].sceneName = scenes[s];
+                runs[r].imageSize = sizes[z];
+                runs[r].numCircles = numCircles;
+                runs[r].mismatches = 0;
+            }
+
+            for (int frame=0; frame<startFrame + totalFrames; frame++) {
+
+                for (int r=0; r<numRenderers; r++) {
+
+                    double startClearTime = CycleTimer::currentSeconds();
+                    renderers[r]->clearImage();
+                    double endClearTime = CycleTimer::currentSeconds();
+                    renderers[r]->advanceAnimation();
+                    double endAdvanceTime = CycleTimer::currentSeconds();
+                    renderers[r]->render();
+                    double endRenderTime = CycleTimer::currentSeconds();
+
+                    if (frame >= startFrame) {
+                        runs[r].clearTimes.push_back(endClearTime - startClearTime);
+                        runs[r].advanceTimes.push_back(endAdvanceTime - endClearTime);
+                        runs[r].renderTimes.push_back(endRenderTime - endAdvanceTime);
+                        runs[r].frameTimes.push_back(endRenderTime - startClearTime);
+                    }
+                }
+
+                if (frame >= startFrame) {
+                    for (int r=1; r<numRenderers; r++) {
+                        int mismatches = count_mismatches(renderers[0]->getImage(), renderers[r]->getImage());
+                        runs[r].mismatches = std::max(runs[r].mismatches, mismatches);
+                    }
+                }
+            }
+
+            for (int r=0; r<numRenderers; r++) {
+                bool correct = runs[r].mismatches <= 5;
+                allCorrect = allCorrect && correct;
+                printf("%-8s %-14s %5d   frame %10.4f ms median %10.4f ms p99   %s\n",
+                       rendererNames[r], sceneNameString(scenes[s]), sizes[z],
+                       1000. * percentile(runs[r].frameTimes, .5), 1000. * percentile(runs[r].frameTimes, .99),
+                       r == 0 ? "reference" : (correct ? "passed" : "MISMATCH"));
+                results.push_back(runs[r]);
+                delete renderers[r];
+            }
+        }
+    }
+
+    writeSuiteJSON(jsonFilename, startFrame, totalFrames, results);
+    printf("\nWrote %s\n", jsonFilename.c_str());
+
+    return allCorrect;
+}
+
+// startNoiseBenchmark --
+//
+// Evaluates the cell noise of the snowflake update (position scaled by
+// 10, 10 and 255) at every circle of the scene, one point at a time
+// with vec2CellNoise and in batches with vec2CellNoiseBatch, on one
+// thread, and reports evaluations per second.  Returns false if the
+// two disagree in any bit.
+bool
+startNoiseBenchmark(SceneName sceneName)
+{
+    // enough evaluations per pass to time reliably
+    const long minEvaluations = 1L << 25;
+
+    int numCircles;
+    float* position;
+    float* velocity;
+    float* color;
+    float* radius;
+    loadCircleScene(sceneName, numCircles, position, velocity, color, radius);
+
+    std::vector<float> x(numCircles), y(numCircles), z(numCircles);
+    for (int i=0; i<numCircles; i++) {
+        x[i] = position[3 * i];
+        y[i] = position[3 * i + 1];
+        z[i] = position[3 * i + 2];
+    }
+    delete [] position;
+    delete [] velocity;
+    delete [] color;
+    delete [] radius;
+
+    int repeats = static_cast<int>(std::max(1L, minEvaluations / std::max(numCircles, 1)));
+    double evaluations = static_cast<double>(repeats) * numCircles;
+
+    std::vector<float> scalarX(numCircles), scalarY(numCircles);
+    std::vector<float> batchX(numCircles), batchY(numCircles);
+
+    double startTime = CycleTimer::currentSeconds();
+    for (int r=0; r<repeats; r++) {
+        for (int i=0; i<numCircles; i++) {
+            float noiseInput[3] = {10.f * x[i], 10.f * y[i], 255.f * z[i]};
+            float noiseForce[2];
+            vec2CellNoise(noiseInput, noiseForce, i);
+            scalarX[i] = noiseForce[0];
+            scalarY[i] = noiseForce[1];
+        }
+    }
+    double scalarTime = CycleTimer::currentSeconds() - startTime;
+
+    startTime = CycleTimer::currentSeconds();
+    for (int r=0; r<repeats; r++)
+        vec2CellNoiseBatch(numCircles, x.data(), y.data(), z.data(), 10.f, 10.f, 255.f, 0,
+                           batchX.data(), batchY.data());
+    double batchTime = CycleTimer::currentSeconds() - startTime;
+
+    bool identical = memcmp(scalarX.data(), batchX.data(), numCircles * sizeof(float)) == 0 &&
+                     memcmp(scalarY.data(), batchY.data(), numCircles * sizeof(float)) == 0;
+
+    printf("\nCell noise, %s positions (%d points x %d passes):\n",
+           sceneNameString(sceneName), numCircles, repeats);
+    printf("vec2CellNoise:       %10.2f M evaluations/s\n", evaluations / scalarTime / 1e6);
+    printf("vec2CellNoiseBatch:  %10.2f M evaluations/s (%.2fx)\n", evaluations / batchTime / 1e6,
+           scalarTime / batchTime);
+    printf("Batch results %s\n", identical ? "identical" : "DIFFER");
+
+    return identical;
+}
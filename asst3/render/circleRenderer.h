@@ -35,6 +35,13 @@ public:
 
     virtual void loadScene(SceneName name) = 0;
 
+    // load the circles of a scene file (sceneFile.h) instead of a
+    // built-in scene
+    virtual void loadSceneFile(const char* filename) = 0;
+
+    // write the current circles to a scene file
+    virtual void dumpScene(const char* filename) = 0;
+
     virtual void allocOutputImage(int width, int height) = 0;
 
     virtual void clearImage() = 0;
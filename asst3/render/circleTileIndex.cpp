@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <omp.h>
+#include <string.h>
+
+#include "circleTileIndex.h"
+#include "util.h"
+
+
+CircleTileIndex::CircleTileIndex() {
+    width = height = 0;
+    tileSize = 0;
+    numTilesX = numTilesY = 0;
+    numCircles = 0;
+    numRebinned = 0;
+    tileOffsets.assign(1, 0);
+}
+
+// computeBox --
+//
+// Records the circle's current position and radius and its screen
+// bounding box, computed exactly like RefRenderer::render.
+void
+CircleTileIndex::computeBox(int circleIndex, const float* x, const float* y, const float* radius) {
+
+    float px = x[circleIndex];
+    float py = y[circleIndex];
+    float rad = radius[circleIndex];
+
+    float* circle = &binnedCircles[3 * circleIndex];
+    circle[0] = px;
+    circle[1] = py;
+    circle[2] = rad;
+
+    int* box = &circleBoxes[4 * circleIndex];
+    box[0] = CLAMP(static_cast<int>((px - rad) * width), 0, width);
+    box[1] = CLAMP(static_cast<int>((px + rad) * width)+1, 0, width);
+    box[2] = CLAMP(static_cast<int>((py - rad) * height), 0, height);
+    box[3] = CLAMP(static_cast<int>((py + rad) * height)+1, 0, height);
+}
+
+// forEachTile --
+//
+// Calls visit(tile) for every tile the circle is binned into, in
+// increasing tile order, using the box and values of the last
+// computeBox.
+template<typename Visit>
+void
+CircleTileIndex::forEachTile(int circleIndex, Visit visit) const {
+
+    const int* box = &circleBoxes[4 * circleIndex];
+    if (box[0] >= box[1] || box[2] >= box[3])
+        return;
+
+    int tileMinX = box[0] / tileSize;
+    int tileMaxX = (box[1] - 1) / tileSize;
+    int tileMinY = box[2] / tileSize;
+    int tileMaxY = (box[3] - 1) / tileSize;
+
+    // a box one tile wide or high crosses the circle's center line, so
+    // the circle reaches every tile the box overlaps
+    bool exactTest = tileMinX != tileMaxX && tileMinY != tileMaxY;
+
+    const float* circle = &binnedCircles[3 * circleIndex];
+    float invWidth = 1.f / width;
+    float invHeight = 1.f / height;
+
+    for (int tileY=tileMinY; tileY<=tileMaxY; tileY++) {
+        float boxB = invHeight * static_cast<float>(tileY * tileSize);
+        float boxT = invHeight * static_cast<float>(std::min((tileY + 1) * tileSize, height));
+
+        for (int tileX=tileMinX; tileX<=tileMaxX; tileX++) {
+            if (exactTest) {
+                float boxL = invWidth * static_cast<float>(tileX * tileSize);
+                float boxR = invWidth * static_cast<float>(std::min((tileX + 1) * tileSize, width));
+                if (!circleInBox(circle[0], circle[1], circle[2], boxL, boxR, boxT, boxB))
+                    continue;
+            }
+            visit(tileY * numTilesX + tileX);
+        }
+    }
+}
+
+// rebuild --
+//
+// Bins all circles.  Every thread takes a contiguous range of circles
+// and counts its circles per tile; an exclusive scan over (tile,
+// thread) turns the counts into write offsets, so when the threads then
+// scatter their circles, the ranges of lower threads come first and
+// each tile list stays sorted by circle index.
+void
+CircleTileIndex::rebuild(const float* x, const float* y, const float* radius) {
+
+    int numTiles = numTilesX * numTilesY;
+
+    binnedCircles.resize(3 * numCircles);
+    circleBoxes.resize(4 * numCircles);
+    tileOffsets.resize(numTiles + 1);
+
+    #pragma omp parallel
+    {
+        int numThreads = omp_get_num_threads();
+        int thread = omp_get_thread_num();
+        int circleStart = static_cast<int>(static_cast<long>(numCircles) * thread / numThreads);
+        int circleEnd = static_cast<int>(static_cast<long>(numCircles) * (thread + 1) / numThreads);
+
+        #pragma omp single
+        binCounts.assign(static_cast<size_t>(numThreads) * numTiles, 0);
+
+        int* counts = &binCounts[static_cast<size_t>(thread) * numTiles];
+
+        for (int circleIndex=circleStart; circleIndex<circleEnd; circleIndex++) {
+            computeBox(circleIndex, x, y, radius);
+            forEachTile(circleIndex, [counts](int tile) { counts[tile]++; });
+        }
+
+        #pragma omp barrier
+        #pragma omp single
+        {
+            int offset = 0;
+            for (int tile=0; tile<numTiles; tile++) {
+                tileOffsets[tile] = offset;
+                for (int t=0; t<numThreads; t++) {
+                    int count = binCounts[static_cast<size_t>(t) * numTiles + tile];
+                    binCounts[static_cast<size_t>(t) * numTiles + tile] = offset;
+                    offset += count;
+                }
+            }
+            tileOffsets[numTiles] = offset;
+            tileCircles.resize(offset);
+        }
+
+        int* lists = tileCircles.data();
+        for (int circleIndex=circleStart; circleIndex<circleEnd; circleIndex++)
+            forEachTile(circleIndex, [counts, lists, circleIndex](int tile) {
+                lists[counts[tile]++] = circleIndex;
+            });
+    }
+}
+
+// rebinDirty --
+//
+// Re-bins the circles of dirtyCircles (sorted).  Only the tiles they
+// were or are now binned into are rebuilt, by merging the tile's
+// remaining entries with the dirty circles added to it; the lists of
+// the other tiles are copied over unchanged.
+void
+CircleTileIndex::rebinDirty(const float* x, const float* y, const float* radius) {
+
+    int numTiles = numTilesX * numTilesY;
+    int numDirty = dirtyCircles.size();
+
+    touchedTiles.assign(numTiles, 0);
+    addedOffsets.assign(numTiles + 1, 0);
+    dirtyFlags.assign(numCircles, 0);
+
+    for (int i=0; i<numDirty; i++) {
+        int circleIndex = dirtyCircles[i];
+        dirtyFlags[circleIndex] = 1;
+        forEachTile(circleIndex, [this](int tile) { touchedTiles[tile] = 1; });
+        computeBox(circleIndex, x, y, radius);
+        forEachTile(circleIndex, [this](int tile) {
+            touchedTiles[tile] = 1;
+            addedOffsets[tile + 1]++;
+        });
+    }
+
+    for (int tile=0; tile<numTiles; tile++)
+        addedOffsets[tile + 1] += addedOffsets[tile];
+
+    addedCircles.resize(addedOffsets[numTiles]);
+    binCounts.assign(addedOffsets.begin(), addedOffsets.end() - 1);
+    for (int i=0; i<numDirty; i++) {
+        int circleIndex = dirtyCircles[i];
+        forEachTile(circleIndex, [this, circleIndex](int tile) {
+            addedCircles[binCounts[tile]++] = circleIndex;
+        });
+    }
+
+    newTileOffsets.resize(numTiles + 1);
+    newTileOffsets[0] = 0;
+
+    #pragma omp parallel for schedule(static)
+    for (int tile=0; tile<numTiles; tile++) {
+        int count = tileOffsets[tile+1] - tileOffsets[tile];
+        if (touchedTiles[tile]) {
+            for (int i=tileOffsets[tile]; i<tileOffsets[tile+1]; i++)
+                count -= dirtyFlags[tileCircles[i]];
+            count += addedOffsets[tile+1] - addedOffsets[tile];
+        }
+        newTileOffsets[tile+1] = count;
+    }
+
+    for (int tile=0; tile<numTiles; tile++)
+        newTileOffsets[tile+1] += newTileOffsets[tile];
+    newTileCircles.resize(newTileOffsets[numTiles]);
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int tile=0; tile<numTiles; tile++) {
+
+        const int* oldList = &tileCircles[tileOffsets[tile]];
+        const int* oldEnd = tileCircles.data() + tileOffsets[tile+1];
+        int* dst = newTileCircles.data() + newTileOffsets[tile];
+
+        if (!touchedTiles[tile]) {
+            memcpy(dst, oldList, (oldEnd - oldList) * sizeof(int));
+            continue;
+        }
+
+        const int* added = addedCircles.data() + addedOffsets[tile];
+        const int* addedEnd = addedCircles.data() + addedOffsets[tile+1];
+
+        while (oldList < oldEnd || added < addedEnd) {
+            if (oldList < oldEnd && dirtyFlags[*oldList]) {
+                oldList++;
+            } else if (added == addedEnd || (oldList < oldEnd && *oldList < *added)) {
+                *dst++ = *oldList++;
+            } else {
+                *dst++ = *added++;
+            }
+        }
+    }
+
+    tileOffsets.swap(newTileOffsets);
+    tileCircles.swap(newTileCircles);
+}
+
+void
+CircleTileIndex::update(int newWidth, int newHeight, int newTileSize, int newNumCircles,
+                        const float* x, const float* y, const float* radius) {
+
+    if (newWidth != width || newHeight != height || newTileSize != tileSize ||
+        newNumCircles != numCircles) {
+
+        width = newWidth;
+        height = newHeight;
+        tileSize = newTileSize;
+        numTilesX = (width + tileSize - 1) / tileSize;
+        numTilesY = (height + tileSize - 1) / tileSize;
+        numCircles = newNumCircles;
+
+        rebuild(x, y, radius);
+        numRebinned = numCircles;
+        return;
+    }
+
+    dirtyCircles.clear();
+    for (int i=0; i<numCircles; i++) {
+        const float* circle = &binnedCircles[3 * i];
+        if (x[i] != circle[0] || y[i] != circle[1] || radius[i] != circle[2])
+            dirtyCircles.push_back(i);
+    }
+
+    numRebinned = dirtyCircles.size();
+
+    // past a quarter of the circles, merging costs more than binning
+    // everything again
+    if (numRebinned > numCircles / 4)
+        rebuild(x, y, radius);
+    else if (numRebinned > 0)
+        rebinDirty(x, y, radius);
+}
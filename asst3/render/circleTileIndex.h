@@ -0,0 +1,99 @@
+#ifndef __CIRCLE_TILE_INDEX_H__
+#define __CIRCLE_TILE_INDEX_H__
+
+#include <vector>
+
+
+// circleInBox --
+//
+// True circle in box test, CPU version of the one in
+// circleBoxTest.cu_inl.  The box is given in normalized coordinates by
+// its left, right, top (larger y) and bottom edges.
+inline bool
+circleInBox(
+    float circleX, float circleY, float circleRadius,
+    float boxL, float boxR, float boxT, float boxB)
+{
+    // clamp circle center to box (finds the closest point on the box)
+    float closestX = (circleX > boxL) ? ((circleX < boxR) ? circleX : boxR) : boxL;
+    float closestY = (circleY > boxB) ? ((circleY < boxT) ? circleY : boxT) : boxB;
+
+    float distX = closestX - circleX;
+    float distY = closestY - circleY;
+
+    return ((distX*distX) + (distY*distY)) <= (circleRadius*circleRadius);
+}
+
+
+// Uniform grid of square screen tiles listing, for every tile, the
+// circles that may cover one of its pixels, in increasing circle index
+// order.  A circle is a candidate for the tiles its screen bounding box
+// overlaps (the conservative test); when that box spans several tiles,
+// each candidate tile is confirmed with circleInBox against the tile's
+// edges, which lie half a pixel outside the pixel centers that are
+// shaded, so rounding cannot drop a covered pixel.
+//
+// update() remembers the position and radius each circle was binned
+// with: when only some circles changed since the last call, only those
+// are re-binned and the lists of the other tiles are carried over.
+class CircleTileIndex {
+
+private:
+
+    int width, height;
+    int tileSize;
+    int numTilesX, numTilesY;
+    int numCircles;
+    int numRebinned;
+
+    std::vector<float> binnedCircles;  // [x, y, radius] each circle was binned with
+    std::vector<int> circleBoxes;      // screen bounding box of each circle [minX, maxX, minY, maxY)
+    std::vector<int> tileOffsets;      // tile t owns tileCircles[tileOffsets[t], tileOffsets[t+1])
+    std::vector<int> tileCircles;
+
+    // scratch space, kept between frames to avoid reallocating it
+    std::vector<int> binCounts;
+    std::vector<int> newTileOffsets;
+    std::vector<int> newTileCircles;
+    std::vector<int> dirtyCircles;
+    std::vector<char> dirtyFlags;
+    std::vector<char> touchedTiles;
+    std::vector<int> addedOffsets;
+    std::vector<int> addedCircles;
+
+    void computeBox(int circleIndex, const float* x, const float* y, const float* radius);
+
+    template<typename Visit>
+    void forEachTile(int circleIndex, Visit visit) const;
+
+    void rebuild(const float* x, const float* y, const float* radius);
+
+    void rebinDirty(const float* x, const float* y, const float* radius);
+
+public:
+
+    CircleTileIndex();
+
+    // Bins numCircles circles (centers x, y in normalized coordinates)
+    // into tiles of tileSize x tileSize pixels of a width x height
+    // image.
+    void update(int width, int height, int tileSize, int numCircles,
+                const float* x, const float* y, const float* radius);
+
+    int getNumTilesX() const { return numTilesX; }
+    int getNumTilesY() const { return numTilesY; }
+
+    // circles of the tile, in increasing index order
+    const int* tileBegin(int tile) const { return tileCircles.data() + tileOffsets[tile]; }
+    const int* tileEnd(int tile) const { return tileCircles.data() + tileOffsets[tile+1]; }
+
+    // screen bounding box of the circle, [minX, maxX) x [minY, maxY),
+    // clamped to the image like RefRenderer::render
+    const int* getCircleBox(int circleIndex) const { return &circleBoxes[4 * circleIndex]; }
+
+    // circles binned by the last update(), numCircles for a full build
+    int getNumRebinned() const { return numRebinned; }
+};
+
+
+#endif
@@ -0,0 +1,419 @@
+#include <algorithm>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include <math.h>
+#include <stdio.h>
+
+#include "cpuParallelRenderer.h"
+#include "animation.h"
+#include "image.h"
+#include "sceneFile.h"
+#include "sceneLoader.h"
+#include "tiledImage.h"
+#include "util.h"
+
+// Side of the square screen tiles, in pixels, the tiles of the image
+// storage.  Small enough that there are many more tiles than cores for
+// load balance, large enough that a circle overlaps only a few of them.
+#define TILE_SIZE IMAGE_TILE_SIZE
+
+
+CpuParallelRenderer::CpuParallelRenderer(TilePixelFormat format) {
+    image = NULL;
+    tiles = NULL;
+    pixelFormat = format;
+
+    numCircles = 0;
+    position = NULL;
+    velocity = NULL;
+    color = NULL;
+    radius = NULL;
+
+    circleX = circleY = circleZ = circleRadius = NULL;
+}
+
+CpuParallelRenderer::~CpuParallelRenderer() {
+
+    if (image) {
+        delete image;
+        delete tiles;
+    }
+
+    if (position) {
+        delete [] position;
+        delete [] velocity;
+        delete [] color;
+        delete [] radius;
+    }
+}
+
+// getImage --
+//
+// The frame lives in the tiled storage; it is converted to the linear
+// image only when the image is asked for.
+const Image*
+CpuParallelRenderer::getImage() {
+    tiles->toImage(image);
+    return image;
+}
+
+void
+CpuParallelRenderer::setup() {
+    // nothing to do here
+}
+
+void
+CpuParallelRenderer::allocOutputImage(int width, int height) {
+
+    if (image) {
+        delete image;
+        delete tiles;
+    }
+    image = new Image(width, height);
+    tiles = new TiledImage(width, height, pixelFormat);
+}
+
+// clearImage --
+//
+// Same result as RefRenderer::clearImage.  Only the color of every row
+// is computed here; no pixel is written until a tile is shaded or the
+// image is converted.
+void
+CpuParallelRenderer::clearImage() {
+
+    bool snow = sceneName == SNOWFLAKES || sceneName == SNOWFLAKES_SINGLE_FRAME;
+    int height = image->height;
+
+    clearColors.resize(4 * height);
+    for (int j=0; j<height; j++) {
+        float shade = snow ? .4f + .45f * static_cast<float>(height-j) / height : 1.f;
+        clearColors[4 * j] = clearColors[4 * j + 1] = clearColors[4 * j + 2] = shade;
+        clearColors[4 * j + 3] = 1.f;
+    }
+
+    tiles->clear(clearColors.data());
+}
+
+void
+CpuParallelRenderer::loadScene(SceneName scene) {
+    sceneName = scene;
+    loadCircleScene(sceneName, numCircles, position, velocity, color, radius);
+    animation.load(sceneName, numCircles, position, velocity, radius);
+}
+
+void
+CpuParallelRenderer::loadSceneFile(const char* filename) {
+    loadCircleSceneFile(filename, sceneName, numCircles, position, velocity, color, radius);
+    animation.load(sceneName, numCircles, position, velocity, radius);
+}
+
+// dumpScene --
+//
+// Writes the animation's current (planar) state; the colors never
+// change.
+void
+CpuParallelRenderer::dumpScene(const char* filename) {
+
+    SceneFileArray arrays[SCENE_FILE_NUM_ARRAYS] = {
+        {animation.getX(), 1}, {animation.getY(), 1}, {animation.getZ(), 1},
+        {animation.getVelX(), 1}, {animation.getVelY(), 1}, {animation.getVelZ(), 1},
+        {color, 3}, {color + 1, 3}, {color + 2, 3},
+        {animation.getRadius(), 1},
+    };
+    writeCircleSceneFile(filename, sceneName, numCircles, arrays);
+}
+
+void
+CpuParallelRenderer::advanceAnimation() {
+    animation.advance();
+}
+
+// Shading constants of one circle
+struct CircleShading {
+    float px, py, pz;
+    float rad, maxDist;
+    float colR, colG, colB;
+    float maxAlpha;        // snowflakes only
+};
+
+#ifdef __AVX2__
+
+// exp(x) for the snowflake falloff, x in [-4, 0]: 2^n times a degree 5
+// polynomial for 2^f, relative error below 3e-7
+static inline __m256
+expApprox(__m256 x) {
+
+    x = _mm256_max_ps(x, _mm256_set1_ps(-80.f));
+    __m256 t = _mm256_mul_ps(x, _mm256_set1_ps(1.44269504f));
+    __m256 n = _mm256_floor_ps(t);
+    __m256 f = _mm256_sub_ps(t, n);
+
+    __m256 p = _mm256_set1_ps(1.8775767e-3f);
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(8.9893397e-3f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(5.5826318e-2f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(2.4015361e-1f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(6.9315308e-1f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(9.9999994e-1f));
+
+    __m256i exponent = _mm256_slli_epi32(
+        _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(exponent));
+}
+
+// shadeRow --
+//
+// Blends the circle into pixels [minX, maxX) of one row of the tile,
+// 8 pixels at a time starting from an 8-aligned column of the tile.
+// Lanes outside the span or the circle get alpha = 0, which leaves the
+// pixel unchanged.  The scene type is a template argument so the
+// snowflake test is not evaluated per pixel.
+template<bool Snow>
+static inline void
+shadeRow(TilePixels& tile, int rowStart, int tileMinX, int minX, int maxX,
+         float pixelCenterNormY, float invWidth, const CircleShading& circle) {
+
+    const __m256 lanes = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+
+    float diffY = circle.py - pixelCenterNormY;
+    __m256 distY = _mm256_set1_ps(diffY * diffY);
+    __m256 spanMin = _mm256_set1_ps(static_cast<float>(minX));
+    __m256 spanMax = _mm256_set1_ps(static_cast<float>(maxX));
+    __m256 px = _mm256_set1_ps(circle.px);
+    __m256 maxDist = _mm256_set1_ps(circle.maxDist);
+    __m256 one = _mm256_set1_ps(1.f);
+
+    for (int x=minX - ((minX - tileMinX) & 7); x<maxX; x+=8) {
+
+        __m256 pixelX = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), lanes);
+        __m256 mask = _mm256_and_ps(_mm256_cmp_ps(pixelX, spanMin, _CMP_GE_OQ),
+                                    _mm256_cmp_ps(pixelX, spanMax, _CMP_LT_OQ));
+
+        // same operations as RefRenderer::shadePixel, so the same pixels
+        // pass the inside test
+        __m256 pixelCenterNormX = _mm256_mul_ps(_mm256_set1_ps(invWidth),
+                                                _mm256_add_ps(pixelX, _mm256_set1_ps(.5f)));
+        __m256 diffX = _mm256_sub_ps(px, pixelCenterNormX);
+        __m256 pixelDist = _mm256_add_ps(_mm256_mul_ps(diffX, diffX), distY);
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(pixelDist, maxDist, _CMP_LE_OQ));
+
+        if (_mm256_movemask_ps(mask) == 0)
+            continue;
+
+        __m256 colR, colG, colB, alpha;
+
+        if (Snow) {
+            // lookupColor with the 5 entry table (padded to 8) in
+            // registers
+            const __m256 tableR = _mm256_setr_ps(1.f, 1.f, .8f, .8f, .8f, .8f, .8f, .8f);
+            const __m256 tableG = _mm256_setr_ps(1.f, 1.f, .9f, .9f, .8f, .8f, .8f, .8f);
+            const __m256 tableB = _mm256_set1_ps(1.f);
+            const float falloffScale = 4.f;
+
+            __m256 normPixelDist = _mm256_div_ps(_mm256_sqrt_ps(pixelDist),
+                                                 _mm256_set1_ps(circle.rad));
+            __m256 scaledCoord = _mm256_mul_ps(normPixelDist, _mm256_set1_ps(4.f));
+            __m256i base = _mm256_min_epi32(_mm256_cvttps_epi32(scaledCoord),
+                                            _mm256_set1_epi32(4));
+            __m256i next = _mm256_add_epi32(base, _mm256_set1_epi32(1));
+            __m256 weight = _mm256_sub_ps(scaledCoord, _mm256_cvtepi32_ps(base));
+            __m256 oneMinusWeight = _mm256_sub_ps(one, weight);
+
+            colR = _mm256_fmadd_ps(oneMinusWeight, _mm256_permutevar8x32_ps(tableR, base),
+                                   _mm256_mul_ps(weight, _mm256_permutevar8x32_ps(tableR, next)));
+            colG = _mm256_fmadd_ps(oneMinusWeight, _mm256_permutevar8x32_ps(tableG, base),
+                                   _mm256_mul_ps(weight, _mm256_permutevar8x32_ps(tableG, next)));
+            colB = tableB;
+
+            __m256 exponent = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(-falloffScale), normPixelDist),
+                                            normPixelDist);
+            alpha = _mm256_mul_ps(_mm256_set1_ps(circle.maxAlpha), expApprox(exponent));
+        } else {
+            colR = _mm256_set1_ps(circle.colR);
+            colG = _mm256_set1_ps(circle.colG);
+            colB = _mm256_set1_ps(circle.colB);
+            alpha = _mm256_set1_ps(.5f);
+        }
+
+        alpha = _mm256_and_ps(mask, alpha);
+        __m256 oneMinusAlpha = _mm256_sub_ps(one, alpha);
+
+        int i = rowStart + x - tileMinX;
+        _mm256_store_ps(&tile.r[i], _mm256_fmadd_ps(alpha, colR, _mm256_mul_ps(oneMinusAlpha, _mm256_load_ps(&tile.r[i]))));
+        _mm256_store_ps(&tile.g[i], _mm256_fmadd_ps(alpha, colG, _mm256_mul_ps(oneMinusAlpha, _mm256_load_ps(&tile.g[i]))));
+        _mm256_store_ps(&tile.b[i], _mm256_fmadd_ps(alpha, colB, _mm256_mul_ps(oneMinusAlpha, _mm256_load_ps(&tile.b[i]))));
+        _mm256_store_ps(&tile.a[i], _mm256_add_ps(_mm256_load_ps(&tile.a[i]), alpha));
+    }
+}
+
+#else
+
+static inline void
+lookupColor(float coord, float& r, float& g, float& b) {
+
+    const int N = 5;
+
+    float lookupTable[N][3] = {
+        {1.f, 1.f, 1.f},
+        {1.f, 1.f, 1.f},
+        {.8f, .9f, 1.f},
+        {.8f, .9f, 1.f},
+        {.8f, 0.8f, 1.f},
+    };
+
+    float scaledCoord = coord * (N-1);
+
+    int base = std::min(static_cast<int>(scaledCoord), N-1);
+
+    // linearly interpolate between values in the table based on the
+    // value of coord
+    float weight = scaledCoord - static_cast<float>(base);
+    float oneMinusWeight = 1.f - weight;
+
+    r = (oneMinusWeight * lookupTable[base][0]) + (weight * lookupTable[base+1][0]);
+    g = (oneMinusWeight * lookupTable[base][1]) + (weight * lookupTable[base+1][1]);
+    b = (oneMinusWeight * lookupTable[base][2]) + (weight * lookupTable[base+1][2]);
+}
+
+// shadeRow --
+//
+// Portable version: RefRenderer::shadePixel over pixels [minX, maxX) of
+// one row of the tile, with the scene test hoisted out of the loop.
+template<bool Snow>
+static inline void
+shadeRow(TilePixels& tile, int rowStart, int tileMinX, int minX, int maxX,
+         float pixelCenterNormY, float invWidth, const CircleShading& circle) {
+
+    float diffY = circle.py - pixelCenterNormY;
+
+    for (int pixelX=minX; pixelX<maxX; pixelX++) {
+
+        float pixelCenterNormX = invWidth * (static_cast<float>(pixelX) + 0.5f);
+        float diffX = circle.px - pixelCenterNormX;
+        float pixelDist = diffX * diffX + diffY * diffY;
+
+        // circle does not contribute to the image
+        if (pixelDist > circle.maxDist)
+            continue;
+
+        float colR, colG, colB;
+        float alpha;
+
+        if (Snow) {
+            const float falloffScale = 4.f;
+
+            float normPixelDist = sqrt(pixelDist) / circle.rad;
+            lookupColor(normPixelDist, colR, colG, colB);
+            alpha = circle.maxAlpha * exp(-1.f * falloffScale * normPixelDist * normPixelDist);
+        } else {
+            colR = circle.colR;
+            colG = circle.colG;
+            colB = circle.colB;
+            alpha = .5f;
+        }
+
+        int i = rowStart + pixelX - tileMinX;
+        float oneMinusAlpha = 1.f - alpha;
+        tile.r[i] = alpha * colR + oneMinusAlpha * tile.r[i];
+        tile.g[i] = alpha * colG + oneMinusAlpha * tile.g[i];
+        tile.b[i] = alpha * colB + oneMinusAlpha * tile.b[i];
+        tile.a[i] += alpha;
+    }
+}
+
+#endif
+
+// shadeTile --
+//
+// Blends every circle of the tile's list into the pixels of the tile
+// covered by the circle's bounding box, in list (= circle index) order.
+// The tile is loaded from the tiled storage (its background if it was
+// cleared) and stored back when done.
+template<bool Snow>
+void
+CpuParallelRenderer::shadeTile(int tile) {
+
+    const int* tileBegin = tileIndex.tileBegin(tile);
+    const int* tileEnd = tileIndex.tileEnd(tile);
+
+    if (tileBegin == tileEnd)
+        return;
+
+    int width = image->width;
+    int tileMinX = (tile % tileIndex.getNumTilesX()) * TILE_SIZE;
+    int tileMinY = (tile / tileIndex.getNumTilesX()) * TILE_SIZE;
+    int tileMaxX = std::min(tileMinX + TILE_SIZE, width);
+    int tileMaxY = std::min(tileMinY + TILE_SIZE, image->height);
+
+    TilePixels pixels;
+    tiles->loadTile(tile, pixels);
+
+    float invWidth = 1.f / width;
+    float invHeight = 1.f / image->height;
+
+    const float* x = circleX;
+    const float* y = circleY;
+    const float* z = circleZ;
+    const float* rad = circleRadius;
+
+    for (const int* i=tileBegin; i<tileEnd; i++) {
+
+        int circleIndex = *i;
+        int index3 = 3 * circleIndex;
+
+        CircleShading circle;
+        circle.px = x[circleIndex];
+        circle.py = y[circleIndex];
+        circle.pz = z[circleIndex];
+        circle.rad = rad[circleIndex];
+        circle.maxDist = circle.rad * circle.rad;
+        circle.colR = color[index3];
+        circle.colG = color[index3+1];
+        circle.colB = color[index3+2];
+        circle.maxAlpha = .5f * CLAMP(.6f + .4f * (1.f-circle.pz), 0.f, 1.f);
+
+        const int* box = tileIndex.getCircleBox(circleIndex);
+        int minX = std::max(box[0], tileMinX);
+        int maxX = std::min(box[1], tileMaxX);
+        int minY = std::max(box[2], tileMinY);
+        int maxY = std::min(box[3], tileMaxY);
+
+        for (int pixelY=minY; pixelY<maxY; pixelY++) {
+            float pixelCenterNormY = invHeight * (static_cast<float>(pixelY) + 0.5f);
+            shadeRow<Snow>(pixels, (pixelY - tileMinY) * TILE_SIZE, tileMinX, minX, maxX,
+                           pixelCenterNormY, invWidth, circle);
+        }
+    }
+
+    tiles->storeTile(tile, pixels);
+}
+
+void
+CpuParallelRenderer::render() {
+    renderFrame(animation.getX(), animation.getY(), animation.getZ(), animation.getRadius());
+}
+
+void
+CpuParallelRenderer::renderFrame(const float* x, const float* y, const float* z, const float* rad) {
+
+    circleX = x;
+    circleY = y;
+    circleZ = z;
+    circleRadius = rad;
+
+    tileIndex.update(image->width, image->height, TILE_SIZE, numCircles, x, y, rad);
+
+    int numTiles = tileIndex.getNumTilesX() * tileIndex.getNumTilesY();
+
+    // tiles differ a lot in cost (the snow piles up at the bottom of
+    // the screen), hand them out dynamically
+    if (sceneName == SNOWFLAKES || sceneName == SNOWFLAKES_SINGLE_FRAME) {
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int tile=0; tile<numTiles; tile++)
+            shadeTile<true>(tile);
+    } else {
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int tile=0; tile<numTiles; tile++)
+            shadeTile<false>(tile);
+    }
+}
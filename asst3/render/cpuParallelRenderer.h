@@ -0,0 +1,82 @@
+#ifndef __CPU_PARALLEL_RENDERER_H__
+#define __CPU_PARALLEL_RENDERER_H__
+
+#include "animation.h"
+#include "circleRenderer.h"
+#include "circleTileIndex.h"
+#include "tiledImage.h"
+
+
+// Multicore CPU renderer.  Circles are first binned into square screen
+// tiles, then the tiles are shaded in parallel: every tile owns its
+// pixels and walks its circle list in index order, so each pixel blends
+// the circles in the same order as RefRenderer.  Tiles are shaded in
+// planar form, 8 pixels of a row per AVX2 instruction, and the frame is
+// kept in tiled form until getImage().
+class CpuParallelRenderer : public CircleRenderer {
+
+private:
+
+    Image* image;
+    SceneName sceneName;
+
+    // the frame, in tiles of TILE_SIZE pixels; image holds it in linear
+    // form after getImage()
+    TiledImage* tiles;
+    TilePixelFormat pixelFormat;
+    std::vector<float> clearColors;
+
+    int numCircles;
+    float* position;
+    float* velocity;
+    float* color;
+    float* radius;
+
+    // current positions and radii, in planar form; position, velocity
+    // and radius above keep the scene as loaded
+    CircleAnimation animation;
+
+    // circles of each screen tile, kept between frames so static
+    // circles are not binned again
+    CircleTileIndex tileIndex;
+
+    // planar circle state of the frame being rendered
+    const float* circleX;
+    const float* circleY;
+    const float* circleZ;
+    const float* circleRadius;
+
+    template<bool Snow>
+    void shadeTile(int tile);
+
+public:
+
+    CpuParallelRenderer(TilePixelFormat pixelFormat = TILE_PIXELS_FLOAT);
+    virtual ~CpuParallelRenderer();
+
+    const Image* getImage();
+
+    void setup();
+
+    void loadScene(SceneName name);
+
+    void loadSceneFile(const char* filename);
+
+    void dumpScene(const char* filename);
+
+    void allocOutputImage(int width, int height);
+
+    void clearImage();
+
+    void advanceAnimation();
+
+    void render();
+
+    // Renders the loaded scene with the circles at the given positions
+    // and radii (planar, e.g. a CircleAnimation advanced elsewhere)
+    // instead of the renderer's own animation state.
+    void renderFrame(const float* x, const float* y, const float* z, const float* radius);
+};
+
+
+#endif
@@ -11,6 +11,7 @@
 #include "cudaRenderer.h"
 #include "image.h"
 #include "noise.h"
+#include "sceneFile.h"
 #include "sceneLoader.h"
 #include "util.h"
 
@@ -585,6 +586,25 @@ CudaRenderer::loadScene(SceneName scene) {
     loadCircleScene(sceneName, numCircles, position, velocity, color, radius);
 }
 
+void
+CudaRenderer::loadSceneFile(const char* filename) {
+    loadCircleSceneFile(filename, sceneName, numCircles, position, velocity, color, radius);
+}
+
+// dumpScene --
+//
+// The animation runs on the device, so the current positions,
+// velocities and radii are copied back before writing them.
+void
+CudaRenderer::dumpScene(const char* filename) {
+
+    cudaMemcpy(position, cudaDevicePosition, sizeof(float) * 3 * numCircles, cudaMemcpyDeviceToHost);
+    cudaMemcpy(velocity, cudaDeviceVelocity, sizeof(float) * 3 * numCircles, cudaMemcpyDeviceToHost);
+    cudaMemcpy(radius, cudaDeviceRadius, sizeof(float) * numCircles, cudaMemcpyDeviceToHost);
+
+    writeCircleSceneFile(filename, sceneName, numCircles, position, velocity, color, radius);
+}
+
 void
 CudaRenderer::setup() {
 
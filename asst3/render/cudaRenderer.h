@@ -41,6 +41,10 @@ public:
 
     void loadScene(SceneName name);
 
+    void loadSceneFile(const char* filename);
+
+    void dumpScene(const char* filename);
+
     void allocOutputImage(int width, int height);
 
     void clearImage();
@@ -0,0 +1,91 @@
+#include <stdio.h>
+
+#include "cycleTimer.h"
+#include "frameWriter.h"
+#include "image.h"
+#include "ppm.h"
+
+
+FrameWriter::FrameWriter(bool writePNG) {
+    png = writePNG;
+    head = 0;
+    count = 0;
+    done = false;
+    writeTime = 0.;
+    thread = std::thread(&FrameWriter::run, this);
+}
+
+FrameWriter::~FrameWriter() {
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        done = true;
+    }
+    changed.notify_all();
+    thread.join();
+}
+
+void
+FrameWriter::write(const Image* image, const std::string& filename) {
+
+    int slot;
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [this] { return count < 2; });
+        slot = (head + count) % 2;
+    }
+
+    // the slot is not queued, the writer thread does not touch it
+    Frame& frame = frames[slot];
+    frame.rgb.resize(3L * image->width * image->height + RGB_PADDING);
+    frame.width = image->width;
+    frame.height = image->height;
+    frame.filename = filename;
+    convertImageToRGB(image, frame.rgb.data());
+
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        count++;
+    }
+    changed.notify_all();
+}
+
+void
+FrameWriter::flush() {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [this] { return count == 0; });
+}
+
+double
+FrameWriter::getWriteTime() {
+    std::unique_lock<std::mutex> guard(lock);
+    return writeTime;
+}
+
+void
+FrameWriter::run() {
+
+    std::unique_lock<std::mutex> guard(lock);
+
+    while (true) {
+        changed.wait(guard, [this] { return count > 0 || done; });
+        if (count == 0)
+            return;
+
+        Frame& frame = frames[head];
+        guard.unlock();
+
+        double startTime = CycleTimer::currentSeconds();
+        if (png)
+            writePNGFile(frame.filename.c_str(), frame.width, frame.height, frame.rgb.data());
+        else
+            writePPMFile(frame.filename.c_str(), frame.width, frame.height, frame.rgb.data());
+        printf("Wrote image file %s\n", frame.filename.c_str());
+        double endTime = CycleTimer::currentSeconds();
+
+        guard.lock();
+        writeTime += endTime - startTime;
+        head = (head + 1) % 2;
+        count--;
+        changed.notify_all();
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef __FRAME_WRITER_H__
+#define __FRAME_WRITER_H__
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Image;
+
+
+// Writes frames (PPM, or PNG when built with libpng) on a background
+// thread.  write() converts the image to 8-bit RGB right away, so the
+// renderer may overwrite it as soon as write() returns, and queues the
+// file; with two frames already queued it waits for the oldest one, so
+// at most two converted frames are in memory.
+class FrameWriter {
+
+private:
+
+    struct Frame {
+        std::vector<unsigned char> rgb;
+        int width, height;
+        std::string filename;
+    };
+
+    bool png;
+    Frame frames[2];
+    int head;            // oldest queued frame
+    int count;           // queued frames
+    bool done;
+    double writeTime;    // seconds spent writing files
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::thread thread;
+
+    void run();
+
+public:
+
+    FrameWriter(bool png);
+    ~FrameWriter();
+
+    void write(const Image* image, const std::string& filename);
+
+    // wait until every queued frame is written
+    void flush();
+
+    // seconds the writer thread has spent writing files so far
+    double getWriteTime();
+};
+
+
+#endif
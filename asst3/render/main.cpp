@@ -1,32 +1,82 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <getopt.h>
+#include <string.h>
 #include <string>
+#include <vector>
 
 #include "refRenderer.h"
+#include "cpuParallelRenderer.h"
 #include "cudaRenderer.h"
+#include "sceneLoader.h"
 #include "platformgl.h"
 
 #define DEFAULT_IMAGE_SIZE 1024
 
 
 void startRendererWithDisplay(CircleRenderer* renderer);
-void startBenchmark(CircleRenderer* renderer, int startFrame, int totalFrames, const std::string& frameFilename);
+void startBenchmark(CircleRenderer* renderer, int startFrame, int totalFrames, const std::string& frameFilename,
+                    bool writePNG);
+bool startBenchmarkSuite(const std::vector<SceneName>& scenes, const std::vector<int>& sizes,
+                         int startFrame, int totalFrames, const std::string& jsonFilename);
+void startRenderFarm(const std::string& jobFilename, bool writePNG);
+bool startNoiseBenchmark(SceneName sceneName);
 void CheckBenchmark(CircleRenderer* ref_renderer, CircleRenderer* cuda_renderer,
                         int benchmarkFrameStart, int totalFrames, const std::string& frameFilename);
 
 
+enum RendererType { CUDA_RENDERER, CPU_REF_RENDERER, CPU_PARALLEL_RENDERER, CPU_PARALLEL_HALF_RENDERER };
+
+CircleRenderer* newRenderer(RendererType type) {
+    switch (type) {
+    case CPU_REF_RENDERER:
+        return new RefRenderer();
+    case CPU_PARALLEL_RENDERER:
+        return new CpuParallelRenderer();
+    case CPU_PARALLEL_HALF_RENDERER:
+        return new CpuParallelRenderer(TILE_PIXELS_HALF);
+    case CUDA_RENDERER:
+    default:
+        return new CudaRenderer();
+    }
+}
+
+
+// loads the scene file when one is given, else the built-in scene
+static void
+loadRendererScene(CircleRenderer* renderer, const std::string& sceneFilename, SceneName sceneName) {
+    if (sceneFilename.length() > 0)
+        renderer->loadSceneFile(sceneFilename.c_str());
+    else
+        renderer->loadScene(sceneName);
+}
+
+
 void usage(const char* progname) {
     printf("Usage: %s [options] scenename\n", progname);
+    printf("       %s [options] -j JOBFILE\n", progname);
     printf("Valid scenenames are: rgb, rgby, rand10k, rand100k, biglittle, littlebig, pattern,\n"
            "                      bouncingballs, fireworks, hypnosis, snow, snowsingle\n");
     printf("Program Options:\n");
-    printf("  -r  --renderer <cpuref/cuda>  Select renderer: ref or cuda (default=cuda)\n");
+    printf("  -r  --renderer <cpuref/cpupar/cpuhalf/cuda>  Select renderer: ref, multicore cpu, multicore cpu\n"
+           "                                storing the frame in half precision, or cuda (default=cuda)\n");
     printf("  -s  --size  <INT>             Rendered image size: <INT>x<INT> pixels (default=%d)\n", DEFAULT_IMAGE_SIZE);    
     printf("  -b  --bench <START:END>       Run for frames [START,END) (default=[0,1))\n");
-    printf("  -c  --check                   Check correctness of CUDA output against CPU reference\n");
+    printf("  -c  --check                   Check correctness of the selected renderer against CPU reference\n");
     printf("  -i  --interactive             Render output to interactive display\n");
     printf("  -f  --file  <FILENAME>        Output file name (FILENAME_xxxx.ppm) (default=output)\n");
+    printf("  -p  --png                     Write frames as PNG (FILENAME_xxxx.png)\n");
+    printf("  -l  --load  <FILENAME>        Render the circles of a scene file instead of scenename\n");
+    printf("  -d  --dump  <FILENAME>        Write the circles after the last frame to a scene file\n");
+    printf("  -S  --suite <FILENAME>        Benchmark suite: run the cpu renderers on scenename (default:\n"
+           "                                every scene) at each size for frames -b (default=[0,10)),\n"
+           "                                check them and write JSON results\n");
+    printf("  -z  --sizes <INT,INT,...>     Image sizes of the suite (default=256,512,1024)\n");
+    printf("  -n  --noise                   Benchmark cell noise evaluations, scalar against batched, on the\n"
+           "                                positions of scenename (default: snow)\n");
+    printf("  -j  --jobs  <FILENAME>        Batch mode: render the jobs listed in the file, one\n"
+           "                                \"scenename size start:end [filename]\" per line, with\n"
+           "                                the multicore cpu renderer\n");
     printf("  -?  --help                    This message\n");
 }
 
@@ -40,10 +90,18 @@ int main(int argc, char** argv)
 
     std::string sceneNameStr;
     std::string frameFilename("output");
+    std::string jobFilename;
+    std::string sceneFilename;
+    std::string dumpFilename;
+    std::string suiteFilename;
+    std::vector<int> suiteSizes;
+    bool benchmarkRangeSet = false;
     SceneName sceneName;
-    bool useRefRenderer = false;
+    RendererType rendererType = CUDA_RENDERER;
     bool checkCorrectness = false;
     bool interactiveMode = false;
+    bool writePNG = false;
+    bool noiseBenchmark = false;
     
     // parse commandline options ////////////////////////////////////////////
     int opt;
@@ -53,12 +111,19 @@ int main(int argc, char** argv)
         {"bench",       1, 0,  'b'},
 	{"interactive", 0, 0,  'i'},
         {"file",        1, 0,  'f'},
+        {"png",         0, 0,  'p'},
+        {"jobs",        1, 0,  'j'},
+        {"load",        1, 0,  'l'},
+        {"dump",        1, 0,  'd'},
+        {"suite",       1, 0,  'S'},
+        {"sizes",       1, 0,  'z'},
+        {"noise",       0, 0,  'n'},
         {"renderer",    1, 0,  'r'},
         {"size",        1, 0,  's'},
         {0 ,0, 0, 0}
     };
 
-    while ((opt = getopt_long(argc, argv, "b:f:r:s:ci?", long_options, NULL)) != EOF) {
+    while ((opt = getopt_long(argc, argv, "b:d:f:j:l:r:s:S:z:cinp?", long_options, NULL)) != EOF) {
 
         switch (opt) {
         case 'b':
@@ -67,6 +132,7 @@ int main(int argc, char** argv)
                 usage(argv[0]);
                 exit(1);
             }
+            benchmarkRangeSet = true;
             break;
 	case 'i':
    	    interactiveMode = true;
@@ -74,14 +140,45 @@ int main(int argc, char** argv)
         case 'c':
             checkCorrectness = true;
             break;
+        case 'n':
+            noiseBenchmark = true;
+            break;
         case 'f':
             frameFilename = optarg;
             break;
+        case 'S':
+            suiteFilename = optarg;
+            break;
+        case 'z':
+            for (char* size=strtok(optarg, ","); size; size=strtok(NULL, ","))
+                suiteSizes.push_back(atoi(size));
+            break;
+        case 'd':
+            dumpFilename = optarg;
+            break;
+        case 'l':
+            sceneFilename = optarg;
+            break;
+        case 'j':
+            jobFilename = optarg;
+            break;
+        case 'p':
+#ifdef USE_PNG
+            writePNG = true;
+#else
+            fprintf(stderr, "ERROR: built without libpng, PNG output is not available\n");
+            return 1;
+#endif
+            break;
         case 'r':
             if (std::string(optarg).compare("cuda") == 0) {
-                useRefRenderer = false;
+                rendererType = CUDA_RENDERER;
             } else if (std::string(optarg).compare("cpuref") == 0) {
-	      useRefRenderer = true;
+	      rendererType = CPU_REF_RENDERER;
+	    } else if (std::string(optarg).compare("cpupar") == 0) {
+	      rendererType = CPU_PARALLEL_RENDERER;
+	    } else if (std::string(optarg).compare("cpuhalf") == 0) {
+	      rendererType = CPU_PARALLEL_HALF_RENDERER;
 	    } else {
 	      fprintf(stderr, "ERROR: Unknown renderer type: %s\n", optarg);
 	      usage(argv[0]);
@@ -99,43 +196,79 @@ int main(int argc, char** argv)
     }
     // end parsing of commandline options //////////////////////////////////////
 
-
-    if (optind + 1 > argc) {
-        fprintf(stderr, "Error: missing scene name\n");
+    // -d dumps the one scene of a benchmark or check run: the display runs
+    // until the window is closed, and the other modes render many scenes
+    if (dumpFilename.length() > 0 &&
+        (interactiveMode || jobFilename.length() > 0 || suiteFilename.length() > 0 || noiseBenchmark)) {
+        fprintf(stderr, "Error: -d cannot be combined with -i, -j, -S or -n\n");
         usage(argv[0]);
         return 1;
     }
 
-    sceneNameStr = argv[optind];
+    if (jobFilename.length() > 0) {
+        startRenderFarm(jobFilename, writePNG);
+        return 0;
+    }
 
-    if (sceneNameStr.compare("snow") == 0) {
+    if (noiseBenchmark) {
         sceneName = SNOWFLAKES;
-    } else if (sceneNameStr.compare("snowsingle") == 0) {
-        sceneName = SNOWFLAKES_SINGLE_FRAME;
-    } else if (sceneNameStr.compare("rgb") == 0) {
-        sceneName = CIRCLE_RGB;
-    } else if (sceneNameStr.compare("rgby") == 0) {
-        sceneName = CIRCLE_RGBY;
-    } else if (sceneNameStr.compare("rand10k") == 0) {
-        sceneName = CIRCLE_TEST_10K;
-    } else if (sceneNameStr.compare("rand100k") == 0) {
-        sceneName = CIRCLE_TEST_100K;
-    } else if (sceneNameStr.compare("pattern") == 0) {
-        sceneName = PATTERN;
-    } else if (sceneNameStr.compare("biglittle") == 0) {
-        sceneName = BIG_LITTLE;
-    } else if (sceneNameStr.compare("littlebig") == 0) {
-        sceneName = LITTLE_BIG;
-    } else if (sceneNameStr.compare("bouncingballs") == 0) {
-        sceneName = BOUNCING_BALLS;  
-    } else if (sceneNameStr.compare("hypnosis") == 0) { 
-        sceneName = HYPNOSIS;           
-    } else if (sceneNameStr.compare("fireworks") == 0) { 
-        sceneName = FIREWORKS;    
-    }else {
-        fprintf(stderr, "Unknown scene name (%s)\n", sceneNameStr.c_str());
-        usage(argv[0]);
-        return 1;
+        if (optind < argc && !parseSceneName(argv[optind], sceneName)) {
+            fprintf(stderr, "Unknown scene name (%s)\n", argv[optind]);
+            usage(argv[0]);
+            return 1;
+        }
+        return startNoiseBenchmark(sceneName) ? 0 : 1;
+    }
+
+    if (suiteFilename.length() > 0) {
+        std::vector<SceneName> scenes;
+        if (optind < argc) {
+            if (!parseSceneName(argv[optind], sceneName)) {
+                fprintf(stderr, "Unknown scene name (%s)\n", argv[optind]);
+                usage(argv[0]);
+                return 1;
+            }
+            scenes.push_back(sceneName);
+        } else {
+            getAllSceneNames(scenes);
+        }
+        if (suiteSizes.empty())
+            suiteSizes = {256, 512, 1024};
+        // a single frame says nothing about the spread of frame times
+        if (!benchmarkRangeSet)
+            benchmarkFrameEnd = 10;
+        if (benchmarkFrameStart < 0 || benchmarkFrameEnd <= benchmarkFrameStart) {
+            fprintf(stderr, "Error: the suite needs a non-empty frame range, got [%d,%d)\n",
+                    benchmarkFrameStart, benchmarkFrameEnd);
+            usage(argv[0]);
+            return 1;
+        }
+        for (size_t i=0; i<suiteSizes.size(); i++) {
+            if (suiteSizes[i] <= 0) {
+                fprintf(stderr, "Error: invalid image size %d for the suite\n", suiteSizes[i]);
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        bool passed = startBenchmarkSuite(scenes, suiteSizes, benchmarkFrameStart,
+                                          benchmarkFrameEnd - benchmarkFrameStart, suiteFilename);
+        return passed ? 0 : 1;
+    }
+
+    if (sceneFilename.length() == 0) {
+        if (optind + 1 > argc) {
+            fprintf(stderr, "Error: missing scene name\n");
+            usage(argv[0]);
+            return 1;
+        }
+
+        sceneNameStr = argv[optind];
+
+        if (!parseSceneName(sceneNameStr, sceneName)) {
+            fprintf(stderr, "Unknown scene name (%s)\n", sceneNameStr.c_str());
+            usage(argv[0]);
+            return 1;
+        }
     }
 
     printf("Rendering to %dx%d image\n", imageSize, imageSize);
@@ -149,32 +282,34 @@ int main(int argc, char** argv)
         CircleRenderer* cuda_renderer;
 
         ref_renderer = new RefRenderer();
-        cuda_renderer = new CudaRenderer();
+        cuda_renderer = newRenderer(rendererType);
 
         ref_renderer->allocOutputImage(imageSize, imageSize);
-        ref_renderer->loadScene(sceneName);
+        loadRendererScene(ref_renderer, sceneFilename, sceneName);
         ref_renderer->setup();
         cuda_renderer->allocOutputImage(imageSize, imageSize);
-        cuda_renderer->loadScene(sceneName);
+        loadRendererScene(cuda_renderer, sceneFilename, sceneName);
         cuda_renderer->setup();
 
         // Check the correctness
         CheckBenchmark(ref_renderer, cuda_renderer, 0, 1, frameFilename);
+        if (dumpFilename.length() > 0)
+            cuda_renderer->dumpScene(dumpFilename.c_str());
     }
     else {
 
-        if (useRefRenderer)
-            renderer = new RefRenderer();
-        else
-            renderer = new CudaRenderer();
+        renderer = newRenderer(rendererType);
 
         renderer->allocOutputImage(imageSize, imageSize);
-        renderer->loadScene(sceneName);
+        loadRendererScene(renderer, sceneFilename, sceneName);
         renderer->setup();
 
-        if (!interactiveMode)
-            startBenchmark(renderer, benchmarkFrameStart, benchmarkFrameEnd - benchmarkFrameStart, frameFilename);
-        else {
+        if (!interactiveMode) {
+            startBenchmark(renderer, benchmarkFrameStart, benchmarkFrameEnd - benchmarkFrameStart, frameFilename,
+                           writePNG);
+            if (dumpFilename.length() > 0)
+                renderer->dumpScene(dumpFilename.c_str());
+        } else {
             glutInit(&argc, argv);
             startRendererWithDisplay(renderer);
         }
@@ -1,3 +1,7 @@
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 #include "noise.h"
 
 
@@ -122,6 +126,54 @@ vec2CellNoise(float location[3], float result[2], int index)
     //result[2] = z_result;
 }
 
+void
+vec2CellNoiseBatch(int count, const float* x, const float* y, const float* z,
+                   float scaleX, float scaleY, float scaleZ, int firstIndex,
+                   float* resultX, float* resultY)
+{
+    int i = 0;
+
+#ifdef __AVX2__
+    // truncating conversions and wrapping 32-bit multiplies, like the
+    // scalar casts and index product
+    const __m256 vScaleX = _mm256_set1_ps(scaleX);
+    const __m256 vScaleY = _mm256_set1_ps(scaleY);
+    const __m256 vScaleZ = _mm256_set1_ps(scaleZ);
+    const __m256i byteMask = _mm256_set1_epi32(0xFF);
+    const __m256i laneOffsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    for (; i+8<=count; i+=8) {
+        __m256i ix = _mm256_cvttps_epi32(_mm256_mul_ps(vScaleX, _mm256_loadu_ps(x + i)));
+        __m256i iy = _mm256_cvttps_epi32(_mm256_mul_ps(vScaleY, _mm256_loadu_ps(y + i)));
+        __m256i iz = _mm256_cvttps_epi32(_mm256_mul_ps(vScaleZ, _mm256_loadu_ps(z + i)));
+        __m256i index = _mm256_add_epi32(_mm256_set1_epi32(firstIndex + i), laneOffsets);
+
+        __m256i hash = _mm256_and_si256(_mm256_mullo_epi32(ix, index), byteMask);
+        hash = _mm256_i32gather_epi32(NoiseXPermutationTable, hash, 4);
+        hash = _mm256_i32gather_epi32(NoiseXPermutationTable,
+                                      _mm256_and_si256(_mm256_add_epi32(hash, iy), byteMask), 4);
+        hash = _mm256_i32gather_epi32(NoiseXPermutationTable,
+                                      _mm256_and_si256(_mm256_add_epi32(hash, iz), byteMask), 4);
+        _mm256_storeu_ps(resultX + i, _mm256_i32gather_ps(Noise1DValueTable, hash, 4));
+
+        hash = _mm256_i32gather_epi32(NoiseYPermutationTable, _mm256_and_si256(ix, byteMask), 4);
+        hash = _mm256_i32gather_epi32(NoiseYPermutationTable,
+                                      _mm256_and_si256(_mm256_add_epi32(hash, iy), byteMask), 4);
+        hash = _mm256_i32gather_epi32(NoiseYPermutationTable,
+                                      _mm256_and_si256(_mm256_add_epi32(hash, iz), byteMask), 4);
+        _mm256_storeu_ps(resultY + i, _mm256_i32gather_ps(Noise1DValueTable, hash, 4));
+    }
+#endif
+
+    for (; i<count; i++) {
+        float location[3] = {scaleX * x[i], scaleY * y[i], scaleZ * z[i]};
+        float result[2];
+        vec2CellNoise(location, result, firstIndex + i);
+        resultX[i] = result[0];
+        resultY[i] = result[1];
+    }
+}
+
 void
 getNoiseTables(int** permX, int** permY, float** value1D) {
     *permX = NoiseXPermutationTable;
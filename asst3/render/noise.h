@@ -4,6 +4,14 @@
 
 void vec2CellNoise(float location[3], float result[2], int index);
 
+// vec2CellNoise for count points given as planar arrays: result i is
+// vec2CellNoise({scaleX * x[i], scaleY * y[i], scaleZ * z[i]}, ...,
+// firstIndex + i), bit for bit.  With AVX2 the hash chains of 8 points
+// are walked at once with gathers from the tables.
+void vec2CellNoiseBatch(int count, const float* x, const float* y, const float* z,
+                        float scaleX, float scaleY, float scaleZ, int firstIndex,
+                        float* resultX, float* resultY);
+
 void getNoiseTables(int** permX, int** permY, float** value1D);
 
 #endif
@@ -5,4 +5,17 @@ struct Image;
 
 void writePPMImage(const Image* image, const char *filename);
 
+// Converts the float4 image to the 8-bit RGB rows written to PPM and
+// PNG files, top (last) image row first.  rgb must hold
+// 3 * width * height + RGB_PADDING bytes: the vector code may write
+// past the last pixel.
+#define RGB_PADDING 16
+void convertImageToRGB(const Image* image, unsigned char* rgb);
+
+// Write converted pixels, each file with a single write
+void writePPMFile(const char* filename, int width, int height, const unsigned char* rgb);
+
+// Only when built with libpng (USE_PNG)
+void writePNGFile(const char* filename, int width, int height, const unsigned char* rgb);
+
 #endif
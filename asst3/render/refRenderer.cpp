@@ -4,8 +4,9 @@
 #include <vector>
 
 #include "refRenderer.h"
+#include "animation.h"
 #include "image.h"
-#include "noise.h"
+#include "sceneFile.h"
 #include "sceneLoader.h"
 #include "util.h"
 
@@ -87,167 +88,18 @@ RefRenderer::loadScene(SceneName scene) {
     loadCircleScene(sceneName, numCircles, position, velocity, color, radius);
 }
 
+void
+RefRenderer::loadSceneFile(const char* filename) {
+    loadCircleSceneFile(filename, sceneName, numCircles, position, velocity, color, radius);
+}
+
 // advanceAnimation --
 //
 // Advance the simulation one time step.  Updates all circle positions
 // and velocities
 void
 RefRenderer::advanceAnimation() {
-
-    // only the snowflake scene has animation
-
-    if (sceneName == SNOWFLAKES) {
-
-        const float dt = 1.f / 60.f;
-        const float kGravity = -1.8f; // sorry Newton
-        const float kDragCoeff = 2.f;
-
-        for (int i=0; i<numCircles; i++) {
-
-            int index3 = 3 * i;
-
-            // hack to make farther circles move more slowly, giving the
-            // illusion of parallax
-            float forceScaling = CLAMP(1.f - position[index3+2], .1f, 1.f);
-
-            // add some noise to the motion to make the snow flutter
-            float noiseInput[3];
-            float noiseForce[2];
-            noiseInput[0] = 10.f * position[index3];
-            noiseInput[1] = 10.f * position[index3+1];
-            noiseInput[2] = 255.f * position[index3+2];
-            vec2CellNoise(noiseInput, noiseForce, i);
-            noiseForce[0] *= 7.5f;
-            noiseForce[1] *= 5.f;
-
-            // drag
-            float dragForce[3];
-            dragForce[0] = -1.f * kDragCoeff * velocity[index3];
-            dragForce[1] = -1.f * kDragCoeff * velocity[index3+1];
-
-            // update positions
-            position[index3]   += velocity[index3] * dt;
-            position[index3+1] += velocity[index3+1] * dt;
-            position[index3+2] += velocity[index3+2] * dt;
-
-            // update forces
-            velocity[index3]   += forceScaling * (noiseForce[0] + dragForce[0]) * dt;
-            velocity[index3+1] += forceScaling * (kGravity + noiseForce[1] + dragForce[1]) * dt;
-
-            // if the snowflake has moved off the left, right or bottom of
-            // the screen, place it back at the top and give it a
-            // pseudorandom x position and velocity.
-            if ( (position[index3+1] + radius[i] < 0.f) ||
-                 (position[index3]+radius[i]) < -0.f ||
-                 (position[index3]-radius[i]) > 1.f)
-            {
-                noiseInput[0] = 255.f * position[index3];
-                noiseInput[1] = 255.f * position[index3+1];
-                noiseInput[2] = 255.f * position[index3+2];
-                vec2CellNoise(noiseInput, noiseForce, i);
-
-                position[index3] = .5f + .5f * noiseForce[0];
-                position[index3+1] = 1.35f + radius[i];
-
-                // restart from 0 vertical velocity.  Choose a
-                // pseudo-random horizontal velocity.
-                velocity[index3] = 2.f * noiseForce[1];
-                velocity[index3+1] = 0.f;
-            }
-        }
-    } else if (sceneName == BOUNCING_BALLS) {
-        const float dt = 1.f / 60.f;
-        const float kGravity = -2.8f; // sorry Newton
-        const float kDragCoeff = -0.8f; 
-        const float epsilon = 0.001f; 
-
-        for (int i=0; i<numCircles; i++) {
-            int index3 = 3 * i;
-
-            // reverse velocity if center position < 0
-            float oldVelocity = velocity[index3+1]; 
-            float oldPosition = position[index3+1]; 
-
-            if (oldVelocity == 0.f && oldPosition == 0.f) { // stop-condition 
-                continue; 
-            }
-
-            if (position[index3+1] < 0 && oldVelocity < 0.f) { // bounce ball 
-                velocity[index3+1] *= kDragCoeff; 
-            }
-
-            // update velocity: v = u + at (only along y-axis)
-            velocity[index3+1] += kGravity * dt; 
-
-            // update positions (only along y-axis)
-            position[index3+1] += velocity[index3+1] * dt;
-
-            if (fabsf(velocity[index3+1] - oldVelocity) < epsilon 
-                    && oldPosition < 0.0f 
-                    && fabsf(position[index3+1]-oldPosition) < epsilon) { // stop ball 
-                velocity[index3+1] = 0.f; 
-                position[index3+1] = 0.f; 
-            } 
-        }
-    } else if (sceneName == HYPNOSIS) { 
-        float cutOff = 0.5f;  
-        for (int i = 0; i < numCircles; i++) { // update radius 
-            // place circle back in center after reaching threshold radisus 
-            if (radius[i] > cutOff) { 
-                radius[i] = 0.02f; 
-            } else { 
-                radius[i] += 0.01f; 
-            }
-        }
-    } else if (sceneName == FIREWORKS) {
-        const float dt = 1.f / 60.f;
-        const float pi = 3.14159;
-        const float maxDist = 0.25f; 
-
-        for (int i = 0; i < NUM_FIREWORKS; i++) { 
-            int index3i = 3 * i;
-            // fire-work center
-            float cx = position[index3i]; 
-            float cy = position[index3i+1]; 
-            for (int j = 0; j < NUM_SPARKS; j++) { 
-                int sIdx = NUM_FIREWORKS + i * NUM_SPARKS + j;
-                int index3j = 3 * sIdx;
-                
-                // update position
-                position[index3j] += velocity[index3j] * dt;  
-                position[index3j+1] += velocity[index3j+1] * dt; 
-
-                // fire-work sparks
-                float sx = position[index3j]; 
-                float sy = position[index3j+1];
-
-                // compute vector from firework-spark
-                float cxsx = sx - cx; 
-                float cysy = sy - cy;
-    
-                // compute distance from fire-work 
-                float dist = sqrt(cxsx * cxsx + cysy * cysy);
-                if (dist > maxDist) { // restore to starting position 
-                    // random starting position on fire-work's rim
-                    float angle = (j * 2 * pi)/NUM_SPARKS;
-                    float sinA = sin(angle); 
-                    float cosA = cos(angle); 
-                    float x = cosA * radius[i]; 
-                    float y = sinA * radius[i]; 
-
-                    position[index3j] = position[index3i] + x;  
-                    position[index3j+1] = position[index3i+1] + y;  
-                    position[index3j+2] = 0.0f; 
-
-                    // travel scaled unit length 
-                    velocity[index3j] = cosA/5.0;  
-                    velocity[index3j+1] = sinA/5.0; 
-                    velocity[index3j+2] = 0.0f;  
-                } 
-            }
-        } 
-
-    } 
+    advanceCircleAnimation(sceneName, numCircles, position, velocity, radius);
 }
 
 static inline void
@@ -410,6 +262,10 @@ RefRenderer::render() {
     }
 }
 
+void RefRenderer::dumpScene(const char* filename) {
+    writeCircleSceneFile(filename, sceneName, numCircles, position, velocity, color, radius);
+}
+
 void RefRenderer::dumpParticles(const char* filename) {
 
     FILE* output = fopen(filename, "w");
@@ -29,6 +29,10 @@ public:
 
     void loadScene(SceneName name);              // 根据 SceneName 加载图像数据
 
+    void loadSceneFile(const char* filename);    // 从二进制场景文件加载图像数据
+
+    void dumpScene(const char* filename);        // 把当前的圆 (含颜色) 写成二进制场景文件
+
     void allocOutputImage(int width, int height);// 给 Image* image 手动分配内存
 
     void clearImage();                           // 清空 image 但是不释放内存
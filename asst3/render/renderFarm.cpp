@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "animation.h"
+#include "cpuParallelRenderer.h"
+#include "cycleTimer.h"
+#include "frameWriter.h"
+#include "sceneLoader.h"
+
+// Frames the simulation may run ahead of the rasterizer
+#define PIPELINE_DEPTH 3
+
+
+// One line of the job file: render frames [startFrame, endFrame) of a
+// scene at imageSize x imageSize.
+struct RenderJob {
+    std::string sceneNameStr;
+    SceneName sceneName;
+    int imageSize;
+    int startFrame, endFrame;
+    std::string frameFilename;   // empty: frames are not written
+};
+
+struct JobStats {
+    int simulatedFrames;
+    int renderedFrames;
+    double simTime;              // busy time of each stage, seconds
+    double renderTime;
+    double writeTime;
+    double totalTime;
+    std::vector<double> latencies;
+};
+
+// Circle state of one simulated frame, on its way to the rasterizer
+struct FrameSlot {
+    int frame;
+    double startTime;            // when its simulation step began
+    std::vector<float> x, y, z, radius;
+};
+
+// Bounded queue of simulated frames between the simulation thread and
+// the rasterizer, same scheme as FrameWriter.
+struct FrameQueue {
+    FrameSlot slots[PIPELINE_DEPTH];
+    int head;
+    int count;
+    bool done;
+
+    std::mutex lock;
+    std::condition_variable changed;
+
+    FrameQueue() : head(0), count(0), done(false) {}
+};
+
+
+// loadJobFile --
+//
+// Reads the job list: one job per line,
+//
+//     scenename size start:end [filename]
+//
+// with frames written to filename_xxxx.ppm (default scenename_size,
+// "-" to not write them).  Blank lines and lines starting with # are
+// skipped.
+static void
+loadJobFile(const std::string& jobFilename, std::vector<RenderJob>& jobs) {
+
+    FILE* fp = fopen(jobFilename.c_str(), "r");
+    if (!fp) {
+        fprintf(stderr, "Error: could not open job file %s\n", jobFilename.c_str());
+        exit(1);
+    }
+
+    char line[1024];
+    int lineNumber = 0;
+
+    while (fgets(line, sizeof(line), fp)) {
+
+        lineNumber++;
+
+        char sceneNameStr[64];
+        char frameFilename[1024];
+        char first;
+        if (sscanf(line, " %c", &first) != 1 || first == '#')
+            continue;
+
+        RenderJob job;
+        int fields = sscanf(line, "%63s %d %d:%d %1023s", sceneNameStr, &job.imageSize,
+                            &job.startFrame, &job.endFrame, frameFilename);
+        if (fields < 4) {
+            fprintf(stderr, "Error: %s:%d: expected \"scenename size start:end [filename]\"\n",
+                    jobFilename.c_str(), lineNumber);
+            exit(1);
+        }
+
+        job.sceneNameStr = sceneNameStr;
+        if (!parseSceneName(job.sceneNameStr, job.sceneName)) {
+            fprintf(stderr, "Error: %s:%d: unknown scene name (%s)\n",
+                    jobFilename.c_str(), lineNumber, sceneNameStr);
+            exit(1);
+        }
+        if (job.imageSize <= 0 || job.startFrame < 0 || job.endFrame <= job.startFrame) {
+            fprintf(stderr, "Error: %s:%d: invalid size or frame range\n",
+                    jobFilename.c_str(), lineNumber);
+            exit(1);
+        }
+
+        if (fields < 5)
+            job.frameFilename = job.sceneNameStr + "_" + std::to_string(job.imageSize);
+        else if (std::string(frameFilename).compare("-") == 0)
+            job.frameFilename = "";
+        else
+            job.frameFilename = frameFilename;
+
+        jobs.push_back(job);
+    }
+
+    fclose(fp);
+}
+
+// simulateJob --
+//
+// Simulation stage: advances the scene frame by frame, like
+// startBenchmark does, and queues the circle state of every frame to
+// render.
+static void
+simulateJob(const RenderJob& job, int numThreads, FrameQueue& queue, JobStats& stats) {
+
+    omp_set_num_threads(numThreads);
+
+    int numCircles;
+    float* position;
+    float* velocity;
+    float* color;
+    float* radius;
+    loadCircleScene(job.sceneName, numCircles, position, velocity, color, radius);
+
+    CircleAnimation animation;
+    animation.load(job.sceneName, numCircles, position, velocity, radius);
+
+    delete [] position;
+    delete [] velocity;
+    delete [] color;
+    delete [] radius;
+
+    for (int frame=0; frame<job.endFrame; frame++) {
+
+        double startTime = CycleTimer::currentSeconds();
+        animation.advance();
+        stats.simTime += CycleTimer::currentSeconds() - startTime;
+        stats.simulatedFrames++;
+
+        if (frame < job.startFrame)
+            continue;
+
+        int slot;
+        {
+            std::unique_lock<std::mutex> guard(queue.lock);
+            queue.changed.wait(guard, [&queue] { return queue.count < PIPELINE_DEPTH; });
+            slot = (queue.head + queue.count) % PIPELINE_DEPTH;
+        }
+
+        // the slot is not queued, the rasterizer does not touch it
+        double startCopyTime = CycleTimer::currentSeconds();
+        FrameSlot& frameSlot = queue.slots[slot];
+        frameSlot.frame = frame;
+        frameSlot.startTime = startTime;
+        frameSlot.x.assign(animation.getX(), animation.getX() + numCircles);
+        frameSlot.y.assign(animation.getY(), animation.getY() + numCircles);
+        frameSlot.z.assign(animation.getZ(), animation.getZ() + numCircles);
+        frameSlot.radius.assign(animation.getRadius(), animation.getRadius() + numCircles);
+        stats.simTime += CycleTimer::currentSeconds() - startCopyTime;
+
+        {
+            std::unique_lock<std::mutex> guard(queue.lock);
+            queue.count++;
+        }
+        queue.changed.notify_all();
+    }
+
+    {
+        std::unique_lock<std::mutex> guard(queue.lock);
+        queue.done = true;
+    }
+    queue.changed.notify_all();
+}
+
+// runJob --
+//
+// Runs one job as a three stage pipeline: a simulation thread stays up
+// to PIPELINE_DEPTH frames ahead of the calling thread, which
+// rasterizes, and a FrameWriter writes the finished frames.  The
+// simulation gets simThreads OpenMP threads, the rasterizer
+// renderThreads.
+static void
+runJob(const RenderJob& job, int simThreads, int renderThreads, bool writePNG, JobStats& stats) {
+
+    double startTime = CycleTimer::currentSeconds();
+
+    omp_set_num_threads(renderThreads);
+
+    CpuParallelRenderer renderer;
+    renderer.allocOutputImage(job.imageSize, job.imageSize);
+    renderer.loadScene(job.sceneName);
+    renderer.setup();
+
+    FrameWriter frameWriter(writePNG);
+    const char* extension = writePNG ? "png" : "ppm";
+
+    FrameQueue queue;
+    std::thread simulation(simulateJob, std::cref(job), simThreads, std::ref(queue), std::ref(stats));
+
+    while (true) {
+
+        int slot;
+        {
+            std::unique_lock<std::mutex> guard(queue.lock);
+            queue.changed.wait(guard, [&queue] { return queue.count > 0 || queue.done; });
+            if (queue.count == 0)
+                break;
+            slot = queue.head;
+        }
+
+        const FrameSlot& frameSlot = queue.slots[slot];
+        int frame = frameSlot.frame;
+        double frameStartTime = frameSlot.startTime;
+
+        double startRenderTime = CycleTimer::currentSeconds();
+        renderer.clearImage();
+        renderer.renderFrame(frameSlot.x.data(), frameSlot.y.data(), frameSlot.z.data(),
+                             frameSlot.radius.data());
+        double endRenderTime = CycleTimer::currentSeconds();
+
+        {
+            std::unique_lock<std::mutex> guard(queue.lock);
+            queue.head = (queue.head + 1) % PIPELINE_DEPTH;
+            queue.count--;
+        }
+        queue.changed.notify_all();
+
+        if (job.frameFilename.length() > 0) {
+            char filename[1024];
+            snprintf(filename, sizeof(filename), "%s_%04d.%s", job.frameFilename.c_str(), frame, extension);
+            frameWriter.write(renderer.getImage(), filename);
+        }
+
+        stats.renderTime += endRenderTime - startRenderTime;
+        stats.renderedFrames++;
+        stats.latencies.push_back(CycleTimer::currentSeconds() - frameStartTime);
+    }
+
+    simulation.join();
+    frameWriter.flush();
+
+    stats.writeTime = frameWriter.getWriteTime();
+    stats.totalTime = CycleTimer::currentSeconds() - startTime;
+}
+
+static double
+framesPerSecond(int frames, double seconds) {
+    return seconds > 0. ? frames / seconds : 0.;
+}
+
+// startRenderFarm --
+//
+// Batch mode: renders every job of the job file with the multicore CPU
+// renderer.  Independent jobs run concurrently on separate lanes, each
+// lane taking the next job when it finishes one, and the cores are
+// split evenly between the lanes.  Reports the throughput of every
+// pipeline stage (frames per second of busy time) and the latency from
+// the start of a frame's simulation until the frame is rendered and
+// handed to the writer.
+void
+startRenderFarm(const std::string& jobFilename, bool writePNG) {
+
+    std::vector<RenderJob> jobs;
+    loadJobFile(jobFilename, jobs);
+
+    if (jobs.empty()) {
+        fprintf(stderr, "Error: no jobs in %s\n", jobFilename.c_str());
+        exit(1);
+    }
+
+    // give every lane about four cores; a quarter of a lane's threads
+    // simulate, the others rasterize
+    int numCores = omp_get_num_procs();
+    int numLanes = std::min(static_cast<int>(jobs.size()), std::max(1, numCores / 4));
+    int laneThreads = std::max(1, numCores / numLanes);
+    int simThreads = std::max(1, laneThreads / 4);
+    int renderThreads = std::max(1, laneThreads - simThreads);
+
+    printf("\nRunning %d jobs on %d lanes, %d simulation + %d render threads each ...\n",
+           static_cast<int>(jobs.size()), numLanes, simThreads, renderThreads);
+
+    std::vector<JobStats> stats(jobs.size(), JobStats());
+    std::atomic<int> nextJob(0);
+
+    double startTime = CycleTimer::currentSeconds();
+
+    std::vector<std::thread> lanes;
+    for (int lane=0; lane<numLanes; lane++) {
+        lanes.push_back(std::thread([&] {
+            int job;
+            while ((job = nextJob++) < static_cast<int>(jobs.size()))
+                runJob(jobs[job], simThreads, renderThreads, writePNG, stats[job]);
+        }));
+    }
+    for (size_t lane=0; lane<lanes.size(); lane++)
+        lanes[lane].join();
+
+    double totalTime = CycleTimer::currentSeconds() - startTime;
+    int totalFrames = 0;
+
+    for (size_t job=0; job<jobs.size(); job++) {
+
+        JobStats& s = stats[job];
+        std::sort(s.latencies.begin(), s.latencies.end());
+        double sumLatency = 0.;
+        for (size_t i=0; i<s.latencies.size(); i++)
+            sumLatency += s.latencies[i];
+        totalFrames += s.renderedFrames;
+
+        printf("\nJob %d: %s %dx%d, frames [%d,%d)\n", static_cast<int>(job), jobs[job].sceneNameStr.c_str(),
+               jobs[job].imageSize, jobs[job].imageSize, jobs[job].startFrame, jobs[job].endFrame);
+        printf("Simulate: %.2f fps\n", framesPerSecond(s.simulatedFrames, s.simTime));
+        printf("Render:   %.2f fps\n", framesPerSecond(s.renderedFrames, s.renderTime));
+        if (jobs[job].frameFilename.length() > 0)
+            printf("Write:    %.2f fps\n", framesPerSecond(s.renderedFrames, s.writeTime));
+        printf("Overall:  %.2f fps, %.4f sec\n", framesPerSecond(s.renderedFrames, s.totalTime), s.totalTime);
+        printf("Latency:  %.4f ms mean, %.4f ms max\n",
+               1000. * sumLatency / s.latencies.size(), 1000. * s.latencies.back());
+    }
+
+    printf("\n");
+    printf("Farm:     %d frames in %.4f sec, %.2f fps\n", totalFrames, totalTime,
+           framesPerSecond(totalFrames, totalTime));
+}
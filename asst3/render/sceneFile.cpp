@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "cycleTimer.h"
+#include "sceneFile.h"
+
+static_assert(sizeof(SceneFileHeader) == SCENE_FILE_ALIGNMENT, "scene file header must fill one aligned block");
+
+// circles written per fwrite
+#define WRITE_CHUNK (16 * 1024)
+
+
+static uint64_t
+arrayStride(uint64_t numCircles) {
+    uint64_t bytes = numCircles * sizeof(float);
+    return (bytes + SCENE_FILE_ALIGNMENT - 1) / SCENE_FILE_ALIGNMENT * SCENE_FILE_ALIGNMENT;
+}
+
+void
+writeCircleSceneFile(
+    const char* filename,
+    SceneName sceneName,
+    int numCircles,
+    const SceneFileArray arrays[SCENE_FILE_NUM_ARRAYS])
+{
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error: could not open %s for write\n", filename);
+        exit(1);
+    }
+    setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+    SceneFileHeader header;
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, SCENE_FILE_MAGIC);
+    header.version = SCENE_FILE_VERSION;
+    header.headerSize = sizeof(SceneFileHeader);
+    header.sceneName = sceneName;
+    header.numArrays = SCENE_FILE_NUM_ARRAYS;
+    header.numCircles = numCircles;
+    header.dataOffset = sizeof(SceneFileHeader);
+    header.arrayStride = arrayStride(numCircles);
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+    std::vector<float> chunk(WRITE_CHUNK);
+    const char padding[SCENE_FILE_ALIGNMENT] = {0};
+    size_t paddingBytes = header.arrayStride - sizeof(float) * numCircles;
+
+    for (int a=0; a<SCENE_FILE_NUM_ARRAYS && ok; a++) {
+
+        const float* data = arrays[a].data;
+        int stride = arrays[a].stride;
+
+        for (int start=0; start<numCircles && ok; start+=WRITE_CHUNK) {
+            int count = std::min(WRITE_CHUNK, numCircles - start);
+            for (int i=0; i<count; i++)
+                chunk[i] = data[static_cast<size_t>(start + i) * stride];
+            ok = fwrite(chunk.data(), sizeof(float), count, fp) == static_cast<size_t>(count);
+        }
+
+        if (ok && paddingBytes > 0)
+            ok = fwrite(padding, 1, paddingBytes, fp) == paddingBytes;
+    }
+
+    if (fclose(fp) != 0 || !ok) {
+        fprintf(stderr, "Error: could not write %s\n", filename);
+        exit(1);
+    }
+
+    printf("Wrote scene file %s with %d circles\n", filename, numCircles);
+}
+
+void
+writeCircleSceneFile(
+    const char* filename,
+    SceneName sceneName,
+    int numCircles,
+    const float* position,
+    const float* velocity,
+    const float* color,
+    const float* radius)
+{
+    SceneFileArray arrays[SCENE_FILE_NUM_ARRAYS] = {
+        {position, 3}, {position + 1, 3}, {position + 2, 3},
+        {velocity, 3}, {velocity + 1, 3}, {velocity + 2, 3},
+        {color, 3}, {color + 1, 3}, {color + 2, 3},
+        {radius, 1},
+    };
+    writeCircleSceneFile(filename, sceneName, numCircles, arrays);
+}
+
+void
+loadCircleSceneFile(
+    const char* filename,
+    SceneName& sceneName,
+    int& numCircles,
+    float*& position,
+    float*& velocity,
+    float*& color,
+    float*& radius)
+{
+    double startTime = CycleTimer::currentSeconds();
+
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Error: could not open scene file %s\n", filename);
+        exit(1);
+    }
+
+    size_t fileSize = st.st_size;
+    if (fileSize < sizeof(SceneFileHeader)) {
+        fprintf(stderr, "Error: %s is not a scene file\n", filename);
+        exit(1);
+    }
+
+    void* mapping = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Error: could not map scene file %s\n", filename);
+        exit(1);
+    }
+
+    // the arrays are read front to back, by all threads at once
+    madvise(mapping, fileSize, MADV_SEQUENTIAL);
+    madvise(mapping, fileSize, MADV_WILLNEED);
+
+    const SceneFileHeader* header = static_cast<const SceneFileHeader*>(mapping);
+
+    if (memcmp(header->magic, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC)) != 0) {
+        fprintf(stderr, "Error: %s is not a scene file\n", filename);
+        exit(1);
+    }
+    if (header->version != SCENE_FILE_VERSION || header->headerSize != sizeof(SceneFileHeader) ||
+        header->numArrays != SCENE_FILE_NUM_ARRAYS) {
+        fprintf(stderr, "Error: %s: unsupported scene file version %u\n", filename, header->version);
+        exit(1);
+    }
+    if (header->sceneName > LITTLE_BIG || header->numCircles > INT_MAX / 3 ||
+        header->dataOffset % SCENE_FILE_ALIGNMENT != 0 || header->arrayStride % SCENE_FILE_ALIGNMENT != 0 ||
+        header->arrayStride < header->numCircles * sizeof(float) ||
+        header->dataOffset > fileSize ||
+        header->arrayStride > (fileSize - header->dataOffset) / SCENE_FILE_NUM_ARRAYS) {
+        fprintf(stderr, "Error: %s: corrupt scene file header\n", filename);
+        exit(1);
+    }
+
+    sceneName = static_cast<SceneName>(header->sceneName);
+    numCircles = static_cast<int>(header->numCircles);
+
+    const float* arrays[SCENE_FILE_NUM_ARRAYS];
+    for (int a=0; a<SCENE_FILE_NUM_ARRAYS; a++)
+        arrays[a] = reinterpret_cast<const float*>(
+            static_cast<const char*>(mapping) + header->dataOffset + a * header->arrayStride);
+
+    position = new float[3 * numCircles];
+    velocity = new float[3 * numCircles];
+    color = new float[3 * numCircles];
+    radius = new float[numCircles];
+
+    // page faults on both the file and the new arrays are spread across
+    // the threads, so loading runs at I/O (or memory) bandwidth
+    #pragma omp parallel for schedule(static)
+    for (int i=0; i<numCircles; i++) {
+        int index3 = 3 * i;
+        position[index3] = arrays[0][i];
+        position[index3+1] = arrays[1][i];
+        position[index3+2] = arrays[2][i];
+        velocity[index3] = arrays[3][i];
+        velocity[index3+1] = arrays[4][i];
+        velocity[index3+2] = arrays[5][i];
+        color[index3] = arrays[6][i];
+        color[index3+1] = arrays[7][i];
+        color[index3+2] = arrays[8][i];
+        radius[i] = arrays[9][i];
+    }
+
+    munmap(mapping, fileSize);
+
+    double seconds = CycleTimer::currentSeconds() - startTime;
+    printf("Loaded scene with %d circles from %s (%.1f MB in %.1f ms)\n", numCircles, filename,
+           fileSize / (1024. * 1024.), 1000. * seconds);
+}
@@ -0,0 +1,73 @@
+#ifndef __SCENE_FILE_H__
+#define __SCENE_FILE_H__
+
+#include <stdint.h>
+
+#include "circleRenderer.h"
+
+// Binary scene files (.scn): a 64-byte header followed by the circle
+// data in planar form, one float array per component, every array
+// starting on a 64-byte boundary so the mapped file can be read with
+// aligned vector loads.  Values are little-endian.
+//
+//     x, y, z, velocity x, y, z, color r, g, b, radius
+//
+// The scene name in the header selects the animation and shading the
+// circles are rendered with.
+
+#define SCENE_FILE_MAGIC "CIRCSCN"
+#define SCENE_FILE_VERSION 1
+#define SCENE_FILE_ALIGNMENT 64
+#define SCENE_FILE_NUM_ARRAYS 10
+
+struct SceneFileHeader {
+    char magic[8];             // SCENE_FILE_MAGIC, NUL terminated
+    uint32_t version;          // SCENE_FILE_VERSION
+    uint32_t headerSize;       // sizeof(SceneFileHeader)
+    uint32_t sceneName;
+    uint32_t numArrays;        // SCENE_FILE_NUM_ARRAYS
+    uint64_t numCircles;
+    uint64_t dataOffset;       // first array, from the start of the file
+    uint64_t arrayStride;      // bytes from one array to the next
+    uint8_t reserved[16];
+};
+
+// Element i of an array written to a scene file is data[i * stride].
+struct SceneFileArray {
+    const float* data;
+    int stride;
+};
+
+// Writes the circles to a scene file, arrays in the order listed above.
+void
+writeCircleSceneFile(
+    const char* filename,
+    SceneName sceneName,
+    int numCircles,
+    const SceneFileArray arrays[SCENE_FILE_NUM_ARRAYS]);
+
+// Same, from the interleaved arrays (3 floats per circle for position,
+// velocity and color) the renderers and loadCircleScene use.
+void
+writeCircleSceneFile(
+    const char* filename,
+    SceneName sceneName,
+    int numCircles,
+    const float* position,
+    const float* velocity,
+    const float* color,
+    const float* radius);
+
+// Maps a scene file and fills newly allocated arrays in the layout of
+// loadCircleScene, interleaving the planar data in parallel.
+void
+loadCircleSceneFile(
+    const char* filename,
+    SceneName& sceneName,
+    int& numCircles,
+    float*& position,
+    float*& velocity,
+    float*& color,
+    float*& radius);
+
+#endif
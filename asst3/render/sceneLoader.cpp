@@ -16,6 +16,57 @@ randomFloat() {
     return static_cast<float>(rand()) / RAND_MAX;
 }
 
+// command line names of the scenes
+static const struct {
+    const char* name;
+    SceneName scene;
+} sceneNames[] = {
+    {"rgb",           CIRCLE_RGB},
+    {"rgby",          CIRCLE_RGBY},
+    {"rand10k",       CIRCLE_TEST_10K},
+    {"rand100k",      CIRCLE_TEST_100K},
+    {"biglittle",     BIG_LITTLE},
+    {"littlebig",     LITTLE_BIG},
+    {"pattern",       PATTERN},
+    {"bouncingballs", BOUNCING_BALLS},
+    {"fireworks",     FIREWORKS},
+    {"hypnosis",      HYPNOSIS},
+    {"snow",          SNOWFLAKES},
+    {"snowsingle",    SNOWFLAKES_SINGLE_FRAME},
+};
+
+#define NUM_SCENE_NAMES (sizeof(sceneNames) / sizeof(sceneNames[0]))
+
+bool
+parseSceneName(const std::string& name, SceneName& sceneName) {
+
+    for (size_t i=0; i<NUM_SCENE_NAMES; i++) {
+        if (name.compare(sceneNames[i].name) == 0) {
+            sceneName = sceneNames[i].scene;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char*
+sceneNameString(SceneName sceneName) {
+
+    for (size_t i=0; i<NUM_SCENE_NAMES; i++) {
+        if (sceneNames[i].scene == sceneName)
+            return sceneNames[i].name;
+    }
+    return "unknown";
+}
+
+void
+getAllSceneNames(std::vector<SceneName>& scenes) {
+
+    scenes.clear();
+    for (size_t i=0; i<NUM_SCENE_NAMES; i++)
+        scenes.push_back(sceneNames[i].scene);
+}
+
 static void
 makeCircleGrid(
     int startIndex,
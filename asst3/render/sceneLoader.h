@@ -1,8 +1,24 @@
 #ifndef __SCENE_LOADER_H__
 #define __SCENE_LOADER_H__
 
+#include <string>
+#include <vector>
+
 #include "circleRenderer.h"
 
+// Scene for a command line scene name ("rgb", "snow", ...), false if
+// there is no such scene.
+bool
+parseSceneName(const std::string& name, SceneName& sceneName);
+
+// Command line name of the scene.
+const char*
+sceneNameString(SceneName sceneName);
+
+// Every scene, in the order the usage message lists them.
+void
+getAllSceneNames(std::vector<SceneName>& scenes);
+
 void
 loadCircleScene(
     SceneName sceneName,
@@ -0,0 +1,289 @@
+#include <algorithm>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image.h"
+#include "tiledImage.h"
+
+#define TILE_PIXELS (IMAGE_TILE_SIZE * IMAGE_TILE_SIZE)
+
+
+#ifndef __F16C__
+
+// Portable conversions between float and IEEE half precision, rounding
+// to nearest even like the F16C instructions.
+
+static inline uint16_t
+floatToHalf(float value) {
+
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    bits &= 0x7fffffff;
+
+    if (bits >= (143u << 23))                       // overflow, inf or nan
+        return sign | (bits > (255u << 23) ? 0x7e00 : 0x7c00);
+
+    if (bits < (113u << 23)) {                      // half subnormal or zero
+        const uint32_t magicBits = 126u << 23;
+        float magic;
+        memcpy(&magic, &magicBits, sizeof(magic));
+        float shifted;
+        memcpy(&shifted, &bits, sizeof(shifted));
+        shifted += magic;
+        memcpy(&bits, &shifted, sizeof(bits));
+        return sign | static_cast<uint16_t>(bits - magicBits);
+    }
+
+    uint32_t mantissaOdd = (bits >> 13) & 1;
+    bits += (static_cast<uint32_t>(15 - 127) << 23) + 0xfff + mantissaOdd;
+    return sign | static_cast<uint16_t>(bits >> 13);
+}
+
+static inline float
+halfToFloat(uint16_t half) {
+
+    const uint32_t exponentMask = 0x7c00u << 13;
+    uint32_t bits = (half & 0x7fffu) << 13;
+    uint32_t exponent = bits & exponentMask;
+    bits += static_cast<uint32_t>(127 - 15) << 23;
+
+    float value;
+    if (exponent == exponentMask) {                 // inf or nan, nan made quiet
+        bits += static_cast<uint32_t>(128 - 16) << 23;
+        if (half & 0x3ffu)
+            bits |= 1u << 22;
+    } else if (exponent == 0) {                     // subnormal or zero
+        const uint32_t magicBits = 113u << 23;
+        float magic;
+        memcpy(&magic, &magicBits, sizeof(magic));
+        bits += 1u << 23;
+        memcpy(&value, &bits, sizeof(value));
+        value -= magic;
+        memcpy(&bits, &value, sizeof(bits));
+    }
+    bits |= static_cast<uint32_t>(half & 0x8000u) << 16;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+#endif
+
+// The 4 planar channels of one stored tile
+static inline float*
+floatChannel(void* storage, int tile, int channel) {
+    return static_cast<float*>(storage) + (4L * tile + channel) * TILE_PIXELS;
+}
+
+static inline uint16_t*
+halfChannel(void* storage, int tile, int channel) {
+    return static_cast<uint16_t*>(storage) + (4L * tile + channel) * TILE_PIXELS;
+}
+
+// Writes count pixels of planar rows r, g, b, a to dst as RGBA
+static inline void
+interleaveRow(const float* r, const float* g, const float* b, const float* a, float* dst, int count) {
+
+    int x = 0;
+
+#ifdef __AVX2__
+    // 8 x 4 transpose: 8 values of each channel become 8 RGBA pixels
+    for (; x+8<=count; x+=8) {
+        __m256 vr = _mm256_loadu_ps(r + x);
+        __m256 vg = _mm256_loadu_ps(g + x);
+        __m256 vb = _mm256_loadu_ps(b + x);
+        __m256 va = _mm256_loadu_ps(a + x);
+
+        __m256 rgLow = _mm256_unpacklo_ps(vr, vg);
+        __m256 rgHigh = _mm256_unpackhi_ps(vr, vg);
+        __m256 baLow = _mm256_unpacklo_ps(vb, va);
+        __m256 baHigh = _mm256_unpackhi_ps(vb, va);
+
+        __m256 p04 = _mm256_shuffle_ps(rgLow, baLow, 0x44);
+        __m256 p15 = _mm256_shuffle_ps(rgLow, baLow, 0xee);
+        __m256 p26 = _mm256_shuffle_ps(rgHigh, baHigh, 0x44);
+        __m256 p37 = _mm256_shuffle_ps(rgHigh, baHigh, 0xee);
+
+        float* out = dst + 4 * x;
+        _mm256_storeu_ps(out, _mm256_permute2f128_ps(p04, p15, 0x20));
+        _mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(p26, p37, 0x20));
+        _mm256_storeu_ps(out + 16, _mm256_permute2f128_ps(p04, p15, 0x31));
+        _mm256_storeu_ps(out + 24, _mm256_permute2f128_ps(p26, p37, 0x31));
+    }
+#endif
+
+    for (; x<count; x++) {
+        dst[4 * x] = r[x];
+        dst[4 * x + 1] = g[x];
+        dst[4 * x + 2] = b[x];
+        dst[4 * x + 3] = a[x];
+    }
+}
+
+// Converts count (a multiple of 8) half values to float
+static inline void
+halfsToFloats(const uint16_t* src, float* dst, int count) {
+#ifdef __F16C__
+    for (int i=0; i<count; i+=8)
+        _mm256_store_ps(dst + i, _mm256_cvtph_ps(_mm_load_si128(reinterpret_cast<const __m128i*>(src + i))));
+#else
+    for (int i=0; i<count; i++)
+        dst[i] = halfToFloat(src[i]);
+#endif
+}
+
+
+TiledImage::TiledImage(int w, int h, TilePixelFormat pixelFormat) {
+
+    width = w;
+    height = h;
+    numTilesX = (width + IMAGE_TILE_SIZE - 1) / IMAGE_TILE_SIZE;
+    numTilesY = (height + IMAGE_TILE_SIZE - 1) / IMAGE_TILE_SIZE;
+    format = pixelFormat;
+
+    size_t channelBytes = format == TILE_PIXELS_HALF ? sizeof(uint16_t) : sizeof(float);
+    size_t bytes = 4 * channelBytes * TILE_PIXELS * numTilesX * numTilesY;
+    if (posix_memalign(&storage, 64, bytes) != 0) {
+        fprintf(stderr, "Error: could not allocate %zu bytes for the image tiles\n", bytes);
+        exit(1);
+    }
+
+    tileCleared.assign(numTilesX * numTilesY, 1);
+    background.assign(4 * height, 0.f);
+}
+
+TiledImage::~TiledImage() {
+    free(storage);
+}
+
+void
+TiledImage::clear(const float* rowColors) {
+    background.assign(rowColors, rowColors + 4 * height);
+    std::fill(tileCleared.begin(), tileCleared.end(), 1);
+}
+
+void
+TiledImage::fillBackground(int tile, TilePixels& pixels) const {
+
+    int tileMinY = (tile / numTilesX) * IMAGE_TILE_SIZE;
+
+    for (int y=0; y<IMAGE_TILE_SIZE; y++) {
+        // rows past the bottom edge are never output
+        const float* color = &background[4 * std::min(tileMinY + y, height - 1)];
+        int rowStart = y * IMAGE_TILE_SIZE;
+        for (int x=0; x<IMAGE_TILE_SIZE; x++) {
+            pixels.r[rowStart + x] = color[0];
+            pixels.g[rowStart + x] = color[1];
+            pixels.b[rowStart + x] = color[2];
+            pixels.a[rowStart + x] = color[3];
+        }
+    }
+}
+
+void
+TiledImage::loadTile(int tile, TilePixels& pixels) const {
+
+    if (tileCleared[tile]) {
+        fillBackground(tile, pixels);
+        return;
+    }
+
+    float* channels[4] = {pixels.r, pixels.g, pixels.b, pixels.a};
+
+    for (int c=0; c<4; c++) {
+        if (format == TILE_PIXELS_HALF)
+            halfsToFloats(halfChannel(storage, tile, c), channels[c], TILE_PIXELS);
+        else
+            memcpy(channels[c], floatChannel(storage, tile, c), TILE_PIXELS * sizeof(float));
+    }
+}
+
+void
+TiledImage::storeTile(int tile, const TilePixels& pixels) {
+
+    const float* channels[4] = {pixels.r, pixels.g, pixels.b, pixels.a};
+
+    for (int c=0; c<4; c++) {
+        const float* src = channels[c];
+
+        if (format == TILE_PIXELS_HALF) {
+            uint16_t* dst = halfChannel(storage, tile, c);
+#ifdef __F16C__
+            for (int i=0; i<TILE_PIXELS; i+=8)
+                _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i),
+                                 _mm256_cvtps_ph(_mm256_load_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+#else
+            for (int i=0; i<TILE_PIXELS; i++)
+                dst[i] = floatToHalf(src[i]);
+#endif
+        } else {
+            float* dst = floatChannel(storage, tile, c);
+#ifdef __AVX2__
+            for (int i=0; i<TILE_PIXELS; i+=8)
+                _mm256_stream_ps(dst + i, _mm256_load_ps(src + i));
+#else
+            memcpy(dst, src, TILE_PIXELS * sizeof(float));
+#endif
+        }
+    }
+
+#ifdef __AVX2__
+    // order the streaming stores before anything another thread does
+    // with the tile
+    _mm_sfence();
+#endif
+
+    tileCleared[tile] = 0;
+}
+
+void
+TiledImage::toImage(Image* image) const {
+
+    int numTiles = numTilesX * numTilesY;
+
+    #pragma omp parallel for schedule(static)
+    for (int tile=0; tile<numTiles; tile++) {
+
+        int tileMinX = (tile % numTilesX) * IMAGE_TILE_SIZE;
+        int tileMinY = (tile / numTilesX) * IMAGE_TILE_SIZE;
+        int tileWidth = std::min(tileMinX + IMAGE_TILE_SIZE, width) - tileMinX;
+        int tileMaxY = std::min(tileMinY + IMAGE_TILE_SIZE, height);
+
+        float rowR[IMAGE_TILE_SIZE] __attribute__((aligned(32)));
+        float rowG[IMAGE_TILE_SIZE] __attribute__((aligned(32)));
+        float rowB[IMAGE_TILE_SIZE] __attribute__((aligned(32)));
+        float rowA[IMAGE_TILE_SIZE] __attribute__((aligned(32)));
+
+        for (int y=tileMinY; y<tileMaxY; y++) {
+
+            float* dst = &image->data[4 * (y * width + tileMinX)];
+            int rowStart = (y - tileMinY) * IMAGE_TILE_SIZE;
+
+            if (tileCleared[tile]) {
+                const float* color = &background[4 * y];
+                for (int x=0; x<tileWidth; x++) {
+                    dst[4 * x] = color[0];
+                    dst[4 * x + 1] = color[1];
+                    dst[4 * x + 2] = color[2];
+                    dst[4 * x + 3] = color[3];
+                }
+            } else if (format == TILE_PIXELS_HALF) {
+                halfsToFloats(halfChannel(storage, tile, 0) + rowStart, rowR, IMAGE_TILE_SIZE);
+                halfsToFloats(halfChannel(storage, tile, 1) + rowStart, rowG, IMAGE_TILE_SIZE);
+                halfsToFloats(halfChannel(storage, tile, 2) + rowStart, rowB, IMAGE_TILE_SIZE);
+                halfsToFloats(halfChannel(storage, tile, 3) + rowStart, rowA, IMAGE_TILE_SIZE);
+                interleaveRow(rowR, rowG, rowB, rowA, dst, tileWidth);
+            } else {
+                interleaveRow(floatChannel(storage, tile, 0) + rowStart,
+                              floatChannel(storage, tile, 1) + rowStart,
+                              floatChannel(storage, tile, 2) + rowStart,
+                              floatChannel(storage, tile, 3) + rowStart, dst, tileWidth);
+            }
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef __TILED_IMAGE_H__
+#define __TILED_IMAGE_H__
+
+#include <vector>
+
+struct Image;
+
+// Side of the square image tiles, in pixels
+#define IMAGE_TILE_SIZE 32
+
+// Planar copy of one tile of the image: while a tile is shaded its
+// channels live in separate arrays, so a row span of 8 pixels is one
+// vector per channel.
+struct TilePixels {
+    float r[IMAGE_TILE_SIZE * IMAGE_TILE_SIZE] __attribute__((aligned(32)));
+    float g[IMAGE_TILE_SIZE * IMAGE_TILE_SIZE] __attribute__((aligned(32)));
+    float b[IMAGE_TILE_SIZE * IMAGE_TILE_SIZE] __attribute__((aligned(32)));
+    float a[IMAGE_TILE_SIZE * IMAGE_TILE_SIZE] __attribute__((aligned(32)));
+};
+
+// How tile pixels are stored: 32-bit floats, or IEEE half precision
+// (8 bytes a pixel instead of 16) when some rounding of the stored
+// result is acceptable.  Shading always runs in single precision.
+enum TilePixelFormat { TILE_PIXELS_FLOAT, TILE_PIXELS_HALF };
+
+// Image stored as IMAGE_TILE_SIZE square tiles, every tile contiguous
+// and planar like TilePixels, so a tile is loaded and stored as one
+// block.  Clearing does not touch the pixels: it records the background
+// color of every row and marks all tiles as cleared, and a cleared tile
+// gets its background when it is next loaded or converted.  toImage()
+// converts to the interleaved layout of Image, for output.
+class TiledImage {
+
+private:
+
+    int width, height;
+    int numTilesX, numTilesY;
+    TilePixelFormat format;
+
+    void* storage;                  // numTiles blocks of 4 planar channels
+    std::vector<char> tileCleared;
+    std::vector<float> background;  // RGBA of every row
+
+    void fillBackground(int tile, TilePixels& pixels) const;
+
+public:
+
+    TiledImage(int width, int height, TilePixelFormat format);
+    ~TiledImage();
+
+    TiledImage(const TiledImage&) = delete;
+    TiledImage& operator=(const TiledImage&) = delete;
+
+    int getNumTilesX() const { return numTilesX; }
+    int getNumTilesY() const { return numTilesY; }
+
+    // Clears every pixel of row j to rowColors[4*j .. 4*j+3].
+    void clear(const float* rowColors);
+
+    void loadTile(int tile, TilePixels& pixels) const;
+
+    // Stores the tile with non-temporal writes: the tile is not read
+    // again before the frame is converted.
+    void storeTile(int tile, const TilePixels& pixels);
+
+    // Writes the image to the linear layout of image, which must have
+    // the same size.  Tiles are converted in parallel.
+    void toImage(Image* image) const;
+};
+
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef __ANALYTICS_H__
+#define __ANALYTICS_H__
+
+#include <climits>
+
+#include "common/graph.h"
+
+#define SSSP_INFINITY INT_MAX
+
+// Symmetric view of a directed graph: the neighbors of v are the union
+// of its outgoing and incoming neighbors, sorted, without duplicates or
+// self loops.  Triangle counting and k-core are defined on undirected
+// graphs, so both work on this view.
+struct undirected_graph
+{
+  int num_nodes;
+  long num_edges;
+
+  // Neighbors of v are edges[starts[v]] .. edges[starts[v + 1] - 1]
+  long* starts;
+  Vertex* edges;
+};
+
+undirected_graph* build_undirected(Graph g);
+void free_undirected(undirected_graph* ug);
+
+// SSSP needs weights, but the graph files only store topology.  Every
+// edge gets a deterministic pseudo-random weight in [1, 255] derived
+// from its endpoints so that all implementations agree.
+static inline int edge_weight(Vertex u, Vertex v)
+{
+  unsigned int h = static_cast<unsigned int>(u) * 0x9E3779B1u ^
+                   static_cast<unsigned int>(v) * 0x85EBCA77u;
+  h ^= h >> 15;
+  h *= 0x2C1B3C6Du;
+  h ^= h >> 13;
+  return static_cast<int>(h % 255) + 1;
+}
+
+// Weakly connected components.  comp[v] is the id of a vertex in v's
+// component; two vertices share a component iff their ids are equal.
+void connected_components(Graph g, int* comp);
+void connected_components_serial(Graph g, int* comp);
+
+// Number of triangles in the undirected view of the graph.
+long triangle_count(undirected_graph* ug);
+long triangle_count_serial(undirected_graph* ug);
+
+// core[v] is the largest k such that v belongs to the k-core of the
+// undirected view of the graph.
+void kcore_decomposition(undirected_graph* ug, int* core);
+void kcore_decomposition_serial(undirected_graph* ug, int* core);
+
+// Shortest distances from `source` along outgoing edges weighted by
+// edge_weight.  Unreachable vertices are set to SSSP_INFINITY.
+void sssp_delta_stepping(Graph g, Vertex source, int delta, int* distances);
+void sssp_serial(Graph g, Vertex source, int* distances);
+
+#endif /* __ANALYTICS_H__ */
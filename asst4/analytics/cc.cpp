@@ -0,0 +1,135 @@
+#include "analytics.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include <omp.h>
+
+#include "../common/graph.h"
+
+// Afforest only samples the first few neighbors of every vertex before
+// finding the giant component.  See
+// https://arxiv.org/abs/1811.00120 (Sutton et al., "Optimizing Parallel
+// Graph Connectivity Computation via Subgraph Sampling").
+#define NEIGHBOR_ROUNDS 2
+#define NUM_COMPONENT_SAMPLES 1024
+
+// Hook the trees of u and v together, always pointing the larger root at
+// the smaller one so that the forest stays acyclic without locks.
+static inline void link(Vertex u, Vertex v, int* comp)
+{
+  int p1 = comp[u];
+  int p2 = comp[v];
+  while (p1 != p2) {
+    int high = std::max(p1, p2);
+    int low = std::min(p1, p2);
+    int p_high = comp[high];
+    if (p_high == low)
+      break;
+    if (p_high == high && __sync_bool_compare_and_swap(&comp[high], high, low))
+      break;
+    p1 = comp[comp[high]];
+    p2 = comp[low];
+  }
+}
+
+// Shortcut every vertex straight to its root.
+static void compress(int n, int* comp)
+{
+  #pragma omp parallel for schedule(dynamic, 16384)
+  for (Vertex v = 0; v < n; v++) {
+    while (comp[v] != comp[comp[v]])
+      comp[v] = comp[comp[v]];
+  }
+}
+
+// Guess the id of the largest component from a fixed random sample.
+static int sample_frequent_element(int n, const int* comp)
+{
+  std::unordered_map<int, int> counts;
+  std::mt19937 gen(27491095);
+  std::uniform_int_distribution<int> distribution(0, n - 1);
+  for (int i = 0; i < NUM_COMPONENT_SAMPLES; i++)
+    counts[comp[distribution(gen)]]++;
+
+  auto most_frequent = std::max_element(
+      counts.begin(), counts.end(),
+      [](const std::pair<const int, int>& a, const std::pair<const int, int>& b) {
+        return a.second < b.second;
+      });
+  return most_frequent->first;
+}
+
+// Afforest: link a sparse sample of the edges, skip every vertex that
+// already landed in the giant component, then finish the remaining
+// vertices with all of their (outgoing and incoming) edges.
+void connected_components(Graph g, int* comp)
+{
+  int n = num_nodes(g);
+  // nothing to label, and no vertex to sample the giant component from
+  if (n == 0)
+    return;
+
+  #pragma omp parallel for
+  for (Vertex v = 0; v < n; v++)
+    comp[v] = v;
+
+  for (int r = 0; r < NEIGHBOR_ROUNDS; r++) {
+    #pragma omp parallel for schedule(dynamic, 16384)
+    for (Vertex u = 0; u < n; u++) {
+      if (r < outgoing_size(g, u))
+        link(u, outgoing_begin(g, u)[r], comp);
+    }
+    compress(n, comp);
+  }
+
+  int c = sample_frequent_element(n, comp);
+
+  #pragma omp parallel for schedule(dynamic, 16384)
+  for (Vertex u = 0; u < n; u++) {
+    if (comp[u] == c)
+      continue;
+    int skip = std::min(outgoing_size(g, u), NEIGHBOR_ROUNDS);
+    for (const Vertex* v = outgoing_begin(g, u) + skip; v != outgoing_end(g, u); v++)
+      link(u, *v, comp);
+    for (const Vertex* v = incoming_begin(g, u); v != incoming_end(g, u); v++)
+      link(u, *v, comp);
+  }
+
+  compress(n, comp);
+}
+
+// Serial reference: breadth-first labeling over outgoing and incoming
+// edges.  Every vertex is labeled with the smallest id in its component.
+void connected_components_serial(Graph g, int* comp)
+{
+  int n = num_nodes(g);
+  for (Vertex v = 0; v < n; v++)
+    comp[v] = -1;
+
+  std::vector<Vertex> queue;
+  for (Vertex root = 0; root < n; root++) {
+    if (comp[root] != -1)
+      continue;
+    comp[root] = root;
+    queue.clear();
+    queue.push_back(root);
+    for (size_t head = 0; head < queue.size(); head++) {
+      Vertex u = queue[head];
+      for (const Vertex* v = outgoing_begin(g, u); v != outgoing_end(g, u); v++) {
+        if (comp[*v] == -1) {
+          comp[*v] = root;
+          queue.push_back(*v);
+        }
+      }
+      for (const Vertex* v = incoming_begin(g, u); v != incoming_end(g, u); v++) {
+        if (comp[*v] == -1) {
+          comp[*v] = root;
+          queue.push_back(*v);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,135 @@
+#include "analytics.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <climits>
+#include <algorithm>
+#include <vector>
+#include <omp.h>
+
+// Parallel peeling.  Level k starts with every remaining vertex of
+// degree <= k; removing them lowers the degree of their neighbors, and a
+// neighbor joins the next round of level k at the moment its degree
+// drops from k + 1 to k.  That transition happens exactly once per
+// vertex, so the atomic decrement alone decides who enqueues it.
+void kcore_decomposition(undirected_graph* ug, int* core)
+{
+  int n = ug->num_nodes;
+  int* degree = (int*)malloc(sizeof(int) * n);
+  bool* removed = (bool*)malloc(sizeof(bool) * n);
+
+  #pragma omp parallel for
+  for (Vertex v = 0; v < n; v++) {
+    degree[v] = ug->starts[v + 1] - ug->starts[v];
+    removed[v] = false;
+  }
+
+  int maxThreadNum = omp_get_max_threads();
+  std::vector<std::vector<Vertex>> localList(maxThreadNum);
+  std::vector<Vertex> frontier;
+
+  int remaining = n;
+  int k = 0;
+  while (remaining > 0) {
+
+    // Skip levels with nothing to peel
+    int min_degree = INT_MAX;
+    #pragma omp parallel for reduction(min: min_degree)
+    for (Vertex v = 0; v < n; v++) {
+      if (!removed[v] && degree[v] < min_degree)
+        min_degree = degree[v];
+    }
+    k = std::max(k, min_degree);
+
+    #pragma omp parallel for
+    for (Vertex v = 0; v < n; v++) {
+      if (!removed[v] && degree[v] <= k) {
+        removed[v] = true;
+        localList[omp_get_thread_num()].push_back(v);
+      }
+    }
+
+    while (true) {
+      frontier.clear();
+      for (int t = 0; t < maxThreadNum; t++) {
+        frontier.insert(frontier.end(), localList[t].begin(), localList[t].end());
+        localList[t].clear();
+      }
+      if (frontier.empty())
+        break;
+      remaining -= frontier.size();
+
+      #pragma omp parallel for schedule(dynamic, 64)
+      for (size_t i = 0; i < frontier.size(); i++) {
+        Vertex v = frontier[i];
+        core[v] = k;
+        for (long e = ug->starts[v]; e < ug->starts[v + 1]; e++) {
+          Vertex u = ug->edges[e];
+          if (removed[u])
+            continue;
+          if (__sync_sub_and_fetch(&degree[u], 1) == k) {
+            removed[u] = true;
+            localList[omp_get_thread_num()].push_back(u);
+          }
+        }
+      }
+    }
+    k++;
+  }
+
+  free(degree);
+  free(removed);
+}
+
+// Serial reference: Batagelj-Zaversnik bucket sort, O(n + m).
+void kcore_decomposition_serial(undirected_graph* ug, int* core)
+{
+  int n = ug->num_nodes;
+  int max_degree = 0;
+  for (Vertex v = 0; v < n; v++) {
+    core[v] = ug->starts[v + 1] - ug->starts[v];
+    max_degree = std::max(max_degree, core[v]);
+  }
+
+  // Vertices sorted by degree, with bin_start[d] the first one of degree d
+  std::vector<int> bin_start(max_degree + 1, 0);
+  std::vector<int> pos(n);
+  std::vector<Vertex> order(n);
+  for (Vertex v = 0; v < n; v++)
+    bin_start[core[v]]++;
+  int start = 0;
+  for (int d = 0; d <= max_degree; d++) {
+    int count = bin_start[d];
+    bin_start[d] = start;
+    start += count;
+  }
+  for (Vertex v = 0; v < n; v++) {
+    pos[v] = bin_start[core[v]]++;
+    order[pos[v]] = v;
+  }
+  for (int d = max_degree; d > 0; d--)
+    bin_start[d] = bin_start[d - 1];
+  bin_start[0] = 0;
+
+  for (int i = 0; i < n; i++) {
+    Vertex v = order[i];
+    for (long e = ug->starts[v]; e < ug->starts[v + 1]; e++) {
+      Vertex u = ug->edges[e];
+      if (core[u] > core[v]) {
+        // Move u to the front of its bin, then shrink the bin by one
+        int du = core[u];
+        int pu = pos[u];
+        int pw = bin_start[du];
+        Vertex w = order[pw];
+        if (u != w) {
+          pos[u] = pw;
+          order[pu] = w;
+          pos[w] = pu;
+          order[pw] = u;
+        }
+        bin_start[du]++;
+        core[u]--;
+      }
+    }
+  }
+}
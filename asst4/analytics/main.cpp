@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+#include <string>
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "common/CycleTimer.h"
+#include "common/graph.h"
+#include "common/grade.h"
+#include "analytics.h"
+
+#define USE_BINARY_GRAPH 1
+
+#define SSSP_SOURCE_NODE_ID 0
+#define SSSP_DELTA 32
+
+#define KERNEL_CC     "cc"
+#define KERNEL_TC     "tc"
+#define KERNEL_KCORE  "kcore"
+#define KERNEL_SSSP   "sssp"
+
+// Result of one kernel run: per-vertex values, or a single count for
+// triangle counting.
+struct kernel_result
+{
+  int* values;
+  long count;
+};
+
+void run_kernel(const std::string& kernel, Graph g, undirected_graph* ug,
+                bool serial, kernel_result* result) {
+    if (kernel == KERNEL_CC) {
+        if (serial)
+            connected_components_serial(g, result->values);
+        else
+            connected_components(g, result->values);
+    } else if (kernel == KERNEL_TC) {
+        result->count = serial ? triangle_count_serial(ug) : triangle_count(ug);
+    } else if (kernel == KERNEL_KCORE) {
+        if (serial)
+            kcore_decomposition_serial(ug, result->values);
+        else
+            kcore_decomposition(ug, result->values);
+    } else {
+        if (serial)
+            sssp_serial(g, SSSP_SOURCE_NODE_ID, result->values);
+        else
+            sssp_delta_stepping(g, SSSP_SOURCE_NODE_ID, SSSP_DELTA, result->values);
+    }
+}
+
+// Component ids are arbitrary representatives, so two labelings agree
+// when they induce the same partition: the map from reference id to
+// computed id must be a bijection.
+bool compareComponents(Graph g, int* ref, int* stu) {
+    std::vector<int> ref_to_stu(g->num_nodes, -1);
+    std::vector<int> stu_to_ref(g->num_nodes, -1);
+    for (int i = 0; i < g->num_nodes; i++) {
+        if (ref_to_stu[ref[i]] == -1 && stu_to_ref[stu[i]] == -1) {
+            ref_to_stu[ref[i]] = stu[i];
+            stu_to_ref[stu[i]] = ref[i];
+        }
+        if (ref_to_stu[ref[i]] != stu[i] || stu_to_ref[stu[i]] != ref[i]) {
+            fprintf(stderr, "*** Results disagree at %d: component %d, %d\n", i, ref[i], stu[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool check_result(const std::string& kernel, Graph g, kernel_result* ref, kernel_result* stu) {
+    if (kernel == KERNEL_CC)
+        return compareComponents(g, ref->values, stu->values);
+    if (kernel == KERNEL_TC) {
+        if (ref->count != stu->count) {
+            fprintf(stderr, "*** Results disagree: %ld triangles, %ld\n", ref->count, stu->count);
+            return false;
+        }
+        return true;
+    }
+    return compareArrays(g, ref->values, stu->values);
+}
+
+void usage() {
+    std::cerr << "Usage: <kernel> <path/to/graph/file> [num_threads]\n";
+    std::cerr << "  kernel is one of:\n";
+    std::cerr << "    " << KERNEL_CC << ":    weakly connected components (Afforest)\n";
+    std::cerr << "    " << KERNEL_TC << ":    triangle counting\n";
+    std::cerr << "    " << KERNEL_KCORE << ": k-core decomposition\n";
+    std::cerr << "    " << KERNEL_SSSP << ":  single-source shortest paths (delta-stepping)\n";
+    std::cerr << "  To run results for all thread counts: <kernel> <path/to/graph/file>\n";
+    std::cerr << "  Run with a certain number of threads: <kernel> <path/to/graph/file> <num_threads>\n";
+}
+
+int main(int argc, char** argv) {
+
+    if (argc < 3)
+    {
+        usage();
+        exit(1);
+    }
+
+    std::string kernel = argv[1];
+    if (kernel != KERNEL_CC && kernel != KERNEL_TC &&
+        kernel != KERNEL_KCORE && kernel != KERNEL_SSSP)
+    {
+        usage();
+        exit(1);
+    }
+
+    int thread_count = -1;
+    if (argc == 4)
+    {
+        thread_count = atoi(argv[3]);
+    }
+
+    std::string graph_filename = argv[2];
+
+    Graph g;
+
+    printf("----------------------------------------------------------\n");
+    printf("Max system threads = %d\n", omp_get_max_threads());
+    if (thread_count > 0)
+    {
+        thread_count = std::min(thread_count, omp_get_max_threads());
+        printf("Running with %d threads\n", thread_count);
+    }
+    printf("----------------------------------------------------------\n");
+
+    printf("Loading graph...\n");
+    if (USE_BINARY_GRAPH) {
+      g = load_graph_binary(graph_filename.c_str());
+    } else {
+        g = load_graph(argv[2]);
+        printf("storing binary form of graph!\n");
+        store_graph_binary(graph_filename.append(".bin").c_str(), g);
+        delete g;
+        exit(1);
+    }
+    printf("\n");
+    printf("Graph stats:\n");
+    printf("  Edges: %d\n", g->num_edges);
+    printf("  Nodes: %d\n", g->num_nodes);
+
+    undirected_graph* ug = NULL;
+    if (kernel == KERNEL_TC || kernel == KERNEL_KCORE) {
+        double start = CycleTimer::currentSeconds();
+        ug = build_undirected(g);
+        printf("  Undirected edges: %ld (built in %.4f sec)\n",
+               ug->num_edges, CycleTimer::currentSeconds() - start);
+    }
+
+    std::vector<int> num_threads;
+    if (thread_count <= -1)
+    {
+        int max_threads = omp_get_max_threads();
+        for (int i = 1; i < max_threads; i *= 2) {
+          num_threads.push_back(i);
+        }
+        num_threads.push_back(max_threads);
+    }
+    else
+    {
+        num_threads.push_back(thread_count);
+    }
+
+    kernel_result sol;
+    sol.values = (int*)malloc(sizeof(int) * g->num_nodes);
+    sol.count = 0;
+
+    //Serial reference
+    kernel_result ref;
+    ref.values = (int*)malloc(sizeof(int) * g->num_nodes);
+    ref.count = 0;
+
+    double start = CycleTimer::currentSeconds();
+    run_kernel(kernel, g, ug, true, &ref);
+    double ref_time = CycleTimer::currentSeconds() - start;
+
+    double base_time = 0;
+    bool check = true;
+    std::stringstream timing;
+    timing << "Threads  Time (Speedup)      vs. Serial\n";
+
+    for (size_t i = 0; i < num_threads.size(); i++)
+    {
+        printf("----------------------------------------------------------\n");
+        std::cout << "Running with " << num_threads[i] << " threads" << std::endl;
+        omp_set_num_threads(num_threads[i]);
+
+        start = CycleTimer::currentSeconds();
+        run_kernel(kernel, g, ug, false, &sol);
+        double time = CycleTimer::currentSeconds() - start;
+        if (i == 0)
+            base_time = time;
+
+        std::cout << "Testing Correctness of " << kernel << "\n";
+        if (!check_result(kernel, g, &ref, &sol))
+            check = false;
+
+        char buf[1024];
+        sprintf(buf, "%4d:    %.4f (%.2fx)     %.2fx\n",
+                num_threads[i], time, base_time / time, ref_time / time);
+        timing << buf;
+    }
+
+    if (kernel == KERNEL_TC)
+        printf("Triangles: %ld\n", sol.count);
+
+    printf("----------------------------------------------------------\n");
+    std::cout << "Your Code: Timing Summary" << std::endl;
+    std::cout << timing.str();
+    printf("----------------------------------------------------------\n");
+    printf("Serial Reference: %.4f\n", ref_time);
+    printf("----------------------------------------------------------\n");
+    if (!check)
+        std::cout << kernel << " is not Correct" << std::endl;
+
+    free(sol.values);
+    free(ref.values);
+    if (ug)
+        free_undirected(ug);
+    delete g;
+
+    return check ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+#include "analytics.h"
+
+#include <stdint.h>
+#include <climits>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+#include <omp.h>
+
+// Lower distances[v] to new_dist unless another thread got it lower.
+static inline bool atomic_min(int* distances, Vertex v, int new_dist)
+{
+  int old_dist = distances[v];
+  while (new_dist < old_dist) {
+    if (__sync_bool_compare_and_swap(&distances[v], old_dist, new_dist))
+      return true;
+    old_dist = distances[v];
+  }
+  return false;
+}
+
+// Delta-stepping (Meyer and Sanders).  Vertices are kept in buckets of
+// width `delta` by tentative distance; each step relaxes every edge out
+// of the lowest non-empty bucket in parallel.  Improved vertices go to
+// per-thread buckets, so the only shared writes are the CAS on the
+// distance array.  A bucket is revisited until relaxing it stops
+// producing new entries for it, and entries whose distance improved
+// after they were queued are skipped because an earlier bucket already
+// handled them.
+void sssp_delta_stepping(Graph g, Vertex source, int delta, int* distances)
+{
+  int n = num_nodes(g);
+
+  #pragma omp parallel for
+  for (Vertex v = 0; v < n; v++)
+    distances[v] = SSSP_INFINITY;
+  distances[source] = 0;
+
+  int maxThreadNum = omp_get_max_threads();
+  std::vector<std::vector<std::vector<Vertex>>> localBins(maxThreadNum);
+  std::vector<Vertex> frontier(1, source);
+  size_t curr_bin = 0;
+
+  while (!frontier.empty()) {
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (size_t i = 0; i < frontier.size(); i++) {
+      Vertex u = frontier[i];
+      int dist_u = distances[u];
+      if (static_cast<size_t>(dist_u / delta) < curr_bin)
+        continue;
+
+      std::vector<std::vector<Vertex>>& bins = localBins[omp_get_thread_num()];
+      for (const Vertex* v = outgoing_begin(g, u); v != outgoing_end(g, u); v++) {
+        int new_dist = dist_u + edge_weight(u, *v);
+        if (atomic_min(distances, *v, new_dist)) {
+          size_t dest_bin = new_dist / delta;
+          if (dest_bin >= bins.size())
+            bins.resize(dest_bin + 1);
+          bins[dest_bin].push_back(*v);
+        }
+      }
+    }
+
+    size_t next_bin = SIZE_MAX;
+    for (int t = 0; t < maxThreadNum; t++) {
+      for (size_t b = curr_bin; b < localBins[t].size() && b < next_bin; b++) {
+        if (!localBins[t][b].empty()) {
+          next_bin = b;
+          break;
+        }
+      }
+    }
+
+    frontier.clear();
+    if (next_bin == SIZE_MAX)
+      break;
+    for (int t = 0; t < maxThreadNum; t++) {
+      if (next_bin < localBins[t].size()) {
+        frontier.insert(frontier.end(), localBins[t][next_bin].begin(),
+                        localBins[t][next_bin].end());
+        localBins[t][next_bin].clear();
+      }
+    }
+    curr_bin = next_bin;
+  }
+}
+
+// Serial reference: Dijkstra with a binary heap.
+void sssp_serial(Graph g, Vertex source, int* distances)
+{
+  int n = num_nodes(g);
+  for (Vertex v = 0; v < n; v++)
+    distances[v] = SSSP_INFINITY;
+  distances[source] = 0;
+
+  typedef std::pair<int, Vertex> Entry;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+  queue.push(Entry(0, source));
+  while (!queue.empty()) {
+    Entry top = queue.top();
+    queue.pop();
+    Vertex u = top.second;
+    if (top.first > distances[u])
+      continue;
+    for (const Vertex* v = outgoing_begin(g, u); v != outgoing_end(g, u); v++) {
+      int new_dist = top.first + edge_weight(u, *v);
+      if (new_dist < distances[*v]) {
+        distances[*v] = new_dist;
+        queue.push(Entry(new_dist, *v));
+      }
+    }
+  }
+}
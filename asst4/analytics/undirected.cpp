@@ -0,0 +1,64 @@
+#include "analytics.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <omp.h>
+
+#include "../common/graph.h"
+
+// build_undirected --
+//
+// Merges the outgoing and incoming lists of every vertex.  Each vertex
+// first sorts and dedups its neighbors in place inside a scratch array
+// large enough for both lists (its slot starts at
+// outgoing_starts[v] + incoming_starts[v]), then the lists are packed
+// into the final CSR once their sizes are known.
+undirected_graph* build_undirected(Graph g)
+{
+  int n = num_nodes(g);
+  undirected_graph* ug = (undirected_graph*)malloc(sizeof(undirected_graph));
+  ug->num_nodes = n;
+  ug->starts = (long*)malloc(sizeof(long) * (n + 1));
+
+  Vertex* scratch = (Vertex*)malloc(sizeof(Vertex) * 2L * num_edges(g));
+  int* degree = (int*)malloc(sizeof(int) * n);
+
+  #pragma omp parallel for schedule(dynamic, 1024)
+  for (Vertex v = 0; v < n; v++) {
+    Vertex* list = scratch + (long)g->outgoing_starts[v] + g->incoming_starts[v];
+    int count = 0;
+    for (const Vertex* u = outgoing_begin(g, v); u != outgoing_end(g, v); u++)
+      list[count++] = *u;
+    for (const Vertex* u = incoming_begin(g, v); u != incoming_end(g, v); u++)
+      list[count++] = *u;
+
+    std::sort(list, list + count);
+    Vertex* end = std::unique(list, list + count);
+    end = std::remove(list, end, v);
+    degree[v] = end - list;
+  }
+
+  ug->starts[0] = 0;
+  for (Vertex v = 0; v < n; v++)
+    ug->starts[v + 1] = ug->starts[v] + degree[v];
+  ug->num_edges = ug->starts[n];
+
+  ug->edges = (Vertex*)malloc(sizeof(Vertex) * ug->num_edges);
+  #pragma omp parallel for schedule(dynamic, 1024)
+  for (Vertex v = 0; v < n; v++) {
+    Vertex* list = scratch + (long)g->outgoing_starts[v] + g->incoming_starts[v];
+    memcpy(ug->edges + ug->starts[v], list, sizeof(Vertex) * degree[v]);
+  }
+
+  free(degree);
+  free(scratch);
+  return ug;
+}
+
+void free_undirected(undirected_graph* ug)
+{
+  free(ug->starts);
+  free(ug->edges);
+  free(ug);
+}
@@ -3,6 +3,10 @@
 #include <fstream>
 #include <sstream>
 #include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "graph.h"
 #include "graph_internal.h"
@@ -312,3 +316,54 @@ void store_graph_binary(const char* filename, Graph graph) {
 
     fclose(output);
 }
+
+Graph map_graph_binary(const char* filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open: %s\n", filename);
+        exit(1);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)(3 * sizeof(int))) {
+        fprintf(stderr, "Error reading header.\n");
+        exit(1);
+    }
+
+    int* data = (int*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Could not map: %s\n", filename);
+        exit(1);
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    if (data[0] != GRAPH_HEADER_TOKEN) {
+        fprintf(stderr, "Invalid graph file header. File may be corrupt.\n");
+        exit(1);
+    }
+
+    graph* graph = (struct graph*)(malloc(sizeof(struct graph)));
+    graph->num_nodes = data[1];
+    graph->num_edges = data[2];
+
+    size_t expected = sizeof(int) * (3 + (size_t)graph->num_nodes + (size_t)graph->num_edges);
+    if ((size_t)st.st_size < expected) {
+        fprintf(stderr, "Error reading edges.\n");
+        exit(1);
+    }
+
+    graph->outgoing_starts = data + 3;
+    graph->outgoing_edges = data + 3 + graph->num_nodes;
+    graph->incoming_starts = NULL;
+    graph->incoming_edges = NULL;
+    return graph;
+}
+
+void unmap_graph_binary(Graph graph)
+{
+    int* data = graph->outgoing_starts - 3;
+    munmap(data, sizeof(int) * (3 + (size_t)graph->num_nodes + (size_t)graph->num_edges));
+    free(graph);
+}
@@ -40,6 +40,12 @@ Graph load_graph(const char* filename);
 Graph load_graph_binary(const char* filename);
 void store_graph_binary(const char* filename, Graph);
 
+// Maps a binary graph file read-only instead of reading it.  Only the
+// outgoing CSR is available (incoming_* are NULL); release the graph
+// with unmap_graph_binary.
+Graph map_graph_binary(const char* filename);
+void unmap_graph_binary(Graph);
+
 void print_graph(const graph*);
 
 
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <omp.h>
+#include <algorithm>
 #include <string>
 #include <getopt.h>
 
@@ -21,17 +22,178 @@
 
 void reference_pageRank(Graph g, double* solution, double damping, double convergence);
 
+typedef void (*PageRankFn)(Graph g, double* solution, double damping, double convergence);
+
+// Largest difference allowed between a seeded query and
+// personalizedReference: both stop within PageRankConvergence of the
+// fixed point, in L1 norm
+#define PersonalizedTolerance 1e-7
+
+// Serial personalized PageRank of a single query that restarts at seed,
+// pushing scores along outgoing edges instead of gathering them: an
+// independent check of pageRankPersonalized.
+void personalizedReference(Graph g, Vertex seed, double* solution, double damping, double convergence) {
+    int numNodes = g->num_nodes;
+    std::vector<double> next(numNodes);
+
+    for (int v = 0; v < numNodes; v++) {
+        solution[v] = 1.0 / numNodes;
+    }
+
+    bool converged = false;
+    while (!converged) {
+        std::fill(next.begin(), next.end(), 0.0);
+        double restart = 1.0 - damping;
+        for (int u = 0; u < numNodes; u++) {
+            int degree = outgoing_size(g, u);
+            if (degree == 0) {
+                restart += damping * solution[u];
+                continue;
+            }
+            double share = damping * solution[u] / degree;
+            for (const Vertex* out = outgoing_begin(g, u); out != outgoing_end(g, u); out++) {
+                next[*out] += share;
+            }
+        }
+        next[seed] += restart;
+
+        double diff = 0.0;
+        for (int v = 0; v < numNodes; v++) {
+            diff += fabs(next[v] - solution[v]);
+            solution[v] = next[v];
+        }
+        converged = diff < convergence;
+    }
+}
+
+// Times one pageRankPersonalized call over K queries against K separate
+// pageRank runs.  With uniform teleport vectors every column must match
+// pageRank; with one seed vertex per query every column must match
+// personalizedReference for that seed, and sum to 1.
+bool runPersonalized(Graph g, int num_vectors) {
+    int K = num_vectors;
+    long size = static_cast<long>(g->num_nodes) * K;
+    double* teleport = (double*)malloc(sizeof(double) * size);
+    double* batched = (double*)malloc(sizeof(double) * size);
+    double* single = (double*)malloc(sizeof(double) * g->num_nodes);
+    double* column = (double*)malloc(sizeof(double) * g->num_nodes);
+    bool check = true;
+
+    for (long i = 0; i < size; i++) {
+        teleport[i] = 1.0 / g->num_nodes;
+    }
+
+    double start = CycleTimer::currentSeconds();
+    pageRankPersonalized(g, K, teleport, batched, PageRankDampening, PageRankConvergence);
+    double batched_time = CycleTimer::currentSeconds() - start;
+
+    double single_time = 0.0;
+    std::cout << "Testing Correctness of Personalized Page Rank\n";
+    for (int k = 0; k < K; k++) {
+        start = CycleTimer::currentSeconds();
+        pageRank(g, single, PageRankDampening, PageRankConvergence);
+        single_time += CycleTimer::currentSeconds() - start;
+
+        for (int v = 0; v < g->num_nodes; v++) {
+            column[v] = batched[static_cast<long>(v) * K + k];
+        }
+        if (!compareApprox(g, single, column)) {
+            std::cerr << "*** Query " << k << " disagrees with pageRank\n";
+            check = false;
+        }
+    }
+
+    for (long i = 0; i < size; i++) {
+        teleport[i] = 0.0;
+    }
+    for (int k = 0; k < K; k++) {
+        Vertex seed = static_cast<Vertex>(static_cast<long>(k) * g->num_nodes / K);
+        teleport[static_cast<long>(seed) * K + k] = 1.0;
+    }
+    pageRankPersonalized(g, K, teleport, batched, PageRankDampening, PageRankConvergence);
+    for (int k = 0; k < K; k++) {
+        Vertex seed = static_cast<Vertex>(static_cast<long>(k) * g->num_nodes / K);
+        personalizedReference(g, seed, single, PageRankDampening, PageRankConvergence);
+
+        double mass = 0.0;
+        double maxDiff = 0.0;
+        for (int v = 0; v < g->num_nodes; v++) {
+            double score = batched[static_cast<long>(v) * K + k];
+            mass += score;
+            maxDiff = std::max(maxDiff, fabs(score - single[v]));
+        }
+        if (maxDiff > PersonalizedTolerance) {
+            std::cerr << "*** Seeded query " << k << " differs from the reference by " << maxDiff << "\n";
+            check = false;
+        }
+        if (fabs(mass - 1.0) > 1e-6) {
+            std::cerr << "*** Seeded query " << k << " has total score " << mass << "\n";
+            check = false;
+        }
+    }
+
+    printf("----------------------------------------------------------\n");
+    printf("Queries  Batched    %d x pageRank  (Speedup)\n", K);
+    printf("%4d:    %.4f     %.4f       (%.2fx)\n",
+           K, batched_time, single_time, single_time / batched_time);
+    printf("----------------------------------------------------------\n");
+    if (!check)
+        std::cout << "Personalized Page Rank is not Correct" << std::endl;
+
+    free(teleport);
+    free(batched);
+    free(single);
+    free(column);
+    return check;
+}
+
+void usage() {
+    std::cerr << "Usage: [-m gather|blocked] [-k num_queries] <path/to/graph/file> [num_threads]\n";
+    std::cerr << "  To run results for all thread counts: <path/to/graph/file>\n";
+    std::cerr << "  Run with a certain number of threads (no correctness run): <path/to/graph/file> <num_threads>\n";
+    std::cerr << "  -m gather:  pull scores over incoming edges (default)\n";
+    std::cerr << "  -m blocked: propagation blocking, for graphs larger than LLC\n";
+    std::cerr << "  -k K:       time personalized PageRank over K queries at once\n";
+}
 
 int main(int argc, char** argv) {
 
     int  num_threads = -1;
     std::string graph_filename;
 
+    PageRankFn pagerank_impl = pageRank;
+    int num_queries = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "m:k:h")) != -1) {
+        switch (opt) {
+        case 'k':
+            num_queries = atoi(optarg);
+            if (num_queries <= 0) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'm':
+            if (std::string(optarg) == "gather") {
+                pagerank_impl = pageRank;
+            } else if (std::string(optarg) == "blocked") {
+                pagerank_impl = pageRankBlocked;
+            } else {
+                usage();
+                exit(1);
+            }
+            break;
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
     if (argc < 2)
     {
-        std::cerr << "Usage: <path/to/graph/file> [num_threads]\n";
-        std::cerr << "  To run results for all thread counts: <path/to/graph/file>\n";
-        std::cerr << "  Run with a certain number of threads (no correctness run): <path/to/graph/file> <num_threads>\n";
+        usage();
         exit(1);
     }
 
@@ -69,6 +231,15 @@ int main(int argc, char** argv) {
     printf("  Edges: %d\n", g->num_edges);
     printf("  Nodes: %d\n", g->num_nodes);
 
+    if (num_queries > 0)
+    {
+        if (thread_count > 0)
+            omp_set_num_threads(thread_count);
+        bool check = runPersonalized(g, num_queries);
+        delete g;
+        return check ? 0 : 1;
+    }
+
     //If we want to run on all threads
     if (thread_count <= -1)
     {
@@ -122,7 +293,7 @@ int main(int argc, char** argv) {
 
             //Run implementations
             start = CycleTimer::currentSeconds();
-            pageRank(g, sol1, PageRankDampening, PageRankConvergence);
+            pagerank_impl(g, sol1, PageRankDampening, PageRankConvergence);
             pagerank_time = CycleTimer::currentSeconds() - start;
 
             //Run staff reference implementation
@@ -205,7 +376,7 @@ int main(int argc, char** argv) {
 
         //Run implementations
         start = CycleTimer::currentSeconds();
-        pageRank(g, sol1, PageRankDampening, PageRankConvergence);
+        pagerank_impl(g, sol1, PageRankDampening, PageRankConvergence);
         pagerank_time = CycleTimer::currentSeconds() - start;
 
         //Run reference implementation
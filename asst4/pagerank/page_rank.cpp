@@ -1,13 +1,20 @@
 #include "page_rank.h"
 
 #include <stdlib.h>
+#include <unistd.h>
 #include <cmath>
 #include <omp.h>
+#include <algorithm>
 #include <utility>
+#include <vector>
 
 #include "../common/CycleTimer.h"
 #include "../common/graph.h"
 
+// Used when the C library cannot report the L2 size (sysconf without
+// _SC_LEVEL2_CACHE_SIZE outside glibc, or a 0 answer).
+#define DEFAULT_L2_CACHE_SIZE (256 * 1024)
+
 
 // pageRank --
 //
@@ -108,3 +115,326 @@ void pageRank(Graph g, double* solution, double damping, double convergence)
 
    */
 }
+
+// pageRankBinShift --
+//
+// log2 of the number of destination vertices covered by one
+// propagation-blocking bin.  A bin's slice of the score array should stay resident in L2
+// while the bin's contributions are streamed in, so we give it half of
+// L2 and leave the rest for the streamed data.  The width is rounded
+// down to a power of two so the bin of a vertex is a single shift, and
+// it is shrunk until every thread has at least one bin to accumulate.
+//
+static int pageRankBinShift(int numNodes, int numThreads)
+{
+  long l2 = 0;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+  if (l2 <= 0) {
+    l2 = DEFAULT_L2_CACHE_SIZE;
+  }
+
+  long width = l2 / 2 / static_cast<long>(sizeof(double));
+  int shift = 0;
+  while ((2L << shift) <= width) {
+    shift++;
+  }
+  while (shift > 0 && ((numNodes - 1) >> shift) + 1 < numThreads) {
+    shift--;
+  }
+  return shift;
+}
+
+// pageRankBlocked --
+//
+// Same contract as pageRank, but computed with propagation blocking
+// instead of a pull over the incoming edges.  The pull reads
+// solution[*iv] at random for every edge, which misses in cache once
+// the score array is larger than LLC.  Here every iteration instead
+//
+//   1. streams the outgoing edges once, appending the contribution
+//      score[u] / outdegree(u) of each edge to the bin that owns its
+//      destination (sequential writes, one cursor per bin), and
+//   2. drains the bins one at a time, so the random updates to the new
+//      scores land in an L2-sized slice of the array.
+//
+// The destination of every bin slot only depends on the graph, so it is
+// computed once up front and only the contributions are rewritten.
+//
+void pageRankBlocked(Graph g, double* solution, double damping, double convergence)
+{
+  int numNodes = num_nodes(g);
+  int numEdges = num_edges(g);
+  int numChunks = omp_get_max_threads();
+  int binShift = pageRankBinShift(numNodes, numChunks);
+  int numBins = ((numNodes - 1) >> binShift) + 1;
+
+  // Split the sources into one chunk per thread holding roughly the same
+  // number of outgoing edges.  Chunks (not threads) own the bin cursors,
+  // so the bin layout is deterministic.
+  int* chunkStarts = new int[numChunks + 1];
+  for (int c = 0; c < numChunks; ++c) {
+    long target = static_cast<long>(numEdges) * c / numChunks;
+    chunkStarts[c] = std::lower_bound(g->outgoing_starts, g->outgoing_starts + numNodes,
+                                      static_cast<int>(target)) - g->outgoing_starts;
+  }
+  chunkStarts[numChunks] = numNodes;
+
+  // binStarts[b * numChunks + c] is where chunk c writes into bin b, so
+  // all slots of one bin are contiguous.
+  int numSlots = numBins * numChunks;
+  int* binStarts = new int[numSlots + 1];
+  #pragma omp parallel for schedule(static, 1)
+  for (int c = 0; c < numChunks; ++c) {
+    for (int b = 0; b < numBins; ++b) {
+      binStarts[b * numChunks + c] = 0;
+    }
+    for (Vertex u = chunkStarts[c]; u < chunkStarts[c + 1]; ++u) {
+      for (const Vertex* ov = outgoing_begin(g, u); ov != outgoing_end(g, u); ++ov) {
+        binStarts[(*ov >> binShift) * numChunks + c]++;
+      }
+    }
+  }
+
+  int total = 0;
+  for (int i = 0; i < numSlots; ++i) {
+    int count = binStarts[i];
+    binStarts[i] = total;
+    total += count;
+  }
+  binStarts[numSlots] = total;
+
+  Vertex* binDest = new Vertex[numEdges];
+  double* binValue = new double[numEdges];
+
+  #pragma omp parallel for schedule(static, 1)
+  for (int c = 0; c < numChunks; ++c) {
+    std::vector<int> cursor(numBins);
+    for (int b = 0; b < numBins; ++b) {
+      cursor[b] = binStarts[b * numChunks + c];
+    }
+    for (Vertex u = chunkStarts[c]; u < chunkStarts[c + 1]; ++u) {
+      for (const Vertex* ov = outgoing_begin(g, u); ov != outgoing_end(g, u); ++ov) {
+        binDest[cursor[*ov >> binShift]++] = *ov;
+      }
+    }
+  }
+
+  double equal_prob = 1.0 / numNodes;
+  #pragma omp parallel for
+  for (int i = 0; i < numNodes; ++i) {
+    solution[i] = equal_prob;
+  }
+
+  double* tempArray = new double[numNodes];
+  double teleport = (1.0 - damping) / static_cast<double>(numNodes);
+
+  bool converged = false;
+  while (!converged) {
+
+    // Binning pass.  The dangling-node mass only needs the old scores,
+    // so it is folded into the same sweep.
+    double t = 0.0;
+    #pragma omp parallel for schedule(static, 1) reduction(+: t)
+    for (int c = 0; c < numChunks; ++c) {
+      std::vector<int> cursor(numBins);
+      for (int b = 0; b < numBins; ++b) {
+        cursor[b] = binStarts[b * numChunks + c];
+      }
+      for (Vertex u = chunkStarts[c]; u < chunkStarts[c + 1]; ++u) {
+        int degree = outgoing_size(g, u);
+        if (degree == 0) {
+          t += damping * solution[u] / static_cast<double>(numNodes);
+          continue;
+        }
+        double contribution = solution[u] / static_cast<double>(degree);
+        for (const Vertex* ov = outgoing_begin(g, u); ov != outgoing_end(g, u); ++ov) {
+          binValue[cursor[*ov >> binShift]++] = contribution;
+        }
+      }
+    }
+
+    // Accumulation pass: one bin covers one cache-resident slice of
+    // tempArray, so no two threads ever touch the same vertex.
+    double globalDiff = 0.0;
+    #pragma omp parallel for schedule(dynamic) reduction(+: globalDiff)
+    for (int b = 0; b < numBins; ++b) {
+      Vertex first = b << binShift;
+      Vertex last = static_cast<Vertex>(
+          std::min(static_cast<long>(numNodes), static_cast<long>(b + 1) << binShift));
+      for (Vertex v = first; v < last; ++v) {
+        tempArray[v] = 0.0;
+      }
+      for (int e = binStarts[b * numChunks]; e < binStarts[(b + 1) * numChunks]; ++e) {
+        tempArray[binDest[e]] += binValue[e];
+      }
+      for (Vertex v = first; v < last; ++v) {
+        tempArray[v] = tempArray[v] * damping + teleport + t;
+        globalDiff += fabs(tempArray[v] - solution[v]);
+      }
+    }
+
+    #pragma omp parallel for
+    for (Vertex v = 0; v < numNodes; ++v) {
+      solution[v] = tempArray[v];
+    }
+    converged = globalDiff < convergence;
+  }
+
+  delete[] tempArray;
+  delete[] binValue;
+  delete[] binDest;
+  delete[] binStarts;
+  delete[] chunkStarts;
+}
+
+// pageRankPersonalized --
+//
+// g:           graph to process (see common/graph.h)
+// numVectors:  number of teleport vectors K iterated together
+// teleport:    K teleport distributions stored vertex-major, i.e. the
+//              probability of jumping to v in query k is
+//              teleport[v * numVectors + k].  Each should sum to 1.
+// solution:    per-vertex scores, same vertex-major layout as teleport
+// damping:     page-rank algorithm's damping parameter
+// convergence: page-rank algorithm's convergence threshold
+//
+// Runs K personalized PageRanks with one traversal of the graph per
+// iteration: each incoming edge updates the contiguous scores of the
+// queries still running, which the compiler turns into SIMD adds.
+// Random restarts and the mass of nodes without outgoing edges are
+// spread according to each query's teleport vector, so a uniform
+// teleport vector reproduces pageRank.  A query that converges is
+// written to solution and dropped from the working arrays, so later
+// iterations only gather the remaining queries, and every column
+// matches what an independent run would have produced.
+//
+void pageRankPersonalized(Graph g, int numVectors, const double* teleport,
+                          double* solution, double damping, double convergence)
+{
+  int numNodes = num_nodes(g);
+  const int K = numVectors;
+
+  // Dangling nodes get a zero weight so they drop out of the gather.
+  double* invDegree = new double[numNodes];
+  #pragma omp parallel for
+  for (Vertex v = 0; v < numNodes; ++v) {
+    int degree = outgoing_size(g, v);
+    invDegree[v] = degree == 0 ? 0.0 : 1.0 / static_cast<double>(degree);
+  }
+
+  // Scores and teleport vectors of the A running queries, vertex-major
+  // with stride A.  query[a] is the column of solution query a came from.
+  int A = K;
+  double* scores = new double[static_cast<long>(numNodes) * K];
+  double* next = new double[static_cast<long>(numNodes) * K];
+  double* jump = new double[static_cast<long>(numNodes) * K];
+  double* dangling = new double[K];
+  double* diff = new double[K];
+  int* query = new int[K];
+  int* keep = new int[K];
+  for (int k = 0; k < K; ++k) {
+    query[k] = k;
+  }
+
+  double equal_prob = 1.0 / numNodes;
+  #pragma omp parallel for
+  for (long i = 0; i < static_cast<long>(numNodes) * K; ++i) {
+    scores[i] = equal_prob;
+    jump[i] = teleport[i];
+  }
+
+  while (A > 0) {
+    for (int a = 0; a < A; ++a) {
+      dangling[a] = 0.0;
+      diff[a] = 0.0;
+    }
+
+    #pragma omp parallel for reduction(+: dangling[:A])
+    for (Vertex v = 0; v < numNodes; ++v) {
+      if (outgoing_size(g, v) == 0) {
+        const double* score = scores + static_cast<long>(v) * A;
+        for (int a = 0; a < A; ++a) {
+          dangling[a] += damping * score[a];
+        }
+      }
+    }
+
+    #pragma omp parallel for schedule(dynamic, 256) reduction(+: diff[:A])
+    for (Vertex v = 0; v < numNodes; ++v) {
+      double* acc = next + static_cast<long>(v) * A;
+      const double* restart = jump + static_cast<long>(v) * A;
+      const double* old = scores + static_cast<long>(v) * A;
+
+      for (int a = 0; a < A; ++a) {
+        acc[a] = 0.0;
+      }
+      for (const Vertex* iv = incoming_begin(g, v); iv != incoming_end(g, v); ++iv) {
+        const double* src = scores + static_cast<long>(*iv) * A;
+        double w = invDegree[*iv];
+        #pragma omp simd
+        for (int a = 0; a < A; ++a) {
+          acc[a] += src[a] * w;
+        }
+      }
+      for (int a = 0; a < A; ++a) {
+        acc[a] = acc[a] * damping + ((1.0 - damping) + dangling[a]) * restart[a];
+        diff[a] += fabs(acc[a] - old[a]);
+      }
+    }
+
+    std::swap(scores, next);
+
+    int numKept = 0;
+    for (int a = 0; a < A; ++a) {
+      if (diff[a] >= convergence) {
+        keep[numKept++] = a;
+      }
+    }
+    if (numKept == A) {
+      continue;
+    }
+
+    // Write out the queries that converged and repack the rest with the
+    // smaller stride, scores into next and teleport into a new array
+    #pragma omp parallel for
+    for (Vertex v = 0; v < numNodes; ++v) {
+      const double* score = scores + static_cast<long>(v) * A;
+      for (int a = 0, j = 0; a < A; ++a) {
+        if (j < numKept && keep[j] == a) {
+          j++;
+        } else {
+          solution[static_cast<long>(v) * K + query[a]] = score[a];
+        }
+      }
+      for (int j = 0; j < numKept; ++j) {
+        next[static_cast<long>(v) * numKept + j] = score[keep[j]];
+      }
+    }
+    double* packedJump = new double[static_cast<long>(numNodes) * std::max(numKept, 1)];
+    #pragma omp parallel for
+    for (Vertex v = 0; v < numNodes; ++v) {
+      for (int j = 0; j < numKept; ++j) {
+        packedJump[static_cast<long>(v) * numKept + j] = jump[static_cast<long>(v) * A + keep[j]];
+      }
+    }
+    delete[] jump;
+    jump = packedJump;
+
+    for (int j = 0; j < numKept; ++j) {
+      query[j] = query[keep[j]];
+    }
+    std::swap(scores, next);
+    A = numKept;
+  }
+
+  delete[] keep;
+  delete[] query;
+  delete[] diff;
+  delete[] dangling;
+  delete[] jump;
+  delete[] next;
+  delete[] scores;
+  delete[] invDegree;
+}
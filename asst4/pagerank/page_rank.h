@@ -4,5 +4,8 @@
 #include "common/graph.h"
 
 void pageRank(Graph g, double* solution, double damping, double convergence);
+void pageRankBlocked(Graph g, double* solution, double damping, double convergence);
+void pageRankPersonalized(Graph g, int numVectors, const double* teleport,
+                          double* solution, double damping, double convergence);
 
 #endif /* __PAGE_RANK_H__ */
@@ -0,0 +1,305 @@
+#include "generators.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <climits>
+#include <cmath>
+#include <algorithm>
+#include <omp.h>
+
+#include "../common/graph.h"
+
+// Graph500 Kronecker initiator probabilities (D = 1 - A - B - C)
+#define RMAT_A 0.57
+#define RMAT_B 0.19
+#define RMAT_C 0.19
+
+// splitmix64 finalizer: a good 64-bit mix, used as a counter-based RNG
+static inline uint64_t mix64(uint64_t x)
+{
+    x += 0x9E3779B97F7A4C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Uniform double in [0, 1) from the i-th draw of stream `stream`
+static inline double uniform(uint64_t stream, uint64_t i)
+{
+    return (mix64(stream + i) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void check_edge_count(long num_edges)
+{
+    if (num_edges > INT_MAX) {
+        fprintf(stderr, "Graph has %ld edges, the binary format holds at most %d.\n",
+                num_edges, INT_MAX);
+        exit(1);
+    }
+}
+
+static graph* alloc_graph(int num_nodes)
+{
+    graph* g = (graph*)malloc(sizeof(graph));
+    g->num_nodes = num_nodes;
+    g->num_edges = 0;
+    g->outgoing_starts = (int*)malloc(sizeof(int) * num_nodes);
+    g->outgoing_edges = NULL;
+    g->incoming_starts = NULL;
+    g->incoming_edges = NULL;
+    return g;
+}
+
+// Exclusive scan of degree into starts; returns the total.
+static long scan_degrees(int n, const int* degree, long* starts)
+{
+    long total = 0;
+    for (int v = 0; v < n; v++) {
+        starts[v] = total;
+        total += degree[v];
+    }
+    return total;
+}
+
+// Turn an edge list into a CSR graph: bucket edges by source with atomic
+// cursors, then sort and dedup every list (which also makes the result
+// independent of the order the buckets were filled in).
+static Graph graph_from_edges(int n, long m, const Vertex* src, const Vertex* dst)
+{
+    int* degree = (int*)calloc(n, sizeof(int));
+    long* starts = (long*)malloc(sizeof(long) * n);
+
+    #pragma omp parallel for
+    for (long e = 0; e < m; e++)
+        __sync_fetch_and_add(&degree[src[e]], 1);
+
+    scan_degrees(n, degree, starts);
+
+    Vertex* scratch = (Vertex*)malloc(sizeof(Vertex) * m);
+    long* cursor = (long*)malloc(sizeof(long) * n);
+    #pragma omp parallel for
+    for (int v = 0; v < n; v++)
+        cursor[v] = starts[v];
+
+    #pragma omp parallel for
+    for (long e = 0; e < m; e++)
+        scratch[__sync_fetch_and_add(&cursor[src[e]], 1)] = dst[e];
+    free(cursor);
+
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (int v = 0; v < n; v++) {
+        Vertex* list = scratch + starts[v];
+        std::sort(list, list + degree[v]);
+        Vertex* end = std::unique(list, list + degree[v]);
+        end = std::remove(list, end, v);
+        degree[v] = end - list;
+    }
+
+    graph* g = alloc_graph(n);
+    long* packed = (long*)malloc(sizeof(long) * n);
+    long total = scan_degrees(n, degree, packed);
+    check_edge_count(total);
+    g->num_edges = total;
+    g->outgoing_edges = (Vertex*)malloc(sizeof(Vertex) * total);
+
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (int v = 0; v < n; v++) {
+        g->outgoing_starts[v] = packed[v];
+        std::copy(scratch + starts[v], scratch + starts[v] + degree[v],
+                  g->outgoing_edges + packed[v]);
+    }
+
+    free(packed);
+    free(scratch);
+    free(starts);
+    free(degree);
+    return g;
+}
+
+// Bijective scramble of [0, 2^scale) so that high-degree vertices are
+// not clustered at low ids, as required by Graph500.
+static inline Vertex permute_vertex(uint64_t x, int scale, uint64_t seed)
+{
+    uint64_t mask = (1ull << scale) - 1;
+    uint64_t k1 = mix64(seed) | 1;
+    uint64_t k2 = mix64(seed + 1) | 1;
+    int shift = std::max(1, scale / 2);
+    x = (x * k1) & mask;
+    x ^= x >> shift;
+    x = (x * k2) & mask;
+    x ^= x >> shift;
+    return static_cast<Vertex>(x);
+}
+
+Graph generate_rmat(int scale, int edge_factor, uint64_t seed)
+{
+    if (scale < 1 || scale > 30) {
+        fprintf(stderr, "R-MAT scale must be between 1 and 30.\n");
+        exit(1);
+    }
+    if (edge_factor < 1) {
+        fprintf(stderr, "R-MAT edge factor must be at least 1.\n");
+        exit(1);
+    }
+
+    int n = 1 << scale;
+    long num_undirected = static_cast<long>(edge_factor) * n;
+    check_edge_count(2 * num_undirected);
+
+    Vertex* src = (Vertex*)malloc(sizeof(Vertex) * 2 * num_undirected);
+    Vertex* dst = (Vertex*)malloc(sizeof(Vertex) * 2 * num_undirected);
+
+    #pragma omp parallel for schedule(static)
+    for (long e = 0; e < num_undirected; e++) {
+        uint64_t stream = mix64(seed ^ mix64(e));
+        uint64_t u = 0, v = 0;
+        for (int level = 0; level < scale; level++) {
+            double r = uniform(stream, level);
+            u <<= 1;
+            v <<= 1;
+            if (r < RMAT_A) {
+            } else if (r < RMAT_A + RMAT_B) {
+                v |= 1;
+            } else if (r < RMAT_A + RMAT_B + RMAT_C) {
+                u |= 1;
+            } else {
+                u |= 1;
+                v |= 1;
+            }
+        }
+        Vertex pu = permute_vertex(u, scale, seed);
+        Vertex pv = permute_vertex(v, scale, seed);
+        src[2 * e] = pu;
+        dst[2 * e] = pv;
+        src[2 * e + 1] = pv;
+        dst[2 * e + 1] = pu;
+    }
+
+    Graph g = graph_from_edges(n, 2 * num_undirected, src, dst);
+    free(src);
+    free(dst);
+    return g;
+}
+
+// Every vertex owns a random stream and walks its row of the adjacency
+// matrix with geometric skips (Batagelj and Brandes), so a row costs time
+// proportional to its degree.  The rows are walked twice, once to size
+// the CSR and once to fill it, drawing the same numbers both times.
+Graph generate_erdos_renyi(int num_nodes, double avg_degree, uint64_t seed)
+{
+    if (num_nodes < 1) {
+        fprintf(stderr, "Erdos-Renyi graph needs at least 1 vertex.\n");
+        exit(1);
+    }
+    if (!std::isfinite(avg_degree) || avg_degree < 0.0) {
+        fprintf(stderr, "Erdos-Renyi average degree must be a finite, non-negative number.\n");
+        exit(1);
+    }
+
+    int n = num_nodes;
+    double p = std::min(1.0, avg_degree / n);
+    double log_q = std::log(1.0 - p);
+
+    graph* g = alloc_graph(n);
+    if (p <= 0.0) {
+        for (int v = 0; v < n; v++)
+            g->outgoing_starts[v] = 0;
+        g->outgoing_edges = (Vertex*)malloc(sizeof(Vertex));
+        return g;
+    }
+
+    // Writes the targets of row u to out (if not NULL) in increasing
+    // order and returns how many there are
+    auto walk_row = [&](Vertex u, Vertex* out) {
+        uint64_t stream = mix64(seed ^ mix64(static_cast<uint64_t>(u)));
+        int count = 0;
+        long v = -1;
+        for (uint64_t i = 0;; i++) {
+            if (p < 1.0)
+                v += 1 + static_cast<long>(std::floor(std::log(1.0 - uniform(stream, i)) / log_q));
+            else
+                v += 1;
+            if (v >= n)
+                break;
+            if (v == u)
+                continue;
+            if (out)
+                out[count] = static_cast<Vertex>(v);
+            count++;
+        }
+        return count;
+    };
+
+    int* degree = (int*)malloc(sizeof(int) * n);
+    long* starts = (long*)malloc(sizeof(long) * n);
+
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (Vertex u = 0; u < n; u++)
+        degree[u] = walk_row(u, NULL);
+
+    long total = scan_degrees(n, degree, starts);
+    check_edge_count(total);
+    g->num_edges = total;
+    g->outgoing_edges = (Vertex*)malloc(sizeof(Vertex) * total);
+
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (Vertex u = 0; u < n; u++) {
+        g->outgoing_starts[u] = starts[u];
+        walk_row(u, g->outgoing_edges + starts[u]);
+    }
+
+    free(starts);
+    free(degree);
+    return g;
+}
+
+Graph generate_grid(int width, int height, int depth)
+{
+    long n = static_cast<long>(width) * height * depth;
+    if (width < 1 || height < 1 || depth < 1 || n > INT_MAX) {
+        fprintf(stderr, "Invalid grid dimensions.\n");
+        exit(1);
+    }
+
+    long plane = static_cast<long>(width) * height;
+    graph* g = alloc_graph(n);
+
+    // Neighbors in increasing id order: -z, -y, -x, +x, +y, +z
+    auto neighbors = [&](long v, Vertex* out) {
+        long x = v % width;
+        long y = (v / width) % height;
+        long z = v / plane;
+        int count = 0;
+        if (z > 0)          out[count++] = v - plane;
+        if (y > 0)          out[count++] = v - width;
+        if (x > 0)          out[count++] = v - 1;
+        if (x < width - 1)  out[count++] = v + 1;
+        if (y < height - 1) out[count++] = v + width;
+        if (z < depth - 1)  out[count++] = v + plane;
+        return count;
+    };
+
+    int* degree = (int*)malloc(sizeof(int) * n);
+    long* starts = (long*)malloc(sizeof(long) * n);
+
+    #pragma omp parallel for
+    for (long v = 0; v < n; v++) {
+        Vertex scratch[6];
+        degree[v] = neighbors(v, scratch);
+    }
+
+    long total = scan_degrees(n, degree, starts);
+    check_edge_count(total);
+    g->num_edges = total;
+    g->outgoing_edges = (Vertex*)malloc(sizeof(Vertex) * total);
+
+    #pragma omp parallel for
+    for (long v = 0; v < n; v++) {
+        g->outgoing_starts[v] = starts[v];
+        neighbors(v, g->outgoing_edges + starts[v]);
+    }
+
+    free(starts);
+    free(degree);
+    return g;
+}
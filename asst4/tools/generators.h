@@ -0,0 +1,28 @@
+#ifndef __GENERATORS_H__
+#define __GENERATORS_H__
+
+#include <stdint.h>
+
+#include "../common/graph.h"
+
+// Synthetic graph generators.  Every generator builds the outgoing CSR
+// directly (the incoming CSR is left NULL, store_graph_binary does not
+// need it) and is deterministic for a given seed regardless of the
+// number of OpenMP threads: random numbers come from a counter-based
+// hash of (seed, edge or vertex id) instead of a shared stream.
+// Adjacency lists are sorted, without duplicate edges or self loops.
+
+// Graph500 Kronecker/R-MAT graph: 2^scale vertices, edge_factor * 2^scale
+// undirected edges (stored in both directions) drawn with A=0.57,
+// B=0.19, C=0.19, vertex ids randomly permuted.
+Graph generate_rmat(int scale, int edge_factor, uint64_t seed);
+
+// Erdos-Renyi G(n, p) directed graph with p = avg_degree / n.
+Graph generate_erdos_renyi(int num_nodes, double avg_degree, uint64_t seed);
+
+// 2D (depth == 1) or 3D grid with edges to the 4 or 6 axis neighbors,
+// stored in both directions.  Vertex (x, y, z) has id
+// x + width * (y + height * z).
+Graph generate_grid(int width, int height, int depth);
+
+#endif /* __GENERATORS_H__ */
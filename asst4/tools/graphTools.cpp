@@ -1,13 +1,19 @@
 
 #include <algorithm>
 #include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <iomanip>
 #include <iostream>
 #include <string>
 #include <vector>
+#include <omp.h>
 
 
 #include "../common/graph.h"
+#include "../common/CycleTimer.h"
+#include "generators.h"
 
 #define CMD_TEXT2BIN    "text2bin"
 #define CMD_INFO        "info"
@@ -15,6 +21,12 @@
 #define CMD_NOOUTEDGES  "noout"
 #define CMD_NOINEDGES   "noin"
 #define CMD_EDGESTATS   "edgestats"
+#define CMD_GENERATE    "generate"
+
+#define GEN_RMAT        "rmat"
+#define GEN_ERDOS_RENYI "er"
+#define GEN_GRID2D      "grid2d"
+#define GEN_GRID3D      "grid3d"
 
 
 void print_help(const char* binary_name) {
@@ -27,7 +39,271 @@ void print_help(const char* binary_name) {
               << CMD_PRINT << ": print graph topology (careful with big graphs)\n"
               << CMD_NOOUTEDGES << ": detect vertices with no outgoing edges\n"
               << CMD_NOINEDGES << ": detect vertices with no incoming edges\n"
-              << CMD_EDGESTATS << ": print stats on graph edges: e.g., min/max edges per node, etc.\n";
+              << CMD_EDGESTATS << ": print stats on graph edges: degree histograms, skew, partition load\n"
+              << CMD_GENERATE << ": generate a synthetic graph in binary format\n";
+}
+
+void print_generate_help(const char* binary_name) {
+    std::cerr << "Usage: " << binary_name << " " << CMD_GENERATE << " type args binfilename\n";
+    std::cerr << "Generates a synthetic graph (deterministic for a given seed) and stores it in binary format.\n\n"
+              << "Valid types are:\n\n"
+              << GEN_RMAT << " scale edgefactor seed: Graph500 Kronecker graph, 2^scale vertices, undirected\n"
+              << GEN_ERDOS_RENYI << " nodes avgdegree seed: Erdos-Renyi directed graph\n"
+              << GEN_GRID2D << " width height: 2D grid, undirected\n"
+              << GEN_GRID3D << " width height depth: 3D grid, undirected\n";
+}
+
+// Arguments of the commands that scan a mapped graph: a filename,
+// optionally followed by -p <partitions> (only where with_partitions
+// is set) and --json.
+struct scan_options {
+    std::string filename;
+    int partitions;
+    bool json;
+};
+
+bool parse_scan_args(int argc, char** argv, bool with_partitions, scan_options* opts) {
+    if (argc < 3)
+        return false;
+    opts->filename = argv[2];
+    opts->partitions = omp_get_max_threads();
+    opts->json = false;
+    for (int i=3; i<argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--json") {
+            opts->json = true;
+        } else if (arg == "-p" && with_partitions && i + 1 < argc) {
+            opts->partitions = atoi(argv[++i]);
+            if (opts->partitions < 1)
+                return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A mapped file is not validated by the loader, so make sure the
+// offsets and targets are in range before anything indexes with them.
+void check_graph(Graph g) {
+    bool valid = true;
+    #pragma omp parallel for reduction(&&: valid)
+    for (int i=0; i<num_nodes(g); i++) {
+        int start = g->outgoing_starts[i];
+        int end = (i == num_nodes(g)-1) ? num_edges(g) : g->outgoing_starts[i+1];
+        if (start < 0 || start > end || end > num_edges(g)) {
+            valid = false;
+            continue;
+        }
+        for (int j=start; j<end; j++) {
+            if (g->outgoing_edges[j] < 0 || g->outgoing_edges[j] >= num_nodes(g))
+                valid = false;
+        }
+    }
+    if (!valid) {
+        std::cerr << "GRAPH DID NOT PASS SANITY CHECK: edge offsets or targets out of range\n";
+        exit(1);
+    }
+}
+
+int* out_degrees(Graph g) {
+    int* degree = (int*)malloc(sizeof(int) * num_nodes(g));
+    #pragma omp parallel for
+    for (int i=0; i<num_nodes(g); i++)
+        degree[i] = outgoing_size(g, i);
+    return degree;
+}
+
+// In-degrees from one pass over the edge array, without building the
+// incoming CSR.
+int* in_degrees(Graph g) {
+    int* degree = (int*)calloc(num_nodes(g), sizeof(int));
+    #pragma omp parallel for
+    for (int j=0; j<num_edges(g); j++)
+        __sync_fetch_and_add(&degree[g->outgoing_edges[j]], 1);
+    return degree;
+}
+
+// Symmetric iff every edge i->target has a matching target->i.  Sorted
+// adjacency lists (e.g. from graphTools generate) are binary searched.
+bool check_symmetric(Graph g) {
+    bool sorted = true;
+    #pragma omp parallel for reduction(&&: sorted)
+    for (int i=0; i<num_nodes(g); i++) {
+        sorted = sorted && std::is_sorted(outgoing_begin(g, i), outgoing_end(g, i));
+    }
+
+    bool is_symmetric = true;
+    #pragma omp parallel for schedule(dynamic, 1024) reduction(&&: is_symmetric)
+    for (int i=0; i<num_nodes(g); i++) {
+        for (const Vertex* v=outgoing_begin(g, i); v!=outgoing_end(g, i) && is_symmetric; v++) {
+            const Vertex* begin = outgoing_begin(g, *v);
+            const Vertex* end = outgoing_end(g, *v);
+            bool found = sorted ? std::binary_search(begin, end, i)
+                                : std::find(begin, end, i) != end;
+            if (!found)
+                is_symmetric = false;
+        }
+    }
+    return is_symmetric;
+}
+
+struct degree_stats {
+    long total;
+    int min;
+    int max;
+    double avg;
+    double stddev;
+    // Gini coefficient of the degrees: 0 when all are equal, close to 1
+    // when a few vertices own all edges
+    double gini;
+    // Fraction of all edges owned by the 1% highest-degree vertices
+    double top1_share;
+    // log2_hist[0] counts degree 0, log2_hist[b] degrees in [2^(b-1), 2^b)
+    std::vector<long> log2_hist;
+};
+
+degree_stats compute_degree_stats(const int* degree, int n) {
+    degree_stats stats;
+    long total = 0;
+    double sum_sq = 0;
+    int min_degree = INT_MAX;
+    int max_degree = 0;
+    #pragma omp parallel for reduction(+: total, sum_sq) reduction(min: min_degree) reduction(max: max_degree)
+    for (int i=0; i<n; i++) {
+        total += degree[i];
+        sum_sq += static_cast<double>(degree[i]) * degree[i];
+        min_degree = std::min(min_degree, degree[i]);
+        max_degree = std::max(max_degree, degree[i]);
+    }
+
+    // Exact distribution, so ranks can be derived without sorting
+    std::vector<long> count(max_degree + 1, 0);
+    long* count_data = count.data();
+    #pragma omp parallel for
+    for (int i=0; i<n; i++)
+        __sync_fetch_and_add(&count_data[degree[i]], 1);
+
+    stats.total = total;
+    stats.min = min_degree;
+    stats.max = max_degree;
+    stats.avg = static_cast<double>(total) / n;
+    stats.stddev = std::sqrt(std::max(0.0, sum_sq / n - stats.avg * stats.avg));
+
+    double weighted_rank = 0;
+    long rank = 0;
+    for (int d=0; d<=max_degree; d++) {
+        long c = count[d];
+        weighted_rank += static_cast<double>(d) * (c * static_cast<double>(rank) + c * (c + 1) / 2.0);
+        rank += c;
+
+        int bucket = 0;
+        while (bucket < 31 && (1 << bucket) <= d)
+            bucket++;
+        if (static_cast<int>(stats.log2_hist.size()) <= bucket)
+            stats.log2_hist.resize(bucket + 1, 0);
+        stats.log2_hist[bucket] += c;
+    }
+    stats.gini = total ? 2.0 * weighted_rank / (static_cast<double>(n) * total) - (n + 1.0) / n : 0.0;
+
+    long top = std::max(1, n / 100);
+    long top_edges = 0;
+    for (int d=max_degree; d>=0 && top>0; d--) {
+        long take = std::min(top, count[d]);
+        top_edges += take * d;
+        top -= take;
+    }
+    stats.top1_share = total ? static_cast<double>(top_edges) / total : 0.0;
+    return stats;
+}
+
+// Edges owned by each of `partitions` equal contiguous vertex ranges,
+// i.e. the per-thread work of a static schedule over the vertices.
+struct partition_stats {
+    int partitions;
+    long min_edges;
+    long max_edges;
+    double imbalance;
+};
+
+partition_stats compute_partition_stats(const int* degree, int n, int partitions) {
+    std::vector<long> edges(partitions, 0);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int p=0; p<partitions; p++) {
+        long first = static_cast<long>(n) * p / partitions;
+        long last = static_cast<long>(n) * (p + 1) / partitions;
+        for (long i=first; i<last; i++)
+            edges[p] += degree[i];
+    }
+
+    partition_stats stats;
+    stats.partitions = partitions;
+    stats.min_edges = *std::min_element(edges.begin(), edges.end());
+    stats.max_edges = *std::max_element(edges.begin(), edges.end());
+    long total = 0;
+    for (int p=0; p<partitions; p++)
+        total += edges[p];
+    stats.imbalance = total ? stats.max_edges / (static_cast<double>(total) / partitions) : 1.0;
+    return stats;
+}
+
+void print_degree_stats(const char* name, const degree_stats& stats, const partition_stats& load) {
+    std::cout << name << " edges: total=" << stats.total
+              << " avg=" << stats.avg
+              << " min=" << stats.min
+              << " max=" << stats.max << "\n";
+    std::cout << "  skew: stddev=" << stats.stddev
+              << " max/avg=" << (stats.avg > 0 ? stats.max / stats.avg : 0)
+              << " gini=" << stats.gini
+              << " top 1% share=" << 100.0 * stats.top1_share << "%\n";
+    std::cout << "  " << load.partitions << " partitions: min=" << load.min_edges
+              << " max=" << load.max_edges
+              << " max/avg=" << load.imbalance << "\n";
+    std::cout << "  degree histogram:\n";
+    for (size_t b=0; b<stats.log2_hist.size(); b++) {
+        if (b == 0)
+            std::cout << "    " << std::setw(21) << "0";
+        else
+            std::cout << "    " << std::setw(10) << (1L << (b - 1)) << " - " << std::setw(8) << ((1L << b) - 1);
+        std::cout << ": " << stats.log2_hist[b] << "\n";
+    }
+}
+
+// s as the contents of a JSON string: quotes, backslashes and control
+// characters escaped.
+std::string json_escape(const std::string& s) {
+    std::string escaped;
+    for (size_t i=0; i<s.size(); i++) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+void print_degree_stats_json(const degree_stats& stats, const partition_stats& load) {
+    std::cout << "{\"total\": " << stats.total
+              << ", \"avg\": " << stats.avg
+              << ", \"min\": " << stats.min
+              << ", \"max\": " << stats.max
+              << ", \"stddev\": " << stats.stddev
+              << ", \"gini\": " << stats.gini
+              << ", \"top1_share\": " << stats.top1_share
+              << ", \"log2_hist\": [";
+    for (size_t b=0; b<stats.log2_hist.size(); b++)
+        std::cout << (b ? ", " : "") << stats.log2_hist[b];
+    std::cout << "], \"partitions\": {\"count\": " << load.partitions
+              << ", \"min_edges\": " << load.min_edges
+              << ", \"max_edges\": " << load.max_edges
+              << ", \"imbalance\": " << load.imbalance << "}}";
 }
 
 int main(int argc, char** argv) {
@@ -92,177 +368,145 @@ int main(int argc, char** argv) {
         print_graph(g);
         delete g;
 
-    } else if (!cmd.compare(CMD_NOOUTEDGES)) {
+    } else if (!cmd.compare(CMD_NOOUTEDGES) || !cmd.compare(CMD_NOINEDGES)) {
 
-        if (argc < 3) {
-            std::cerr << "Usage: " << argv[0] << " " << cmd << " filename\n";
-            std::cerr << "Lists all vertices without outgoing edges.\n";
+        bool outgoing = !cmd.compare(CMD_NOOUTEDGES);
+        scan_options opts;
+        if (!parse_scan_args(argc, argv, false, &opts)) {
+            std::cerr << "Usage: " << argv[0] << " " << cmd << " filename [--json]\n";
+            std::cerr << (outgoing ? "Lists all vertices without outgoing edges.\n"
+                                   : "Lists all vertices without incoming edges.\n");
             exit(1);
         }
 
-        std::string inputFilename = std::string(argv[2]);
-
-        Graph g;
-        std::cout << "Loading graph: " << inputFilename << "\n";
-        g = load_graph_binary(inputFilename.c_str());
-        std::cout << "Done loading.\n";
-
-        std::vector<Vertex> zero_outgoing;
+        Graph g = map_graph_binary(opts.filename.c_str());
+        check_graph(g);
+        int* degree = outgoing ? out_degrees(g) : in_degrees(g);
 
+        // Static schedule, so concatenating the per-thread lists in
+        // thread order keeps the vertices sorted.
+        int maxThreadNum = omp_get_max_threads();
+        std::vector<std::vector<Vertex>> localList(maxThreadNum);
+        #pragma omp parallel for schedule(static)
         for (int i=0; i<num_nodes(g); i++) {
-            if (outgoing_size(g, i) == 0) {
-                zero_outgoing.push_back(i);
+            if (degree[i] == 0)
+                localList[omp_get_thread_num()].push_back(i);
+        }
+        std::vector<Vertex> zero;
+        for (int t=0; t<maxThreadNum; t++)
+            zero.insert(zero.end(), localList[t].begin(), localList[t].end());
+
+        const char* direction = outgoing ? "outgoing" : "incoming";
+        if (opts.json) {
+            std::cout << "{\"graph\": \"" << json_escape(opts.filename) << "\", "
+                      << "\"direction\": \"" << direction << "\", "
+                      << "\"num_nodes\": " << num_nodes(g) << ", "
+                      << "\"count\": " << zero.size() << ", \"vertices\": [";
+            for (size_t i=0; i<zero.size(); i++)
+                std::cout << (i ? ", " : "") << zero[i];
+            std::cout << "]}\n";
+        } else {
+            std::cout << "Nodes with no " << direction << " edges:\n";
+            for (size_t i=0; i<zero.size(); i++) {
+                std::cout << zero[i] << " ";
             }
+            std::cout << "\n";
+            std::cout << zero.size() << " of " << num_nodes(g) << " nodes have zero " << direction << " edges ("
+                      << std::setprecision(2)
+                      << 100.0 * static_cast<double>(zero.size())/num_nodes(g) << "\%).\n";
         }
 
-        std::cout << "Nodes with no outgoing edges:\n";
-        for (size_t i=0; i<zero_outgoing.size(); i++) {
-            std::cout << zero_outgoing[i] << " ";
-        }
-        std::cout << "\n";
-        std::cout << zero_outgoing.size() << " of " << num_nodes(g) << " nodes have zero outgoing edges ("
-                  << std::setprecision(2)
-                  << 100.0 * static_cast<double>(zero_outgoing.size())/num_nodes(g) << "\%).\n";
-        delete g;
+        free(degree);
+        unmap_graph_binary(g);
 
-    } else if (!cmd.compare(CMD_NOINEDGES)) {
+    } else if (!cmd.compare(CMD_EDGESTATS)) {
 
-        if (argc < 3) {
-            std::cerr << "Usage: " << argv[0] << " " << cmd << " filename\n";
-            std::cerr << "Lists all edges without incoming edges.\n";
+        scan_options opts;
+        if (!parse_scan_args(argc, argv, true, &opts)) {
+            std::cerr << "Usage: " << argv[0] << " " << cmd << " filename [-p partitions] [--json]\n";
+            std::cerr << "Print stats about edges: degree distribution, skew and the edge load\n"
+                      << "of splitting the vertices into equal contiguous partitions\n"
+                      << "(default: one per thread).\n";
             exit(1);
         }
 
-        std::string inputFilename = std::string(argv[2]);
+        Graph g = map_graph_binary(opts.filename.c_str());
+        check_graph(g);
+
+        int* out_degree = out_degrees(g);
+        int* in_degree = in_degrees(g);
+        degree_stats out_stats = compute_degree_stats(out_degree, num_nodes(g));
+        degree_stats in_stats = compute_degree_stats(in_degree, num_nodes(g));
+        partition_stats out_load = compute_partition_stats(out_degree, num_nodes(g), opts.partitions);
+        partition_stats in_load = compute_partition_stats(in_degree, num_nodes(g), opts.partitions);
+        bool is_symmetric = check_symmetric(g);
+
+        if (opts.json) {
+            std::cout << "{\"graph\": \"" << json_escape(opts.filename) << "\", "
+                      << "\"num_nodes\": " << num_nodes(g) << ", "
+                      << "\"num_edges\": " << num_edges(g) << ", "
+                      << "\"symmetric\": " << (is_symmetric ? "true" : "false") << ",\n";
+            std::cout << " \"outgoing\": ";
+            print_degree_stats_json(out_stats, out_load);
+            std::cout << ",\n \"incoming\": ";
+            print_degree_stats_json(in_stats, in_load);
+            std::cout << "}\n";
+        } else {
+            std::cout << "=========================================================\n";
+            std::cout << "Edge statistics for this graph:\n";
+            std::cout << "=========================================================\n";
+            std::cout << "The graph " << ((is_symmetric) ? "IS " : "IS NOT ") << "symmetric.\n";
+            print_degree_stats("Outgoing", out_stats, out_load);
+            print_degree_stats("Incoming", in_stats, in_load);
+        }
 
-        Graph g;
-        std::cout << "Loading graph: " << inputFilename << "\n";
-        g = load_graph_binary(inputFilename.c_str());
-        std::cout << "Done loading.\n";
+        free(out_degree);
+        free(in_degree);
+        unmap_graph_binary(g);
+    }
 
-        std::vector<Vertex> zero_incoming;
+    else if (!cmd.compare(CMD_GENERATE)) {
 
-        for (int i=0; i<num_nodes(g); i++) {
-            if (incoming_size(g, i) == 0) {
-                zero_incoming.push_back(i);
-            }
+        if (argc < 3) {
+            print_generate_help(argv[0]);
+            exit(1);
         }
 
-        std::cout << "Nodes with no incoming edges:\n";
-        for (size_t i=0; i<zero_incoming.size(); i++) {
-            std::cout << zero_incoming[i] << " ";
+        std::string type = std::string(argv[2]);
+        int num_args;
+        if (!type.compare(GEN_RMAT) || !type.compare(GEN_ERDOS_RENYI) || !type.compare(GEN_GRID3D)) {
+            num_args = 3;
+        } else if (!type.compare(GEN_GRID2D)) {
+            num_args = 2;
+        } else {
+            print_generate_help(argv[0]);
+            exit(1);
         }
-        std::cout << "\n";
-        std::cout << zero_incoming.size() << " of " << num_nodes(g) << " nodes have zero incoming edges ("
-                  << std::setprecision(2)
-                  << 100.0 * static_cast<double>(zero_incoming.size())/num_nodes(g) << "\%).\n";
-        delete g;
-
-    } else if (!cmd.compare(CMD_EDGESTATS)) {
-
-        if (argc < 3) {
-            std::cerr << "Usage: " << argv[0] << " " << cmd << " filename\n";
-            std::cerr << "Print basic stats about edges.\n";
+        if (argc < 4 + num_args) {
+            print_generate_help(argv[0]);
             exit(1);
         }
 
-        std::string inputFilename = std::string(argv[2]);
+        std::string outputFilename = std::string(argv[3 + num_args]);
 
         Graph g;
-        std::cout << "Loading graph: " << inputFilename << "\n";
-        g = load_graph_binary(inputFilename.c_str());
-        std::cout << "Done loading. Now analyzing graph...\n";
-
-        unsigned int total_incoming = 0;
-        unsigned int total_outgoing = 0;
-        unsigned int min_outgoing = INT_MAX;
-        unsigned int max_outgoing = 0;
-        unsigned int min_incoming = INT_MAX;
-        unsigned int max_incoming = 0;
-        bool is_symmetric = true;
-
-        for (int i=0; i<num_nodes(g); i++) {
-
-            unsigned int num_incoming = incoming_size(g, i);
-            unsigned int num_outgoing = outgoing_size(g, i);
-
-            min_outgoing = std::min(min_outgoing, num_outgoing);
-            max_outgoing = std::max(max_outgoing, num_outgoing);
-            total_outgoing += num_outgoing;
-
-            min_incoming = std::min(min_incoming, num_incoming);
-            max_incoming = std::max(max_incoming, num_incoming);
-            total_incoming += num_incoming;
-
-            // check graph for sanity, and test for symmetric directed
-            // edges
-            const Vertex* out_begin = outgoing_begin(g, i);
-            const Vertex* out_end = outgoing_end(g, i);
-            for (const Vertex* v=out_begin; v!=out_end; v++) {
-
-                Vertex target = *v;
-
-                // sanity check. vertex i has an outoing edge to target
-                // (i->target), therefore target better have an
-                // incoming edge from i.
-                bool found_matching = false;
-                const Vertex* sanity_begin = incoming_begin(g, target);
-                const Vertex* sanity_end = incoming_end(g, target);
-                for (const Vertex* v2=sanity_begin; v2!=sanity_end; v2++) {
-                    Vertex i2 = *v2;
-                    if (i == i2) {
-                        found_matching = true;
-                        break;
-                    }
-                }
-                if (!found_matching) {
-                    std::cerr << "GRAPH DID NOT PASS SANITY CHECK:\n"
-                              << "vertex " << i << " has outgoing edge to " << target << ",\n but "
-                              << "vertex " << target << " has no incoming edge from " << i << "\n";
-
-                    // abort on a failed sanity check
-                    exit(1);
-                 }
-
-                // symmetry test: vertex i has an outgoing edge to
-                // target (i->target), so check to see if there's an
-                // incoming edge from target as well (target->i).
-                bool found_symmetric = false;
-                const Vertex* in_start = incoming_begin(g, i);
-                const Vertex* in_end =   incoming_end(g, i);
-
-                for (const Vertex* v2=in_start; v2!=in_end; v2++) {
-
-                    Vertex target2 = *v2;
-
-                    if (target == target2) {
-                        found_symmetric = true;
-                        break;
-                    }
-                }
-                if (!found_symmetric)
-                    is_symmetric = false;
-
-            }
-
+        std::cout << "Generating graph...\n";
+        double start = CycleTimer::currentSeconds();
+        if (!type.compare(GEN_RMAT)) {
+            g = generate_rmat(atoi(argv[3]), atoi(argv[4]), strtoull(argv[5], NULL, 10));
+        } else if (!type.compare(GEN_ERDOS_RENYI)) {
+            g = generate_erdos_renyi(atoi(argv[3]), atof(argv[4]), strtoull(argv[5], NULL, 10));
+        } else if (!type.compare(GEN_GRID2D)) {
+            g = generate_grid(atoi(argv[3]), atoi(argv[4]), 1);
+        } else {
+            g = generate_grid(atoi(argv[3]), atoi(argv[4]), atoi(argv[5]));
         }
+        std::cout << "Done generating in " << CycleTimer::currentSeconds() - start << " sec.\n";
+        std::cout << "Num vertices: " << num_nodes(g) << "\n";
+        std::cout << "Num edges:    " << num_edges(g) << "\n";
 
-        float avg_outgoing = (float)total_outgoing / num_nodes(g);
-        float avg_incoming = (float)total_incoming / num_nodes(g);
-
-        std::cout << "=========================================================\n";
-        std::cout << "Edge statistics for this graph:\n";
-        std::cout << "=========================================================\n";
-        std::cout << "The graph " << ((is_symmetric) ? "IS " : "IS NOT ") << "symmetric.\n";
-        std::cout << "Outgoing edges: total=" << total_outgoing
-                  << " avg=" << avg_outgoing
-                  << " min=" << min_outgoing
-                  << " max=" << max_outgoing << "\n";
-
-        std::cout << "Incoming edges: total=" << total_incoming
-                  << " avg=" << avg_incoming
-                  << " min=" << min_incoming
-                  << " max=" << max_incoming << "\n";
+        store_graph_binary(outputFilename.c_str(), g);
+        free_graph(g);
     }
 
     else {
@@ -6,6 +6,301 @@
 // Matrix A is M x K
 // Matrix B is K x N
 //
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "CycleTimer.h"
+#include "gemm.h"
+
+/**
+ * @brief Cache sizes of the machine and the blocking parameters derived
+ * from them, shared by every blocked variant below.
+ *
+ * @details The sizes are read from sysfs on the first call of
+ * `blocking()` (falling back to `sysconf`, then to typical values), and
+ * the blocks follow the analytical model of Low et al., "Analytical
+ * Modeling Is Enough for High-Performance BLIS":
+ * - a `kc x NR` micro-panel of B takes half of L1, the other half holds
+ *   the `MR x kc` micro-panel of A streaming through,
+ * - the `mc x kc` block of A takes half of L2,
+ * - the `kc x nc` panel of B takes half of L3.
+ * `gemmAutotune` may then replace them with measured values.
+ *
+ */
+class GemmConfig {
+public:
+  /**
+   * @brief Disable constructing this class
+   *
+   */
+  GemmConfig() = delete;
+
+  /**
+   * @brief Register block of the micro-kernel, fixed at compile time
+   *
+   */
+  static const int MR = 6;
+  static const int NR = 8;
+
+  struct Blocking {
+    int mc, kc, nc;     /**< Cache blocks of the packed GEMM */
+    int block;          /**< Square block of the simple blocked variants */
+    const char *source; /**< "analytic", "tuned" or "cached" */
+  };
+
+  static long cacheSize[4]; /**< Data cache size in bytes, by level */
+
+  static const Blocking &blocking() {
+    if (!initialized) {
+      detectCaches();
+      current = analytic();
+      initialized = true;
+    }
+    return current;
+  }
+
+  /**
+   * @brief The blocking for elements of type `T`. The blocks keep their
+   * footprint in bytes, so narrower elements get proportionally larger
+   * `mc` and `nc`; `kc` stays, a float micro-panel of B (16 wide) takes
+   * as many bytes as a double one (8 wide).
+   *
+   */
+  template <typename T> static Blocking blockingFor() {
+    Blocking b = blocking();
+    int scale = sizeof(double) / sizeof(T);
+    b.mc *= scale;
+    b.nc *= scale;
+    return b;
+  }
+
+  /**
+   * @brief Use the given blocks, rounded to what the kernels require
+   *
+   */
+  static void setBlocking(int mc, int kc, int nc, const char *source) {
+    blocking();
+    current.kc = roundDown(clamp(kc, 16, 2048), 8);
+    current.mc = roundDown(clamp(mc, MR, 4096), MR);
+    current.nc = roundDown(clamp(nc, NR, 16384), NR);
+    current.source = source;
+  }
+
+  /**
+   * @brief Blocks following the analytical model from the cache sizes
+   *
+   */
+  static Blocking analytic() {
+    Blocking b;
+    int kc = cacheSize[1] / 2 / (NR * sizeof(double));
+    b.kc = roundDown(clamp(kc, 16, 2048), 8);
+    int mc = cacheSize[2] / 2 / (b.kc * sizeof(double));
+    b.mc = roundDown(clamp(mc, MR, 4096), MR);
+    long nc = cacheSize[3] / 2 / (b.kc * sizeof(double));
+    b.nc = roundDown(clamp(nc < 16384 ? nc : 16384, NR, 16384), NR);
+
+    // Three `block x block` blocks (A, B and C) fit in L1
+    int block = 8;
+    while (3 * (block + 8) * (block + 8) * sizeof(double) <=
+           static_cast<unsigned long>(cacheSize[1])) {
+      block += 8;
+    }
+    b.block = block;
+    b.source = "analytic";
+    return b;
+  }
+
+private:
+  static Blocking current;
+  static bool initialized;
+
+  static int clamp(long value, int lo, int hi) {
+    return value < lo ? lo : value > hi ? hi : static_cast<int>(value);
+  }
+
+  static int roundDown(int value, int multiple) {
+    return value / multiple * multiple;
+  }
+
+  /**
+   * @brief Parse a sysfs cache size such as "48K" or "2048K"
+   *
+   */
+  static long parseSize(const char *text) {
+    char *end;
+    long size = strtol(text, &end, 10);
+    if (*end == 'K') {
+      size <<= 10;
+    } else if (*end == 'M') {
+      size <<= 20;
+    } else if (*end == 'G') {
+      size <<= 30;
+    }
+    return size;
+  }
+
+  static bool readLine(const char *path, char *line, int length) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+      return false;
+    }
+    bool ok = fgets(line, length, file) != NULL;
+    fclose(file);
+    return ok;
+  }
+
+  static void detectCaches() {
+    for (int level = 0; level < 4; level++) {
+      cacheSize[level] = 0;
+    }
+
+    // cpu0 is representative: every core of a socket has the same caches
+    for (int index = 0; index < 16; index++) {
+      char path[128], line[64];
+      snprintf(path, sizeof(path),
+               "/sys/devices/system/cpu/cpu0/cache/index%d/level", index);
+      if (!readLine(path, line, sizeof(line))) {
+        break;
+      }
+      int level = atoi(line);
+      snprintf(path, sizeof(path),
+               "/sys/devices/system/cpu/cpu0/cache/index%d/type", index);
+      if (level < 1 || level > 3 || !readLine(path, line, sizeof(line)) ||
+          line[0] == 'I') {
+        continue;
+      }
+      snprintf(path, sizeof(path),
+               "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+      if (readLine(path, line, sizeof(line))) {
+        cacheSize[level] = parseSize(line);
+      }
+    }
+
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    const int names[4] = {0, _SC_LEVEL1_DCACHE_SIZE, _SC_LEVEL2_CACHE_SIZE,
+                          _SC_LEVEL3_CACHE_SIZE};
+    for (int level = 1; level < 4; level++) {
+      if (cacheSize[level] <= 0) {
+        cacheSize[level] = sysconf(names[level]);
+      }
+    }
+#endif
+
+    const long defaults[4] = {0, 32L << 10, 256L << 10, 8L << 20};
+    for (int level = 1; level < 4; level++) {
+      if (cacheSize[level] <= 0) {
+        cacheSize[level] = defaults[level];
+      }
+    }
+    // Without an L3 the B panel has to live in L2 next to the A block
+    if (cacheSize[3] < cacheSize[2]) {
+      cacheSize[3] = cacheSize[2];
+    }
+  }
+};
+
+long GemmConfig::cacheSize[4];
+GemmConfig::Blocking GemmConfig::current;
+bool GemmConfig::initialized = false;
+
+/**
+ * @brief Buffers for matrices and packing workspaces.
+ *
+ * @details Every buffer is 64-byte aligned, so packed panels start on a
+ * cache line. Buffers of 2MB and more are 2MB aligned and advised as
+ * transparent huge pages, so a packed panel of B or a large matrix is
+ * covered by a few TLB entries instead of one per 4KB page.
+ *
+ * The packing workspaces are cached per thread, one buffer per `Slot`,
+ * and only grow, so repeated calls neither allocate nor fault in fresh
+ * pages, and each buffer stays on the NUMA node of the thread that first
+ * wrote it. A slot must not be acquired twice by the same thread at once:
+ * the serial and the parallel GEMM use different slots, and neither runs
+ * tasks of another group while it holds one.
+ *
+ */
+class GemmMemory {
+public:
+  /**
+   * @brief Disable constructing this class
+   *
+   */
+  GemmMemory() = delete;
+
+  enum Slot { SerialA, SerialB, ParallelA, ParallelB, NumSlots };
+
+  static const size_t hugePageSize = 2 << 20;
+
+  static bool hugePages;
+  static bool cacheWorkspace;
+
+  static void *allocate(size_t bytes) {
+    if (hugePages && bytes >= hugePageSize) {
+      bytes = (bytes + hugePageSize - 1) / hugePageSize * hugePageSize;
+      void *ptr = aligned_alloc(hugePageSize, bytes);
+#ifdef MADV_HUGEPAGE
+      if (ptr != NULL) {
+        madvise(ptr, bytes, MADV_HUGEPAGE);
+      }
+#endif
+      return ptr;
+    }
+    return aligned_alloc(64, (bytes + 63) / 64 * 64);
+  }
+
+  /**
+   * @brief A workspace of at least `bytes` for `slot`, give it back with
+   * `release`
+   *
+   */
+  static void *acquire(Slot slot, size_t bytes) {
+    if (!cacheWorkspace) {
+      return allocate(bytes);
+    }
+    Cache &c = cache;
+    if (bytes > c.size[slot]) {
+      free(c.buffer[slot]);
+      c.buffer[slot] = allocate(bytes);
+      c.size[slot] = bytes;
+    }
+    return c.buffer[slot];
+  }
+
+  static void release(Slot slot, void *ptr) {
+    if (!cacheWorkspace && ptr != cache.buffer[slot]) {
+      free(ptr);
+    }
+  }
+
+private:
+  struct Cache {
+    void *buffer[NumSlots];
+    size_t size[NumSlots];
+
+    ~Cache() {
+      for (int s = 0; s < NumSlots; s++) {
+        free(buffer[s]);
+      }
+    }
+  };
+
+  static thread_local Cache cache;
+};
+
+bool GemmMemory::hugePages = true;
+bool GemmMemory::cacheWorkspace = true;
+thread_local GemmMemory::Cache GemmMemory::cache;
+
 /**
  * @brief `Gemm` class is the most simplest implementation, it uses the native
  * way to calculate the matrix-matrix multiplication.
@@ -107,7 +402,7 @@ public:
   static void gemmUsingBlock(int m, int n, int k, double *A, double *B,
                              double *C, double alpha, double beta) {
     Point2D a{}, b{}, c{};
-    const int size = 8;
+    const int size = GemmConfig::blocking().block;
     for (int i = 0; i < m; i += size) {
       int mBlock = i + size < m ? size : m - i;
       // A(i, k) * B(k, j) -> A(i, j)
@@ -149,18 +444,26 @@ public:
    */
   static void gemmUsingBlock(int M, int N, int K, double *A, double *B,
                              double *C, double alpha, double beta) {
-    const int size = 8;
+    const int size = GemmConfig::blocking().block;
+
+    // The K loop is the outermost one, so beta has to be applied first
+    for (int i = 0; i < M; i++) {
+      for (int j = 0; j < N; j++) {
+        C[i * N + j] = beta == 0.0 ? 0.0 : beta * C[i * N + j];
+      }
+    }
+
     for (int kk = 0; kk < K; kk += size) {
       int kBlock = kk + size < K ? size : K - kk;
       for (int jj = 0; jj < N; jj += size) {
         int jBlock = jj + size < N ? size : N - jj;
         for (int i = 0; i < M; i++) {
           for (int j = jj; j < jj + jBlock; j++) {
-            double sum = C[i * M + j];
+            double sum = 0;
             for (int k = kk; k < kk + kBlock; k++) {
-              sum += A[i * M + k] * B[K * k + j];
+              sum += A[i * K + k] * B[k * N + j];
             }
-            C[i * M + j] = sum;
+            C[i * N + j] += alpha * sum;
           }
         }
       }
@@ -200,7 +503,7 @@ public:
         double inner_pod = 0;
         for (int kk = 0; kk < kBlock; kk++) {
           inner_pod +=
-              A[(i + a.i) * k + (kk + a.j)] * B[(j + b.i) * n + (kk + b.j)];
+              A[(i + a.i) * k + (kk + a.j)] * B[(j + b.i) * k + (kk + b.j)];
         }
         C[(i + c.i) * n + (j + c.j)] += alpha * inner_pod;
       }
@@ -210,7 +513,7 @@ public:
   static void gemmUsingBlock(int m, int n, int k, double *A, double *B,
                              double *C, double alpha, double beta) {
     Point2D a{}, b{}, c{};
-    const int size = 8;
+    const int size = GemmConfig::blocking().block;
     for (int i = 0; i < m; i += size) {
       int mBlock = i + size < m ? size : m - i;
       a.i = i;
@@ -248,7 +551,185 @@ public:
   }
 };
 
-class GemmBlockWithThreeCacheLevel {
+/**
+ * @brief Register block of the micro-kernel for each element type: a row
+ * of the `MR x NR` tile is two AVX2 registers, 8 doubles or 16 floats.
+ *
+ */
+template <typename T> struct GemmTraits;
+
+template <> struct GemmTraits<double> {
+  static const int MR = GemmConfig::MR;
+  static const int NR = GemmConfig::NR;
+};
+
+template <> struct GemmTraits<float> {
+  static const int MR = 6;
+  static const int NR = 16;
+};
+
+/**
+ * @brief Element conversions used while packing. A and B may be stored in
+ * a narrower type than the one the kernel computes in; packing is the one
+ * pass that reads them anyway, so widening there costs nothing extra.
+ *
+ */
+static inline double widen(double x) { return x; }
+static inline float widen(float x) { return x; }
+
+static inline float widen(GemmBf16 x) {
+  uint32_t bits = static_cast<uint32_t>(x.bits) << 16;
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+static inline float widen(GemmFp16 x) {
+  uint32_t sign = static_cast<uint32_t>(x.bits & 0x8000) << 16;
+  uint32_t exponent = (x.bits >> 10) & 0x1f;
+  uint32_t mantissa = x.bits & 0x3ff;
+  uint32_t bits;
+  if (exponent == 0) {
+    // Zero or subnormal: mantissa * 2^-24
+    float f = mantissa * (1.0f / 16777216.0f);
+    memcpy(&bits, &f, sizeof(bits));
+    bits |= sign;
+  } else if (exponent == 31) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+/**
+ * @brief Epilogues: element-wise functions applied to the finished tile
+ * of C before it is stored, so that the bias, activation and scaling after
+ * a layer do not each need another pass over C. The kernels are templates
+ * on the epilogue type, so `GemmNoEpilogue` compiles away entirely.
+ *
+ * @details `shift(i, j)` returns the epilogue of the tile whose top-left
+ * element is C(i, j), and `apply(x, r, c)` maps the element at row `r`,
+ * column `c` of that tile (a vector `apply` maps columns `c` to `c + 3`).
+ * Only tiles of the last K panel get an epilogue, the others hold partial
+ * sums.
+ *
+ */
+struct GemmNoEpilogue {
+  static const bool active = false;
+
+  GemmNoEpilogue shift(int i, int j) const { return *this; }
+
+  template <typename U> U apply(U x, int r, int c) const { return x; }
+};
+
+#ifdef __AVX2__
+/**
+ * @brief exp(x) for |x| <= 40 to about 1 ulp: x = n ln2 + t with
+ * |t| <= ln2 / 2, a degree 12 Taylor polynomial for exp(t), and 2^n built
+ * directly in the exponent bits.
+ *
+ */
+static inline __m256d gemmExp(__m256d x) {
+  const __m256d log2e = _mm256_set1_pd(1.4426950408889634);
+  const __m256d ln2hi = _mm256_set1_pd(6.93147180369123816490e-01);
+  const __m256d ln2lo = _mm256_set1_pd(1.90821492927058770002e-10);
+  // 2^52 + 2^51: adding it leaves n in the low mantissa bits
+  const __m256d shifter = _mm256_set1_pd(6755399441055744.0);
+
+  __m256d n = _mm256_round_pd(_mm256_mul_pd(x, log2e),
+                              _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  __m256d t = _mm256_fnmadd_pd(n, ln2hi, x);
+  t = _mm256_fnmadd_pd(n, ln2lo, t);
+
+  __m256d p = _mm256_set1_pd(1.0 / 479001600.0);
+  const double inverseFactorial[12] = {
+      1.0 / 39916800.0, 1.0 / 3628800.0, 1.0 / 362880.0, 1.0 / 40320.0,
+      1.0 / 5040.0,     1.0 / 720.0,     1.0 / 120.0,    1.0 / 24.0,
+      1.0 / 6.0,        1.0 / 2.0,       1.0,            1.0};
+  for (int i = 0; i < 12; i++) {
+    p = _mm256_fmadd_pd(p, t, _mm256_set1_pd(inverseFactorial[i]));
+  }
+
+  __m256i bits = _mm256_sub_epi64(
+      _mm256_castpd_si256(_mm256_add_pd(n, shifter)),
+      _mm256_castpd_si256(shifter));
+  __m256i scale = _mm256_slli_epi64(
+      _mm256_add_epi64(bits, _mm256_set1_epi64x(1023)), 52);
+  return _mm256_mul_pd(p, _mm256_castsi256_pd(scale));
+}
+#endif
+
+/**
+ * @brief `x -> rowScale[r] * activation(x + bias[c])`, the usual tail of
+ * a dense layer. `bias` (one value per column of C) and `rowScale` (one
+ * per row) may be NULL. GELU uses the tanh approximation.
+ *
+ */
+template <int Activation> struct GemmBiasActivation {
+  static const bool active = true;
+
+  const double *bias;
+  const double *rowScale;
+
+  GemmBiasActivation shift(int i, int j) const {
+    GemmBiasActivation tile;
+    tile.bias = bias != NULL ? bias + j : NULL;
+    tile.rowScale = rowScale != NULL ? rowScale + i : NULL;
+    return tile;
+  }
+
+  double apply(double x, int r, int c) const {
+    if (bias != NULL) {
+      x += bias[c];
+    }
+    if (Activation == GemmActivationReLU) {
+      x = x > 0 ? x : 0;
+    } else if (Activation == GemmActivationGELU) {
+      const double sqrt2OverPi = 0.7978845608028654;
+      x = 0.5 * x * (1 + tanh(sqrt2OverPi * (x + 0.044715 * x * x * x)));
+    }
+    if (rowScale != NULL) {
+      x *= rowScale[r];
+    }
+    return x;
+  }
+
+#ifdef __AVX2__
+  __m256d apply(__m256d x, int r, int c) const {
+    if (bias != NULL) {
+      x = _mm256_add_pd(x, _mm256_loadu_pd(bias + c));
+    }
+    if (Activation == GemmActivationReLU) {
+      x = _mm256_max_pd(x, _mm256_setzero_pd());
+    } else if (Activation == GemmActivationGELU) {
+      // tanh(u) = 1 - 2 / (exp(2u) + 1), saturated well before exp
+      // overflows
+      const __m256d limit = _mm256_set1_pd(40.0);
+      __m256d x3 = _mm256_mul_pd(_mm256_mul_pd(x, x), x);
+      __m256d u2 = _mm256_mul_pd(
+          _mm256_set1_pd(2 * 0.7978845608028654),
+          _mm256_fmadd_pd(_mm256_set1_pd(0.044715), x3, x));
+      u2 = _mm256_min_pd(_mm256_max_pd(u2, _mm256_sub_pd(_mm256_setzero_pd(), limit)),
+                         limit);
+      __m256d one = _mm256_set1_pd(1.0);
+      __m256d tanhU = _mm256_sub_pd(
+          one, _mm256_div_pd(_mm256_set1_pd(2.0),
+                             _mm256_add_pd(gemmExp(u2), one)));
+      x = _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(0.5), x),
+                        _mm256_add_pd(one, tanhU));
+    }
+    if (rowScale != NULL) {
+      x = _mm256_mul_pd(x, _mm256_set1_pd(rowScale[r]));
+    }
+    return x;
+  }
+#endif
+};
+
+template <typename T> class GemmBlockWithThreeCacheLevel {
 public:
   /**
    * @brief Disable constructing this class
@@ -256,110 +737,195 @@ public:
    */
   GemmBlockWithThreeCacheLevel() = delete;
 
-  static void matrixMultiplicationBlock(int mBlock, int nBlock, int kBlock,
-                                        int n, int k, Point2D &a, Point2D &b,
-                                        Point2D &c, double *A, double *B,
-                                        double *C, double alpha) {
+  /**
+   * @brief Register block: every call of the micro-kernel produces an
+   * `MR x NR` tile of C. With AVX2 a row of the tile is two YMM registers,
+   * so the 12 accumulators plus two B vectors and one A broadcast fit in
+   * the 16 YMM registers.
+   *
+   */
+  static const int MR = GemmTraits<T>::MR;
+  static const int NR = GemmTraits<T>::NR;
 
-    for (int i = 0; i < mBlock; i++) {
-      for (int j = 0; j < nBlock; j++) {
-        double inner_pod = 0;
-        for (int kk = 0; kk < kBlock; kk++) {
-          inner_pod +=
-              A[(i + a.i) * k + (kk + a.j)] * B[(j + b.i) * k + (kk + b.j)];
+  /**
+   * @brief Pack a `mBlock x kBlock` block of A into micro-panels of `MR`
+   * rows. Inside a micro-panel the `MR` values of one column are
+   * consecutive, which is the order the micro-kernel reads them in. Rows
+   * past `mBlock` are padded with zeros so the kernel never branches.
+   *
+   * @details Element (i, p) is read from `A[i * rsA + p * csA]`, so a
+   * transposed or column-major A is packed by swapping the two strides and
+   * never needs a separate transposition pass.
+   *
+   */
+  template <typename S>
+  static void packA(int mBlock, int kBlock, const S *A, long rsA, long csA,
+                    T *packedA) {
+    for (int ir = 0; ir < mBlock; ir += MR) {
+      int rows = ir + MR < mBlock ? MR : mBlock - ir;
+      for (int p = 0; p < kBlock; p++) {
+        for (int r = 0; r < rows; r++) {
+          packedA[r] = widen(A[(ir + r) * rsA + p * csA]);
         }
-        C[(i + c.i) * n + (j + c.j)] += alpha * inner_pod;
+        for (int r = rows; r < MR; r++) {
+          packedA[r] = 0;
+        }
+        packedA += MR;
       }
     }
   }
 
   /**
-   * @brief Use five loop tp calculate the matrix-matrix multiplication, for
-   * simplicity here, I only implement C = alpha AB.
+   * @brief Pack a `kBlock x nBlock` panel of B into micro-panels of `NR`
+   * columns, `NR` consecutive values per row, zero padded like `packA`.
+   * Element (p, j) is read from `B[p * rsB + j * csB]`.
    *
    */
-  static void gemmUsingBlock(int m, int n, int k, double *A, double *B,
-                             double *C, double alpha, double beta) {
+  template <typename S>
+  static void packB(int kBlock, int nBlock, const S *B, long rsB, long csB,
+                    T *packedB) {
+    for (int jr = 0; jr < nBlock; jr += NR) {
+      int cols = jr + NR < nBlock ? NR : nBlock - jr;
+      for (int p = 0; p < kBlock; p++) {
+        const S *row = B + p * rsB + jr * csB;
+        if (csB == 1) {
+          for (int c = 0; c < cols; c++) {
+            packedB[c] = widen(row[c]);
+          }
+        } else {
+          for (int c = 0; c < cols; c++) {
+            packedB[c] = widen(row[c * csB]);
+          }
+        }
+        for (int c = cols; c < NR; c++) {
+          packedB[c] = 0;
+        }
+        packedB += NR;
+      }
+    }
+  }
+
+  /**
+   * @brief Merge a finished `AB` tile (row stride `NR`) into C:
+   * `C = epilogue(alpha * AB + beta * C)` on its `rows x cols` corner. C
+   * is not read when `beta` is zero.
+   *
+   */
+  template <typename Epilogue>
+  static void storeTile(const T *AB, T *C, long ldc, int rows, int cols,
+                        T alpha, T beta, const Epilogue &epilogue) {
+    for (int r = 0; r < rows; r++) {
+      for (int c = 0; c < cols; c++) {
+        T *out = C + r * ldc + c;
+        T value = beta == 0 ? alpha * AB[r * NR + c]
+                            : alpha * AB[r * NR + c] + beta * *out;
+        *out = epilogue.apply(value, r, c);
+      }
+    }
+  }
 
-    const int sizeN = 4096;
-    const int sizeK = 256;
-    const int sizeM = 96;
+  /**
+   * @brief Compute `AB = a * b` for one `MR x kBlock` micro-panel `a` and
+   * one `kBlock x NR` micro-panel `b`, then merge it into C:
+   * `C = alpha * AB + beta * C`. The whole K loop runs in registers, so C
+   * is read and written once per tile. Only the `rows x cols` corner of
+   * the tile that lies inside C is stored.
+   *
+   * @details This is the portable version, AVX2 builds use the
+   * specializations below. `epilogue` is applied to the merged values
+   * before they are stored.
+   *
+   */
+  template <typename Epilogue = GemmNoEpilogue>
+  static void microKernel(int kBlock, const T *a, const T *b, T *C, long ldc,
+                          int rows, int cols, T alpha, T beta,
+                          const Epilogue &epilogue = Epilogue()) {
+    T AB[MR * NR];
+    for (int i = 0; i < MR * NR; i++) {
+      AB[i] = 0;
+    }
+    for (int p = 0; p < kBlock; p++) {
+      for (int r = 0; r < MR; r++) {
+        for (int c = 0; c < NR; c++) {
+          AB[r * NR + c] += a[r] * b[c];
+        }
+      }
+      a += MR;
+      b += NR;
+    }
+    storeTile(AB, C, ldc, rows, cols, alpha, beta, epilogue);
+  }
 
-    Point2D a{}, b{}, c{}, ra{}, rb{}, rc{};
+  /**
+   * @brief Use five loops to calculate the matrix-matrix multiplication
+   * (the Goto/BLIS algorithm). The two outer loops pick a panel of B and
+   * a block of A that fit in L3 and L2, the two inner loops walk
+   * `MR x NR` tiles of C, and the micro-kernel performs the innermost
+   * loop over K in registers. `beta` is only applied by the first panel
+   * of K, later panels accumulate into C.
+   *
+   * @details A and B are addressed through a row and a column stride (see
+   * `packA`), C is row-major with leading dimension `ldc`. `k` must be
+   * positive, otherwise `beta` is never applied. A and B may be stored as
+   * `S` and are converted to `T` by the packing. The tiles of the last
+   * panel of K go through `epilogue` (see `GemmNoEpilogue`).
+   *
+   */
+  template <typename S, typename Epilogue = GemmNoEpilogue>
+  static void gemmUsingBlock(int m, int n, int k, T alpha, const S *A,
+                             long rsA, long csA, const S *B, long rsB,
+                             long csB, T beta, T *C, long ldc,
+                             const Epilogue &epilogue = Epilogue()) {
 
-    const int rSizeN = 4;
-    const int rSizeM = 8;
+    // Cache blocks: a `sizeM x sizeK` block of A lives in L2 and a
+    // `sizeK x sizeN` panel of B lives in L3, see `GemmConfig`.
+    const GemmConfig::Blocking blocking = GemmConfig::blockingFor<T>();
+    // Smaller problems only get (and allocate) blocks as big as they are
+    const int sizeN = n < blocking.nc ? (n + NR - 1) / NR * NR : blocking.nc;
+    const int sizeK = k < blocking.kc ? k : blocking.kc;
+    const int sizeM = m < blocking.mc ? (m + MR - 1) / MR * MR : blocking.mc;
 
     // We need to create pack A and pack B. It's a bad idea to allocate
-    // memory in the loop.
-    double *packedA = new double[sizeM * sizeK];
-    double *packedB = new double[sizeN * sizeK];
-
-    for (int j = 0; j < n; j += sizeN) {
-      // In this loop, we only handle for the matrix B, it would
-      // be split up by `sizeN` for the col.
-      b.j = j;
-      c.j = j;
-      int nBlock = j + sizeN < n ? sizeN : n - j;
-
-      for (int kk = 0; kk < k; kk += sizeK) {
-        // In this loop, we handle for the matrix A and matrix B.
-        // For the matrix A it would be split up by `sizeK` for the col
-        // For the matrix B it would be split up by `sizeK` for the row
-        a.j = kk;
-        b.i = kk;
-        int kBlock = kk + sizeK < k ? sizeK : k - kk;
-
-        // At here, we should pack the B into a consecutive memory, in
-        // order to improve the cache hit rate and avoid TLB miss. We make
-        // `packedB` into the L3 cache, So the L3 size should be greater
-        // than the `sizeN * sizeK`. So in the following `for` loop all
-        // the access to the `packedB` would gain great efficiency. And we
-        // will convert the row-major to the col-major.
-
-        for (int j_ = 0; j_ < nBlock; j_++) {
-          for (int i_ = 0; i_ < kBlock; i_++) {
-            packedB[j_ * sizeK + i_] = B[(b.i + i_) * n + (b.j + j_)];
-          }
-        }
+    // memory in the loop, or even in every call.
+    T *packedA = static_cast<T *>(GemmMemory::acquire(
+        GemmMemory::SerialA, sizeof(T) * sizeM * sizeK));
+    T *packedB = static_cast<T *>(GemmMemory::acquire(
+        GemmMemory::SerialB, sizeof(T) * sizeN * sizeK));
 
-        for (int i = 0; i < m; i += sizeM) {
-          // In this loop, we handle for the matrix A, it would be split
-          // up by the `sizeI` for the row.
-          a.i = i;
-          c.i = i;
-          int mBlock = i + sizeM < m ? sizeM : m - i;
-
-          // At here, we should pack the A into a consecutive memory, in
-          // order to improve the cache hit rate and avoid TLB miss. We
-          // make `packedA` into the L2 cache, so the L2 cache must be
-          // greater than `sizeM * sizeK`. So the following `for` loop
-          // for accessing to the `packedA` would get great efficiency.
-          for (int i_ = 0; i_ < mBlock; i_++) {
-            for (int j_ = 0; j_ < kBlock; j_++) {
-              packedA[i_ * sizeK + j_] = A[(a.i + i_) * k + (a.j + j_)];
-            }
-          }
+    for (int jc = 0; jc < n; jc += sizeN) {
+      int nBlock = jc + sizeN < n ? sizeN : n - jc;
+
+      for (int pc = 0; pc < k; pc += sizeK) {
+        int kBlock = pc + sizeK < k ? sizeK : k - pc;
+        T betaBlock = pc == 0 ? beta : 1;
+
+        // `packedB` should stay in the L3 cache, so the L3 size should be
+        // greater than `sizeN * sizeK`.
+        packB(kBlock, nBlock, B + pc * rsB + jc * csB, rsB, csB, packedB);
+
+        for (int ic = 0; ic < m; ic += sizeM) {
+          int mBlock = ic + sizeM < m ? sizeM : m - ic;
 
-          // Here, we already split the matrix A and matrix B into the block.
-          // However, we need to split again just like the above, this would
-          // be super easy.
-          for (int jr = 0; jr < nBlock; jr += rSizeN) {
-            int rNBlock = jr + rSizeN < nBlock ? rSizeN : nBlock - jr;
-            rb.i = jr;
-            rc.j = jr + c.j;
-
-            for (int ri = 0; ri < mBlock; ri += rSizeM) {
-              int rMBlock = ri + rSizeM < mBlock ? rSizeM : mBlock - ri;
-              ra.i = ri;
-              rc.i = ri + c.i;
-
-              for (int internalK = 0; internalK < kBlock; internalK++) {
-                ra.j = internalK;
-                rb.j = internalK;
-
-                matrixMultiplicationBlock(rMBlock, rNBlock, 1, n, sizeK, ra, rb,
-                                          rc, packedA, packedB, C, alpha);
+          // `packedA` should stay in the L2 cache, so the L2 size should
+          // be greater than `sizeM * sizeK`.
+          packA(mBlock, kBlock, A + ic * rsA + pc * csA, rsA, csA, packedA);
+
+          for (int jr = 0; jr < nBlock; jr += NR) {
+            int cols = jr + NR < nBlock ? NR : nBlock - jr;
+
+            for (int ir = 0; ir < mBlock; ir += MR) {
+              int rows = ir + MR < mBlock ? MR : mBlock - ir;
+
+              if (pc + kBlock < k) {
+                microKernel(kBlock, packedA + ir * kBlock,
+                            packedB + jr * kBlock,
+                            C + (ic + ir) * ldc + (jc + jr), ldc, rows, cols,
+                            alpha, betaBlock);
+              } else {
+                microKernel(kBlock, packedA + ir * kBlock,
+                            packedB + jr * kBlock,
+                            C + (ic + ir) * ldc + (jc + jr), ldc, rows, cols,
+                            alpha, betaBlock, epilogue.shift(ic + ir, jc + jr));
               }
             }
           }
@@ -367,29 +933,1497 @@ public:
       }
     }
 
-    delete[] packedA;
-    delete[] packedB;
+    GemmMemory::release(GemmMemory::SerialA, packedA);
+    GemmMemory::release(GemmMemory::SerialB, packedB);
   }
 
-  static void gemm(int m, int n, int k, double *A, double *B, double *C,
-                   double alpha, double beta) {
+  static void gemm(int m, int n, int k, T *A, T *B, T *C, T alpha, T beta) {
 
-    gemmUsingBlock(m, n, k, A, B, C, alpha, beta);
+    gemmUsingBlock(m, n, k, alpha, A, k, 1, B, n, 1, beta, C, n);
   }
 };
 
-void gemm(int m, int n, int k, double *A, double *B, double *C, double alpha, double beta){
-  // Brute Force
-  // Gemm::gemm(m, n, k, A, B, C, alpha, beta);
+#ifdef __AVX2__
+template <>
+template <typename Epilogue>
+inline void GemmBlockWithThreeCacheLevel<double>::microKernel(
+    int kBlock, const double *a, const double *b, double *C, long ldc,
+    int rows, int cols, double alpha, double beta, const Epilogue &epilogue) {
+  __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+  __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+  __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+  __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+  __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+  __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
 
-  // SubMatrix Multiplication
-  // GemmBlock::gemm(m, n, k, A, B, C, alpha, beta);
+  for (int p = 0; p < kBlock; p++) {
+    __m256d b0 = _mm256_load_pd(b);
+    __m256d b1 = _mm256_load_pd(b + 4);
+    __m256d ai;
 
-  // SubMatrix Multiplication
-  GemmBlockIJK::gemm(m, n, k, A, B, C, alpha, beta);
+    ai = _mm256_broadcast_sd(a + 0);
+    c00 = _mm256_fmadd_pd(ai, b0, c00);
+    c01 = _mm256_fmadd_pd(ai, b1, c01);
+    ai = _mm256_broadcast_sd(a + 1);
+    c10 = _mm256_fmadd_pd(ai, b0, c10);
+    c11 = _mm256_fmadd_pd(ai, b1, c11);
+    ai = _mm256_broadcast_sd(a + 2);
+    c20 = _mm256_fmadd_pd(ai, b0, c20);
+    c21 = _mm256_fmadd_pd(ai, b1, c21);
+    ai = _mm256_broadcast_sd(a + 3);
+    c30 = _mm256_fmadd_pd(ai, b0, c30);
+    c31 = _mm256_fmadd_pd(ai, b1, c31);
+    ai = _mm256_broadcast_sd(a + 4);
+    c40 = _mm256_fmadd_pd(ai, b0, c40);
+    c41 = _mm256_fmadd_pd(ai, b1, c41);
+    ai = _mm256_broadcast_sd(a + 5);
+    c50 = _mm256_fmadd_pd(ai, b0, c50);
+    c51 = _mm256_fmadd_pd(ai, b1, c51);
 
-  // SubMatrix Multiplication with B memory layout change
-  // GemmBlockWithMemoryLayoutChange::gemm(m, n, k, A, B, C, alpha, beta);
+    a += MR;
+    b += NR;
+  }
+
+  // Full tiles update C straight from the registers, the epilogue
+  // included
+  if (rows == MR && cols == NR) {
+    __m256d va = _mm256_set1_pd(alpha);
+    __m256d vb = _mm256_set1_pd(beta);
+    __m256d acc[MR][2] = {{c00, c01}, {c10, c11}, {c20, c21},
+                          {c30, c31}, {c40, c41}, {c50, c51}};
+    for (int r = 0; r < MR; r++) {
+      double *row = C + r * ldc;
+      __m256d r0 = _mm256_mul_pd(va, acc[r][0]);
+      __m256d r1 = _mm256_mul_pd(va, acc[r][1]);
+      if (beta != 0.0) {
+        r0 = _mm256_fmadd_pd(vb, _mm256_loadu_pd(row), r0);
+        r1 = _mm256_fmadd_pd(vb, _mm256_loadu_pd(row + 4), r1);
+      }
+      r0 = epilogue.apply(r0, r, 0);
+      r1 = epilogue.apply(r1, r, 4);
+      _mm256_storeu_pd(row, r0);
+      _mm256_storeu_pd(row + 4, r1);
+    }
+    return;
+  }
+
+  // Edge tiles go through memory
+  double AB[MR * NR];
+  _mm256_storeu_pd(AB + 0 * NR, c00);
+  _mm256_storeu_pd(AB + 0 * NR + 4, c01);
+  _mm256_storeu_pd(AB + 1 * NR, c10);
+  _mm256_storeu_pd(AB + 1 * NR + 4, c11);
+  _mm256_storeu_pd(AB + 2 * NR, c20);
+  _mm256_storeu_pd(AB + 2 * NR + 4, c21);
+  _mm256_storeu_pd(AB + 3 * NR, c30);
+  _mm256_storeu_pd(AB + 3 * NR + 4, c31);
+  _mm256_storeu_pd(AB + 4 * NR, c40);
+  _mm256_storeu_pd(AB + 4 * NR + 4, c41);
+  _mm256_storeu_pd(AB + 5 * NR, c50);
+  _mm256_storeu_pd(AB + 5 * NR + 4, c51);
+  storeTile(AB, C, ldc, rows, cols, alpha, beta, epilogue);
+}
+
+template <>
+template <typename Epilogue>
+inline void GemmBlockWithThreeCacheLevel<float>::microKernel(
+    int kBlock, const float *a, const float *b, float *C, long ldc, int rows,
+    int cols, float alpha, float beta, const Epilogue &epilogue) {
+  __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+  __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+  __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+  __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+  __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+  __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+  for (int p = 0; p < kBlock; p++) {
+    __m256 b0 = _mm256_load_ps(b);
+    __m256 b1 = _mm256_load_ps(b + 8);
+    __m256 ai;
+
+    ai = _mm256_broadcast_ss(a + 0);
+    c00 = _mm256_fmadd_ps(ai, b0, c00);
+    c01 = _mm256_fmadd_ps(ai, b1, c01);
+    ai = _mm256_broadcast_ss(a + 1);
+    c10 = _mm256_fmadd_ps(ai, b0, c10);
+    c11 = _mm256_fmadd_ps(ai, b1, c11);
+    ai = _mm256_broadcast_ss(a + 2);
+    c20 = _mm256_fmadd_ps(ai, b0, c20);
+    c21 = _mm256_fmadd_ps(ai, b1, c21);
+    ai = _mm256_broadcast_ss(a + 3);
+    c30 = _mm256_fmadd_ps(ai, b0, c30);
+    c31 = _mm256_fmadd_ps(ai, b1, c31);
+    ai = _mm256_broadcast_ss(a + 4);
+    c40 = _mm256_fmadd_ps(ai, b0, c40);
+    c41 = _mm256_fmadd_ps(ai, b1, c41);
+    ai = _mm256_broadcast_ss(a + 5);
+    c50 = _mm256_fmadd_ps(ai, b0, c50);
+    c51 = _mm256_fmadd_ps(ai, b1, c51);
+
+    a += MR;
+    b += NR;
+  }
+
+  // The epilogues only have double vector forms, so float tiles with one
+  // take the scalar path
+  if (rows == MR && cols == NR && !Epilogue::active) {
+    __m256 va = _mm256_set1_ps(alpha);
+    __m256 vb = _mm256_set1_ps(beta);
+    __m256 acc[MR][2] = {{c00, c01}, {c10, c11}, {c20, c21},
+                         {c30, c31}, {c40, c41}, {c50, c51}};
+    for (int r = 0; r < MR; r++) {
+      float *row = C + r * ldc;
+      __m256 r0 = _mm256_mul_ps(va, acc[r][0]);
+      __m256 r1 = _mm256_mul_ps(va, acc[r][1]);
+      if (beta != 0.0f) {
+        r0 = _mm256_fmadd_ps(vb, _mm256_loadu_ps(row), r0);
+        r1 = _mm256_fmadd_ps(vb, _mm256_loadu_ps(row + 8), r1);
+      }
+      _mm256_storeu_ps(row, r0);
+      _mm256_storeu_ps(row + 8, r1);
+    }
+    return;
+  }
+
+  float AB[MR * NR];
+  _mm256_storeu_ps(AB + 0 * NR, c00);
+  _mm256_storeu_ps(AB + 0 * NR + 8, c01);
+  _mm256_storeu_ps(AB + 1 * NR, c10);
+  _mm256_storeu_ps(AB + 1 * NR + 8, c11);
+  _mm256_storeu_ps(AB + 2 * NR, c20);
+  _mm256_storeu_ps(AB + 2 * NR + 8, c21);
+  _mm256_storeu_ps(AB + 3 * NR, c30);
+  _mm256_storeu_ps(AB + 3 * NR + 8, c31);
+  _mm256_storeu_ps(AB + 4 * NR, c40);
+  _mm256_storeu_ps(AB + 4 * NR + 8, c41);
+  _mm256_storeu_ps(AB + 5 * NR, c50);
+  _mm256_storeu_ps(AB + 5 * NR + 8, c51);
+  storeTile(AB, C, ldc, rows, cols, alpha, beta, epilogue);
+}
+#endif
+
+// Entry points of the task system in ../common/tasksys.cpp
+extern "C" {
+void ISPCLaunch(void **handlePtr, void *f, void *data, int count);
+void ISPCSync(void *handle);
+}
+
+/**
+ * @brief Thread count and per-thread statistics shared by every
+ * instantiation of `GemmParallel` and by `GemmSmall`.
+ *
+ */
+class GemmParallelBase {
+public:
+  /**
+   * @brief Disable constructing this class
+   *
+   */
+  GemmParallelBase() = delete;
+
+  static const int maxThreads = 256;
+
+  /**
+   * @brief Number of tasks (and threads) to use, 0 means one per online
+   * core. Per-task busy time and flop counts of the last call are kept so
+   * the harness can report per-thread GFLOPS.
+   *
+   */
+  static int numThreads;
+  static double threadSeconds[maxThreads];
+  static double threadFlops[maxThreads];
+
+  /**
+   * @brief Number of tasks used by the last call
+   *
+   */
+  static int lastThreads;
+
+  static int taskCount() {
+    int tasks = numThreads > 0 ? numThreads : sysconf(_SC_NPROCESSORS_ONLN);
+    return tasks < maxThreads ? tasks : maxThreads;
+  }
+
+  /**
+   * @brief Start of part `i` out of `parts` of `[0, size)`, rounded to a
+   * multiple of `align` so that parts never split a micro-panel.
+   *
+   */
+  static int split(int size, int parts, int i, int align) {
+    int units = (size + align - 1) / align;
+    int start = static_cast<int>(static_cast<long>(units) * i / parts) * align;
+    return start < size ? start : size;
+  }
+
+  /**
+   * @brief Split `tasks` into a `mWays x nWays` grid. The N direction only
+   * gets the smaller factor: splitting N makes tasks in the same row
+   * pack the same blocks of A twice, splitting M costs nothing extra.
+   *
+   */
+  static void grid(int tasks, int *mWays, int *nWays) {
+    *nWays = 1;
+    for (int f = 1; f * f <= tasks; f++) {
+      if (tasks % f == 0) {
+        *nWays = f;
+      }
+    }
+    *mWays = tasks / *nWays;
+  }
+};
+
+int GemmParallelBase::numThreads = 0;
+int GemmParallelBase::lastThreads = 0;
+double GemmParallelBase::threadSeconds[GemmParallelBase::maxThreads];
+double GemmParallelBase::threadFlops[GemmParallelBase::maxThreads];
+
+/**
+ * @brief Multithreaded version of `GemmBlockWithThreeCacheLevel` running on
+ * the pthread task system that ships with ISPC (`ISPCLaunch`/`ISPCSync`).
+ *
+ * @details For every `sizeK x sizeN` panel of B, one launch packs the panel
+ * cooperatively into a single shared buffer, then a second launch splits
+ * the C panel over a `mWays x nWays` grid of tasks: task (mi, ni) owns a
+ * range of rows (it packs its own blocks of A into a private buffer) and a
+ * range of `NR` column micro-panels. There is one task per thread, so each
+ * packed-A buffer stays in the L2 of the core that uses it.
+ *
+ */
+template <typename T> class GemmParallel : public GemmParallelBase {
+public:
+  /**
+   * @brief Disable constructing this class
+   *
+   */
+  GemmParallel() = delete;
+
+  typedef GemmBlockWithThreeCacheLevel<T> Kernel;
+  static const int MR = Kernel::MR;
+  static const int NR = Kernel::NR;
+
+  /**
+   * @brief Everything a task needs to find its share of the work
+   *
+   */
+  template <typename S, typename Epilogue> struct Args {
+    int m, n, k;
+    const S *A, *B;
+    T *C;
+    long rsA, csA, rsB, csB, ldc;
+    T alpha, beta;
+    int sizeM, sizeK;
+    int jc, nBlock, pc, kBlock;
+    int mWays, nWays;
+    T *packedB;
+    Epilogue epilogue;
+  };
+
+  template <typename S, typename Epilogue>
+  static void packBTask(void *data, int threadIndex, int threadCount,
+                        int taskIndex, int taskCount) {
+    Args<S, Epilogue> *args = static_cast<Args<S, Epilogue> *>(data);
+    double start = CycleTimer::currentSeconds();
+
+    int j0 = split(args->nBlock, taskCount, taskIndex, NR);
+    int j1 = split(args->nBlock, taskCount, taskIndex + 1, NR);
+    if (j1 > j0) {
+      Kernel::packB(args->kBlock, j1 - j0,
+                    args->B + args->pc * args->rsB + (args->jc + j0) * args->csB,
+                    args->rsB, args->csB, args->packedB + j0 * args->kBlock);
+    }
+
+    threadSeconds[taskIndex] += CycleTimer::currentSeconds() - start;
+  }
+
+  template <typename S, typename Epilogue>
+  static void computeTask(void *data, int threadIndex, int threadCount,
+                          int taskIndex, int taskCount) {
+    Args<S, Epilogue> *args = static_cast<Args<S, Epilogue> *>(data);
+    double start = CycleTimer::currentSeconds();
+
+    int mi = taskIndex / args->nWays;
+    int ni = taskIndex % args->nWays;
+    int i0 = split(args->m, args->mWays, mi, MR);
+    int i1 = split(args->m, args->mWays, mi + 1, MR);
+    int j0 = split(args->nBlock, args->nWays, ni, NR);
+    int j1 = split(args->nBlock, args->nWays, ni + 1, NR);
+    // Each thread packs A into its own cached workspace
+    T *packedA = static_cast<T *>(GemmMemory::acquire(
+        GemmMemory::ParallelA, sizeof(T) * args->sizeM * args->sizeK));
+    T betaBlock = args->pc == 0 ? args->beta : 1;
+    double flops = 0;
+
+    for (int ic = i0; ic < i1; ic += args->sizeM) {
+      int mBlock = ic + args->sizeM < i1 ? args->sizeM : i1 - ic;
+      Kernel::packA(mBlock, args->kBlock,
+                    args->A + ic * args->rsA + args->pc * args->csA, args->rsA,
+                    args->csA, packedA);
+
+      for (int jr = j0; jr < j1; jr += NR) {
+        int cols = jr + NR < args->nBlock ? NR : args->nBlock - jr;
+
+        for (int ir = 0; ir < mBlock; ir += MR) {
+          int rows = ir + MR < mBlock ? MR : mBlock - ir;
+
+          if (args->pc + args->kBlock < args->k) {
+            Kernel::microKernel(
+                args->kBlock, packedA + ir * args->kBlock,
+                args->packedB + jr * args->kBlock,
+                args->C + (ic + ir) * args->ldc + (args->jc + jr), args->ldc,
+                rows, cols, args->alpha, betaBlock);
+          } else {
+            Kernel::microKernel(
+                args->kBlock, packedA + ir * args->kBlock,
+                args->packedB + jr * args->kBlock,
+                args->C + (ic + ir) * args->ldc + (args->jc + jr), args->ldc,
+                rows, cols, args->alpha, betaBlock,
+                args->epilogue.shift(ic + ir, args->jc + jr));
+          }
+          flops += 2.0 * rows * cols * args->kBlock;
+        }
+      }
+    }
+
+    GemmMemory::release(GemmMemory::ParallelA, packedA);
+    threadFlops[taskIndex] += flops;
+    threadSeconds[taskIndex] += CycleTimer::currentSeconds() - start;
+  }
+
+  /**
+   * @brief Same strided interface as
+   * `GemmBlockWithThreeCacheLevel::gemmUsingBlock`, epilogue included
+   *
+   */
+  template <typename S, typename Epilogue = GemmNoEpilogue>
+  static void gemmUsingBlock(int m, int n, int k, T alpha, const S *A,
+                             long rsA, long csA, const S *B, long rsB,
+                             long csB, T beta, T *C, long ldc,
+                             const Epilogue &epilogue = Epilogue()) {
+    int tasks = taskCount();
+
+    const GemmConfig::Blocking blocking = GemmConfig::blockingFor<T>();
+    // Smaller problems only get (and allocate) blocks as big as they are
+    const int sizeN = n < blocking.nc ? (n + NR - 1) / NR * NR : blocking.nc;
+    const int sizeK = k < blocking.kc ? k : blocking.kc;
+    const int sizeM = m < blocking.mc ? (m + MR - 1) / MR * MR : blocking.mc;
+
+    Args<S, Epilogue> args;
+    args.m = m;
+    args.n = n;
+    args.k = k;
+    args.A = A;
+    args.B = B;
+    args.C = C;
+    args.rsA = rsA;
+    args.csA = csA;
+    args.rsB = rsB;
+    args.csB = csB;
+    args.ldc = ldc;
+    args.alpha = alpha;
+    args.beta = beta;
+    args.sizeM = sizeM;
+    args.sizeK = sizeK;
+    args.epilogue = epilogue;
+    grid(tasks, &args.mWays, &args.nWays);
+
+    args.packedB = static_cast<T *>(GemmMemory::acquire(
+        GemmMemory::ParallelB, sizeof(T) * sizeN * sizeK));
+    for (int t = 0; t < tasks; t++) {
+      threadSeconds[t] = 0;
+      threadFlops[t] = 0;
+    }
+
+    for (int jc = 0; jc < n; jc += sizeN) {
+      args.jc = jc;
+      args.nBlock = jc + sizeN < n ? sizeN : n - jc;
+
+      for (int pc = 0; pc < k; pc += sizeK) {
+        args.pc = pc;
+        args.kBlock = pc + sizeK < k ? sizeK : k - pc;
+
+        void *handle = NULL;
+        ISPCLaunch(&handle, reinterpret_cast<void *>(packBTask<S, Epilogue>), &args,
+                   tasks);
+        ISPCSync(handle);
+
+        handle = NULL;
+        ISPCLaunch(&handle, reinterpret_cast<void *>(computeTask<S, Epilogue>), &args,
+                   tasks);
+        ISPCSync(handle);
+      }
+    }
+
+    GemmMemory::release(GemmMemory::ParallelB, args.packedB);
+    lastThreads = tasks;
+  }
+
+  static void gemm(int m, int n, int k, T *A, T *B, T *C, T alpha, T beta) {
+    gemmUsingBlock(m, n, k, alpha, A, k, 1, B, n, 1, beta, C, n);
+  }
+};
+
+/**
+ * @brief Batched GEMM of many small row-major matrices. Packing and task
+ * launches cost more than the multiplication itself at these sizes, so
+ * every matrix is multiplied straight from its storage by one task, and
+ * the batch is split across the tasks.
+ *
+ * @details Square sizes 8, 16, 32 and 64 use kernels whose loop bounds are
+ * template arguments, so the compiler fully unrolls and vectorizes the row
+ * of accumulators. Other shapes up to `maxSize` use the same loops with
+ * runtime bounds, larger ones go through the packed single-threaded path.
+ *
+ */
+template <typename T> class GemmSmall {
+public:
+  /**
+   * @brief Disable constructing this class
+   *
+   */
+  GemmSmall() = delete;
+
+  static const int maxSize = 64;
+
+  typedef void (*Kernel)(int m, int n, int k, T alpha, const T *A, int lda,
+                         const T *B, int ldb, T beta, T *C, int ldc);
+
+  /**
+   * @brief One row of C at a time: the row of `acc` stays in registers
+   * while A(i, :) is broadcast against the rows of B.
+   *
+   */
+  template <int M, int N, int K>
+  static void fixed(int, int, int, T alpha, const T *A, int lda, const T *B,
+                    int ldb, T beta, T *C, int ldc) {
+    for (int i = 0; i < M; i++) {
+      T acc[N] = {};
+      for (int p = 0; p < K; p++) {
+        T a = A[i * lda + p];
+        const T *row = B + p * ldb;
+        for (int j = 0; j < N; j++) {
+          acc[j] += a * row[j];
+        }
+      }
+      T *out = C + i * ldc;
+      for (int j = 0; j < N; j++) {
+        out[j] = beta == 0 ? alpha * acc[j] : alpha * acc[j] + beta * out[j];
+      }
+    }
+  }
+
+  static void generic(int m, int n, int k, T alpha, const T *A, int lda,
+                      const T *B, int ldb, T beta, T *C, int ldc) {
+    for (int i = 0; i < m; i++) {
+      T acc[maxSize] = {};
+      for (int p = 0; p < k; p++) {
+        T a = A[i * lda + p];
+        const T *row = B + p * ldb;
+        for (int j = 0; j < n; j++) {
+          acc[j] += a * row[j];
+        }
+      }
+      T *out = C + i * ldc;
+      for (int j = 0; j < n; j++) {
+        out[j] = beta == 0 ? alpha * acc[j] : alpha * acc[j] + beta * out[j];
+      }
+    }
+  }
+
+  static void packed(int m, int n, int k, T alpha, const T *A, int lda,
+                     const T *B, int ldb, T beta, T *C, int ldc) {
+    GemmBlockWithThreeCacheLevel<T>::gemmUsingBlock(m, n, k, alpha, A, lda, 1,
+                                                    B, ldb, 1, beta, C, ldc);
+  }
+
+  static Kernel select(int m, int n, int k) {
+    if (m == n && n == k) {
+      switch (m) {
+      case 8:
+        return fixed<8, 8, 8>;
+      case 16:
+        return fixed<16, 16, 16>;
+      case 32:
+        return fixed<32, 32, 32>;
+      case 64:
+        return fixed<64, 64, 64>;
+      }
+    }
+    if (n <= maxSize && m <= maxSize && k <= maxSize) {
+      return generic;
+    }
+    return packed;
+  }
+
+  struct Args {
+    int m, n, k;
+    T alpha, beta;
+    const T *A, *B;
+    T *C;
+    int lda, ldb, ldc;
+    long strideA, strideB, strideC;
+    int batchCount;
+    Kernel kernel;
+  };
+
+  static void batchTask(void *data, int threadIndex, int threadCount,
+                        int taskIndex, int taskCount) {
+    Args *args = static_cast<Args *>(data);
+    int b0 = GemmParallelBase::split(args->batchCount, taskCount, taskIndex, 1);
+    int b1 =
+        GemmParallelBase::split(args->batchCount, taskCount, taskIndex + 1, 1);
+    for (int b = b0; b < b1; b++) {
+      args->kernel(args->m, args->n, args->k, args->alpha,
+                   args->A + b * args->strideA, args->lda,
+                   args->B + b * args->strideB, args->ldb, args->beta,
+                   args->C + b * args->strideC, args->ldc);
+    }
+  }
+
+  static void gemmBatched(int m, int n, int k, T alpha, const T *A, int lda,
+                          long strideA, const T *B, int ldb, long strideB,
+                          T beta, T *C, int ldc, long strideC,
+                          int batchCount) {
+    int tasks = GemmParallelBase::taskCount();
+    tasks = tasks < batchCount ? tasks : batchCount;
+
+    Args args;
+    args.m = m;
+    args.n = n;
+    args.k = k;
+    args.alpha = alpha;
+    args.beta = beta;
+    args.A = A;
+    args.B = B;
+    args.C = C;
+    args.lda = lda;
+    args.ldb = ldb;
+    args.ldc = ldc;
+    args.strideA = strideA;
+    args.strideB = strideB;
+    args.strideC = strideC;
+    args.batchCount = batchCount;
+    args.kernel = select(m, n, k);
+
+    void *handle = NULL;
+    ISPCLaunch(&handle, reinterpret_cast<void *>(batchTask), &args, tasks);
+    ISPCSync(handle);
+  }
+};
+
+/**
+ * @brief Strassen-Winograd recursion (7 multiplications and 15 additions
+ * per level) on top of the packed kernels, for very large multiplies.
+ *
+ * @details Every level splits A, B and C into quadrants; products of
+ * sub-matrices of at most `cutoff` in some dimension go to the classical
+ * kernel. Odd dimensions are peeled: the even part recurses and the last
+ * row, column or rank-1 term is fixed up classically.
+ *
+ * The top `parallelDepth` levels run the seven products as tasks (one
+ * level is enough for 7 threads, two for 49). Those levels keep all the
+ * operands and products alive at once: 4 S + 4 T + 7 P quadrants. Below
+ * them the products run one at a time with the schedule in `serialLevel`,
+ * which only needs three quadrant temporaries and accumulates straight
+ * into C. All temporaries come from one arena sized up front by
+ * `workspace`, which mirrors the recursion.
+ *
+ * Strassen trades accuracy for speed: the error bound grows by roughly a
+ * constant factor per level, so `main` reports it against the classical
+ * result.
+ *
+ */
+class GemmStrassen {
+public:
+  /**
+   * @brief Disable constructing this class
+   *
+   */
+  GemmStrassen() = delete;
+
+  /**
+   * @brief Products with a dimension at or below `cutoff` are classical
+   *
+   */
+  static int cutoff;
+
+  struct Context {
+    int cutoff;
+    int parallelDepth;
+  };
+
+  static bool isLeaf(const Context &ctx, int m, int n, int k) {
+    int smallest = m < n ? (m < k ? m : k) : (n < k ? n : k);
+    return smallest <= ctx.cutoff;
+  }
+
+  /**
+   * @brief Doubles of workspace the recursion below (m, n, k) needs
+   *
+   */
+  static long workspace(const Context &ctx, int m, int n, int k, int depth) {
+    if (isLeaf(ctx, m, n, k)) {
+      return 0;
+    }
+    long hm = m / 2, hn = n / 2, hk = k / 2;
+    long child = workspace(ctx, hm, hn, hk, depth + 1);
+    if (depth < ctx.parallelDepth) {
+      return 4 * hm * hk + 4 * hk * hn + 7 * hm * hn + 7 * child;
+    }
+    return hm * hk + hk * hn + hm * hn + child;
+  }
+
+  /**
+   * @brief `out = ca * a + cb * b` on `rows x cols` views, `out` may be
+   * `a` or `b`
+   *
+   */
+  static void linear(int rows, int cols, double *out, long ldo, double ca,
+                     const double *a, long lda, double cb, const double *b,
+                     long ldb) {
+    for (int i = 0; i < rows; i++) {
+      double *o = out + i * ldo;
+      const double *x = a + i * lda;
+      const double *y = b + i * ldb;
+      for (int j = 0; j < cols; j++) {
+        o[j] = ca * x[j] + cb * y[j];
+      }
+    }
+  }
+
+  /**
+   * @brief `C = beta * C`, C is not read when `beta` is zero
+   *
+   */
+  static void scale(int rows, int cols, double *C, long ldc, double beta) {
+    if (beta == 1.0) {
+      return;
+    }
+    for (int i = 0; i < rows; i++) {
+      for (int j = 0; j < cols; j++) {
+        C[i * ldc + j] = beta == 0.0 ? 0.0 : beta * C[i * ldc + j];
+      }
+    }
+  }
+
+  /**
+   * @brief The classical kernel: the parallel one on the calling thread,
+   * the serial one inside the tasks of a parallel level
+   *
+   */
+  static void classical(const Context &ctx, int depth, int m, int n, int k,
+                        double alpha, const double *A, long lda,
+                        const double *B, long ldb, double beta, double *C,
+                        long ldc) {
+    if (depth > 0 && ctx.parallelDepth > 0) {
+      GemmBlockWithThreeCacheLevel<double>::gemmUsingBlock(
+          m, n, k, alpha, A, lda, 1, B, ldb, 1, beta, C, ldc);
+    } else {
+      GemmParallel<double>::gemmUsingBlock(m, n, k, alpha, A, lda, 1, B, ldb,
+                                           1, beta, C, ldc);
+    }
+  }
+
+  /**
+   * @brief `C = alpha * A x B + beta * C` on row-major views, `k > 0`
+   *
+   */
+  static void multiply(const Context &ctx, int depth, int m, int n, int k,
+                       double alpha, const double *A, long lda,
+                       const double *B, long ldb, double beta, double *C,
+                       long ldc, double *ws) {
+    if (isLeaf(ctx, m, n, k)) {
+      classical(ctx, depth, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+      return;
+    }
+
+    int m2 = m & ~1, n2 = n & ~1, k2 = k & ~1;
+    if (depth < ctx.parallelDepth) {
+      parallelLevel(ctx, depth, m2, n2, k2, alpha, A, lda, B, ldb, beta, C,
+                    ldc, ws);
+    } else {
+      serialLevel(ctx, depth, m2, n2, k2, alpha, A, lda, B, ldb, beta, C, ldc,
+                  ws);
+    }
+
+    // Peel the odd row, column and rank-1 term
+    if (k2 < k) {
+      classical(ctx, depth, m2, n2, 1, alpha, A + k2, lda, B + k2 * ldb, ldb,
+                1.0, C, ldc);
+    }
+    if (n2 < n) {
+      classical(ctx, depth, m, 1, k, alpha, A, lda, B + n2, ldb, beta, C + n2,
+                ldc);
+    }
+    if (m2 < m) {
+      classical(ctx, depth, 1, n2, k, alpha, A + m2 * lda, lda, B, ldb, beta,
+                C + m2 * ldc, ldc);
+    }
+  }
+
+  /**
+   * @brief One level with the products in sequence, for even m, n, k.
+   * C is scaled by beta first, then every product is either accumulated
+   * straight into its quadrant of C or computed into Z and added to the
+   * quadrants that use it:
+   *   C11 = P1 + P2, C12 = P1 + P6 + P5 + P3,
+   *   C21 = P1 + P6 + P7 - P4, C22 = P1 + P6 + P7 + P5.
+   * S2, S4 and T2, T4 are built in place from S1 and T1, as in Winograd's
+   * schedule.
+   *
+   */
+  static void serialLevel(const Context &ctx, int depth, int m, int n, int k,
+                          double alpha, const double *A, long lda,
+                          const double *B, long ldb, double beta, double *C,
+                          long ldc, double *ws) {
+    int hm = m / 2, hn = n / 2, hk = k / 2;
+    const double *A11 = A, *A12 = A + hk;
+    const double *A21 = A + hm * lda, *A22 = A21 + hk;
+    const double *B11 = B, *B12 = B + hn;
+    const double *B21 = B + hk * ldb, *B22 = B21 + hn;
+    double *C11 = C, *C12 = C + hn;
+    double *C21 = C + hm * ldc, *C22 = C21 + hn;
+
+    double *X = ws;
+    double *Y = X + (long)hm * hk;
+    double *Z = Y + (long)hk * hn;
+    double *child = Z + (long)hm * hn;
+
+    scale(m, n, C, ldc, beta);
+
+    // P5 = S1 T1
+    linear(hm, hk, X, hk, 1.0, A21, lda, 1.0, A22, lda);
+    linear(hk, hn, Y, hn, 1.0, B12, ldb, -1.0, B11, ldb);
+    multiply(ctx, depth + 1, hm, hn, hk, 1.0, X, hk, Y, hn, 0.0, Z, hn, child);
+    linear(hm, hn, C12, ldc, 1.0, C12, ldc, alpha, Z, hn);
+    linear(hm, hn, C22, ldc, 1.0, C22, ldc, alpha, Z, hn);
+
+    // P6 = S2 T2
+    linear(hm, hk, X, hk, 1.0, X, hk, -1.0, A11, lda);
+    linear(hk, hn, Y, hn, 1.0, B22, ldb, -1.0, Y, hn);
+    multiply(ctx, depth + 1, hm, hn, hk, 1.0, X, hk, Y, hn, 0.0, Z, hn, child);
+    linear(hm, hn, C12, ldc, 1.0, C12, ldc, alpha, Z, hn);
+    linear(hm, hn, C21, ldc, 1.0, C21, ldc, alpha, Z, hn);
+    linear(hm, hn, C22, ldc, 1.0, C22, ldc, alpha, Z, hn);
+
+    // P3 = S4 B22 into C12, P4 = A22 T4 out of C21
+    linear(hm, hk, X, hk, 1.0, A12, lda, -1.0, X, hk);
+    multiply(ctx, depth + 1, hm, hn, hk, alpha, X, hk, B22, ldb, 1.0, C12, ldc,
+             child);
+    linear(hk, hn, Y, hn, 1.0, Y, hn, -1.0, B21, ldb);
+    multiply(ctx, depth + 1, hm, hn, hk, -alpha, A22, lda, Y, hn, 1.0, C21,
+             ldc, child);
+
+    // P7 = S3 T3
+    linear(hm, hk, X, hk, 1.0, A11, lda, -1.0, A21, lda);
+    linear(hk, hn, Y, hn, 1.0, B22, ldb, -1.0, B12, ldb);
+    multiply(ctx, depth + 1, hm, hn, hk, 1.0, X, hk, Y, hn, 0.0, Z, hn, child);
+    linear(hm, hn, C21, ldc, 1.0, C21, ldc, alpha, Z, hn);
+    linear(hm, hn, C22, ldc, 1.0, C22, ldc, alpha, Z, hn);
+
+    // P1 = A11 B11 into every quadrant, P2 = A12 B21 into C11
+    multiply(ctx, depth + 1, hm, hn, hk, 1.0, A11, lda, B11, ldb, 0.0, Z, hn,
+             child);
+    linear(hm, hn, C11, ldc, 1.0, C11, ldc, alpha, Z, hn);
+    linear(hm, hn, C12, ldc, 1.0, C12, ldc, alpha, Z, hn);
+    linear(hm, hn, C21, ldc, 1.0, C21, ldc, alpha, Z, hn);
+    linear(hm, hn, C22, ldc, 1.0, C22, ldc, alpha, Z, hn);
+    multiply(ctx, depth + 1, hm, hn, hk, alpha, A12, lda, B21, ldb, 1.0, C11,
+             ldc, child);
+  }
+
+  /**
+   * @brief Everything the tasks of a parallel level share
+   *
+   */
+  struct LevelArgs {
+    const Context *ctx;
+    int depth;
+    int hm, hn, hk;
+    double alpha, beta;
+    const double *A11, *A12, *A21, *A22;
+    const double *B11, *B12, *B21, *B22;
+    double *C11, *C12, *C21, *C22;
+    long lda, ldb, ldc;
+    double *S[4], *T[4], *P[7];
+    double *child[7];
+  };
+
+  /**
+   * @brief Tasks 0-3 build S1..S4, tasks 4-7 build T1..T4, each straight
+   * from the quadrants so they do not depend on each other
+   *
+   */
+  static void operandTask(void *data, int threadIndex, int threadCount,
+                          int taskIndex, int taskCount) {
+    LevelArgs *a = static_cast<LevelArgs *>(data);
+    int hm = a->hm, hn = a->hn, hk = a->hk;
+    long lda = a->lda, ldb = a->ldb;
+
+    switch (taskIndex) {
+    case 0: // S1 = A21 + A22
+      linear(hm, hk, a->S[0], hk, 1.0, a->A21, lda, 1.0, a->A22, lda);
+      break;
+    case 1: // S2 = S1 - A11
+      linear(hm, hk, a->S[1], hk, 1.0, a->A21, lda, 1.0, a->A22, lda);
+      linear(hm, hk, a->S[1], hk, 1.0, a->S[1], hk, -1.0, a->A11, lda);
+      break;
+    case 2: // S3 = A11 - A21
+      linear(hm, hk, a->S[2], hk, 1.0, a->A11, lda, -1.0, a->A21, lda);
+      break;
+    case 3: // S4 = A12 - S2
+      linear(hm, hk, a->S[3], hk, 1.0, a->A12, lda, -1.0, a->A21, lda);
+      linear(hm, hk, a->S[3], hk, 1.0, a->S[3], hk, -1.0, a->A22, lda);
+      linear(hm, hk, a->S[3], hk, 1.0, a->S[3], hk, 1.0, a->A11, lda);
+      break;
+    case 4: // T1 = B12 - B11
+      linear(hk, hn, a->T[0], hn, 1.0, a->B12, ldb, -1.0, a->B11, ldb);
+      break;
+    case 5: // T2 = B22 - T1
+      linear(hk, hn, a->T[1], hn, 1.0, a->B22, ldb, -1.0, a->B12, ldb);
+      linear(hk, hn, a->T[1], hn, 1.0, a->T[1], hn, 1.0, a->B11, ldb);
+      break;
+    case 6: // T3 = B22 - B12
+      linear(hk, hn, a->T[2], hn, 1.0, a->B22, ldb, -1.0, a->B12, ldb);
+      break;
+    case 7: // T4 = T2 - B21
+      linear(hk, hn, a->T[3], hn, 1.0, a->B22, ldb, -1.0, a->B12, ldb);
+      linear(hk, hn, a->T[3], hn, 1.0, a->T[3], hn, 1.0, a->B11, ldb);
+      linear(hk, hn, a->T[3], hn, 1.0, a->T[3], hn, -1.0, a->B21, ldb);
+      break;
+    }
+  }
+
+  /**
+   * @brief Task i computes P(i+1), recursing with its own workspace
+   *
+   */
+  static void productTask(void *data, int threadIndex, int threadCount,
+                          int taskIndex, int taskCount) {
+    LevelArgs *a = static_cast<LevelArgs *>(data);
+    int hm = a->hm, hn = a->hn, hk = a->hk;
+    const double *X, *Y;
+    long ldx, ldy;
+
+    switch (taskIndex) {
+    case 0: // P1 = A11 B11
+      X = a->A11, ldx = a->lda, Y = a->B11, ldy = a->ldb;
+      break;
+    case 1: // P2 = A12 B21
+      X = a->A12, ldx = a->lda, Y = a->B21, ldy = a->ldb;
+      break;
+    case 2: // P3 = S4 B22
+      X = a->S[3], ldx = hk, Y = a->B22, ldy = a->ldb;
+      break;
+    case 3: // P4 = A22 T4
+      X = a->A22, ldx = a->lda, Y = a->T[3], ldy = hn;
+      break;
+    case 4: // P5 = S1 T1
+      X = a->S[0], ldx = hk, Y = a->T[0], ldy = hn;
+      break;
+    case 5: // P6 = S2 T2
+      X = a->S[1], ldx = hk, Y = a->T[1], ldy = hn;
+      break;
+    default: // P7 = S3 T3
+      X = a->S[2], ldx = hk, Y = a->T[2], ldy = hn;
+      break;
+    }
+    multiply(*a->ctx, a->depth + 1, hm, hn, hk, 1.0, X, ldx, Y, ldy, 0.0,
+             a->P[taskIndex], hn, a->child[taskIndex]);
+  }
+
+  /**
+   * @brief Task q assembles quadrant q of C from the products
+   *
+   */
+  static void combineTask(void *data, int threadIndex, int threadCount,
+                          int taskIndex, int taskCount) {
+    LevelArgs *a = static_cast<LevelArgs *>(data);
+    int hm = a->hm, hn = a->hn;
+    long ldc = a->ldc;
+    double alpha = a->alpha;
+    double **P = a->P;
+    double *Cq;
+    // Products summed into the quadrant, negative entries are subtracted
+    int terms[4];
+
+    switch (taskIndex) {
+    case 0: // C11 = P1 + P2
+      Cq = a->C11, terms[0] = 1, terms[1] = 2, terms[2] = 0, terms[3] = 0;
+      break;
+    case 1: // C12 = P1 + P6 + P5 + P3
+      Cq = a->C12, terms[0] = 1, terms[1] = 6, terms[2] = 5, terms[3] = 3;
+      break;
+    case 2: // C21 = P1 + P6 + P7 - P4
+      Cq = a->C21, terms[0] = 1, terms[1] = 6, terms[2] = 7, terms[3] = -4;
+      break;
+    default: // C22 = P1 + P6 + P7 + P5
+      Cq = a->C22, terms[0] = 1, terms[1] = 6, terms[2] = 7, terms[3] = 5;
+      break;
+    }
+
+    scale(hm, hn, Cq, ldc, a->beta);
+    for (int t = 0; t < 4 && terms[t] != 0; t++) {
+      int p = terms[t] > 0 ? terms[t] - 1 : -terms[t] - 1;
+      double sign = terms[t] > 0 ? alpha : -alpha;
+      linear(hm, hn, Cq, ldc, 1.0, Cq, ldc, sign, P[p], hn);
+    }
+  }
+
+  /**
+   * @brief One level with the seven products running as tasks, for even
+   * m, n, k. Operands, products and the assembly of C are three launches.
+   *
+   */
+  static void parallelLevel(const Context &ctx, int depth, int m, int n,
+                            int k, double alpha, const double *A, long lda,
+                            const double *B, long ldb, double beta, double *C,
+                            long ldc, double *ws) {
+    LevelArgs a;
+    a.ctx = &ctx;
+    a.depth = depth;
+    a.hm = m / 2;
+    a.hn = n / 2;
+    a.hk = k / 2;
+    a.alpha = alpha;
+    a.beta = beta;
+    a.lda = lda;
+    a.ldb = ldb;
+    a.ldc = ldc;
+    a.A11 = A;
+    a.A12 = A + a.hk;
+    a.A21 = A + a.hm * lda;
+    a.A22 = a.A21 + a.hk;
+    a.B11 = B;
+    a.B12 = B + a.hn;
+    a.B21 = B + a.hk * ldb;
+    a.B22 = a.B21 + a.hn;
+    a.C11 = C;
+    a.C12 = C + a.hn;
+    a.C21 = C + a.hm * ldc;
+    a.C22 = a.C21 + a.hn;
+
+    long sizeS = (long)a.hm * a.hk, sizeT = (long)a.hk * a.hn;
+    long sizeP = (long)a.hm * a.hn;
+    long child = workspace(ctx, a.hm, a.hn, a.hk, depth + 1);
+    for (int i = 0; i < 4; i++) {
+      a.S[i] = ws;
+      ws += sizeS;
+      a.T[i] = ws;
+      ws += sizeT;
+    }
+    for (int i = 0; i < 7; i++) {
+      a.P[i] = ws;
+      ws += sizeP;
+      a.child[i] = ws;
+      ws += child;
+    }
+
+    void *handle = NULL;
+    ISPCLaunch(&handle, reinterpret_cast<void *>(operandTask), &a, 8);
+    ISPCSync(handle);
+    handle = NULL;
+    ISPCLaunch(&handle, reinterpret_cast<void *>(productTask), &a, 7);
+    ISPCSync(handle);
+    handle = NULL;
+    ISPCLaunch(&handle, reinterpret_cast<void *>(combineTask), &a, 4);
+    ISPCSync(handle);
+  }
+
+  /**
+   * @brief The arena is kept between calls and only grows, so repeated
+   * multiplies do not fault in fresh pages every time. Calls must
+   * therefore not overlap.
+   *
+   */
+  static double *arena;
+  static long arenaSize;
+
+  static void gemmUsingBlock(int m, int n, int k, double alpha,
+                             const double *A, long lda, const double *B,
+                             long ldb, double beta, double *C, long ldc) {
+    // Initialize the blocking before tasks can race on it
+    GemmConfig::blocking();
+
+    Context ctx;
+    ctx.cutoff = cutoff > 1 ? cutoff : 1;
+    ctx.parallelDepth = 0;
+
+    // Enough parallel levels to give every thread a product, as long as
+    // the recursion goes that deep
+    int tasks = GemmParallelBase::taskCount();
+    int levels = 0;
+    for (int mm = m, nn = n, kk = k; !isLeaf(ctx, mm, nn, kk);
+         mm /= 2, nn /= 2, kk /= 2) {
+      levels++;
+    }
+    for (long products = 1; products < tasks && ctx.parallelDepth < levels;
+         products *= 7) {
+      ctx.parallelDepth++;
+    }
+
+    long need = workspace(ctx, m, n, k, 0);
+    if (need > arenaSize) {
+      free(arena);
+      arena = static_cast<double *>(GemmMemory::allocate(sizeof(double) * need));
+      arenaSize = need;
+    }
+
+    multiply(ctx, 0, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, arena);
+  }
+
+  static void gemm(int m, int n, int k, double *A, double *B, double *C,
+                   double alpha, double beta) {
+    gemmUsingBlock(m, n, k, alpha, A, k, B, n, beta, C, n);
+  }
+};
+
+int GemmStrassen::cutoff = 512;
+double *GemmStrassen::arena = NULL;
+long GemmStrassen::arenaSize = 0;
+
+void gemmSetNumThreads(int numThreads) {
+  GemmParallelBase::numThreads = numThreads;
+}
+
+void gemmSetStrassenCutoff(int cutoff) { GemmStrassen::cutoff = cutoff; }
+
+void gemmSetMemoryOptions(bool hugePages, bool cacheWorkspace) {
+  GemmMemory::hugePages = hugePages;
+  GemmMemory::cacheWorkspace = cacheWorkspace;
+}
+
+struct FirstTouchArgs {
+  char *buffer;
+  size_t bytes;
+};
+
+// Zero one share of the pages, so they land on the NUMA node of the
+// thread that wrote them first
+static void firstTouchTask(void *data, int threadIndex, int threadCount,
+                           int taskIndex, int taskCount) {
+  FirstTouchArgs *args = static_cast<FirstTouchArgs *>(data);
+  size_t pages = (args->bytes + 4095) / 4096;
+  size_t begin = pages * taskIndex / taskCount * 4096;
+  size_t end = pages * (taskIndex + 1) / taskCount * 4096;
+  end = end < args->bytes ? end : args->bytes;
+  if (end > begin) {
+    memset(args->buffer + begin, 0, end - begin);
+  }
+}
+
+void *gemmAlloc(size_t bytes) {
+  FirstTouchArgs args;
+  args.buffer = static_cast<char *>(GemmMemory::allocate(bytes));
+  args.bytes = bytes;
+  if (args.buffer == NULL) {
+    return NULL;
+  }
+
+  int tasks = GemmParallelBase::taskCount();
+  void *handle = NULL;
+  ISPCLaunch(&handle, reinterpret_cast<void *>(firstTouchTask), &args, tasks);
+  ISPCSync(handle);
+  return args.buffer;
+}
+
+void gemmFree(void *ptr) { free(ptr); }
+
+int gemmThreadGFLOPS(double *gflops, int maxThreads) {
+  int count = GemmParallelBase::lastThreads < maxThreads ? GemmParallelBase::lastThreads
+                                                     : maxThreads;
+  for (int t = 0; t < count; t++) {
+    gflops[t] = GemmParallelBase::threadSeconds[t] > 0
+                    ? GemmParallelBase::threadFlops[t] /
+                          GemmParallelBase::threadSeconds[t] / 1e9
+                    : 0.0;
+  }
+  return count;
+}
+
+void gemmGetBlocking(GemmBlockingInfo *info) {
+  const GemmConfig::Blocking &blocking = GemmConfig::blocking();
+  info->l1 = GemmConfig::cacheSize[1];
+  info->l2 = GemmConfig::cacheSize[2];
+  info->l3 = GemmConfig::cacheSize[3];
+  info->mc = blocking.mc;
+  info->kc = blocking.kc;
+  info->nc = blocking.nc;
+  info->source = blocking.source;
+}
+
+void gemmAutotune(const char *cacheFile) {
+  GemmConfig::Blocking base = GemmConfig::blocking();
+  const long *cacheSize = GemmConfig::cacheSize;
+
+  // Lines of the cache file are "l1 l2 l3 mc kc nc", one per CPU type
+  if (cacheFile != NULL) {
+    FILE *file = fopen(cacheFile, "r");
+    if (file != NULL) {
+      long l1, l2, l3;
+      int mc, kc, nc;
+      while (fscanf(file, "%ld %ld %ld %d %d %d", &l1, &l2, &l3, &mc, &kc,
+                    &nc) == 6) {
+        if (l1 == cacheSize[1] && l2 == cacheSize[2] && l3 == cacheSize[3]) {
+          GemmConfig::setBlocking(mc, kc, nc, "cached");
+          fclose(file);
+          return;
+        }
+      }
+      fclose(file);
+    }
+  }
+
+  // Time a few blockings around the analytical one. When kc changes, mc
+  // is scaled the other way first so the block of A keeps its L2
+  // footprint. nc is left alone, the test problem is narrower than it.
+  const int size = 768;
+  const double kFactors[] = {0.5, 0.75, 1.0, 1.5};
+  const double mFactors[] = {0.5, 1.0, 2.0};
+  double *A = static_cast<double *>(aligned_alloc(64, sizeof(double) * size * size));
+  double *B = static_cast<double *>(aligned_alloc(64, sizeof(double) * size * size));
+  double *C = static_cast<double *>(aligned_alloc(64, sizeof(double) * size * size));
+  for (int i = 0; i < size * size; i++) {
+    A[i] = 1.0 / (i % 7 + 1);
+    B[i] = 1.0 / (i % 5 + 1);
+    C[i] = 0.0;
+  }
+
+  int bestMc = base.mc, bestKc = base.kc;
+  double bestTime = 1e30;
+  for (double kf : kFactors) {
+    for (double mf : mFactors) {
+      int kc = static_cast<int>(base.kc * kf);
+      int mc = static_cast<int>(base.mc / kf * mf);
+      GemmConfig::setBlocking(mc, kc, base.nc, "tuned");
+
+      double time = 1e30;
+      for (int rep = 0; rep < 2; rep++) {
+        double start = CycleTimer::currentSeconds();
+        GemmParallel<double>::gemm(size, size, size, A, B, C, 1.0, 0.0);
+        double elapsed = CycleTimer::currentSeconds() - start;
+        time = elapsed < time ? elapsed : time;
+      }
+      if (time < bestTime) {
+        bestTime = time;
+        bestMc = GemmConfig::blocking().mc;
+        bestKc = GemmConfig::blocking().kc;
+      }
+    }
+  }
+  free(A);
+  free(B);
+  free(C);
+
+  GemmConfig::setBlocking(bestMc, bestKc, base.nc, "tuned");
+
+  if (cacheFile != NULL) {
+    FILE *file = fopen(cacheFile, "a");
+    if (file == NULL) {
+      fprintf(stderr, "gemmAutotune: cannot write %s\n", cacheFile);
+      return;
+    }
+    const GemmConfig::Blocking &blocking = GemmConfig::blocking();
+    fprintf(file, "%ld %ld %ld %d %d %d\n", cacheSize[1], cacheSize[2],
+            cacheSize[3], blocking.mc, blocking.kc, blocking.nc);
+    fclose(file);
+  }
+}
+
+/**
+ * @brief Argument checks and layout handling shared by the BLAS entry
+ * points. `T` is the type the arithmetic and C use, `S` the storage type
+ * of A and B. An epilogue indexes C by row and column, so it is only
+ * passed with `GemmRowMajor`.
+ *
+ */
+template <typename T, typename S, typename Epilogue = GemmNoEpilogue>
+static void gemmDispatch(const char *name, GemmLayout layout,
+                         GemmTranspose transA, GemmTranspose transB, int m,
+                         int n, int k, T alpha, const S *A, int lda,
+                         const S *B, int ldb, T beta, T *C, int ldc,
+                         const Epilogue &epilogue = Epilogue()) {
+  // A column-major C = op(A) op(B) is the row-major C^T = op(B)^T op(A)^T,
+  // so swap the operands and solve the row-major problem.
+  if (layout == GemmColMajor) {
+    gemmDispatch(name, GemmRowMajor, transB, transA, n, m, k, alpha, B, ldb,
+                 A, lda, beta, C, ldc);
+    return;
+  }
+
+  int colsA = transA == GemmNoTrans ? k : m;
+  int colsB = transB == GemmNoTrans ? n : k;
+  const char *error = NULL;
+  if (m < 0 || n < 0 || k < 0) {
+    error = "negative dimension";
+  } else if (lda < (colsA > 1 ? colsA : 1)) {
+    error = "lda is too small";
+  } else if (ldb < (colsB > 1 ? colsB : 1)) {
+    error = "ldb is too small";
+  } else if (ldc < (n > 1 ? n : 1)) {
+    error = "ldc is too small";
+  }
+  if (error != NULL) {
+    fprintf(stderr, "%s: %s (m=%d n=%d k=%d lda=%d ldb=%d ldc=%d)\n", name,
+            error, m, n, k, lda, ldb, ldc);
+    return;
+  }
+
+  if (m == 0 || n == 0) {
+    return;
+  }
+
+  // Nothing to multiply, only C = beta * C (beta == 0 clears NaNs too)
+  if (k == 0 || alpha == 0) {
+    for (int i = 0; i < m; i++) {
+      for (int j = 0; j < n; j++) {
+        T value = beta == 0 ? 0 : beta * C[(long)i * ldc + j];
+        C[(long)i * ldc + j] = epilogue.apply(value, i, j);
+      }
+    }
+    return;
+  }
+
+  // op(A)(i, p) = A[i * rsA + p * csA], and the same for B
+  long rsA = transA == GemmNoTrans ? lda : 1;
+  long csA = transA == GemmNoTrans ? 1 : lda;
+  long rsB = transB == GemmNoTrans ? ldb : 1;
+  long csB = transB == GemmNoTrans ? 1 : ldb;
+
+  GemmParallel<T>::gemmUsingBlock(m, n, k, alpha, A, rsA, csA, B, rsB, csB,
+                                  beta, C, ldc, epilogue);
+}
+
+void dgemm(GemmLayout layout, GemmTranspose transA, GemmTranspose transB,
+           int m, int n, int k, double alpha, const double *A, int lda,
+           const double *B, int ldb, double beta, double *C, int ldc) {
+  gemmDispatch("dgemm", layout, transA, transB, m, n, k, alpha, A, lda, B, ldb,
+               beta, C, ldc);
+}
+
+void dgemmFused(GemmTranspose transA, GemmTranspose transB, int m, int n,
+                int k, double alpha, const double *A, int lda,
+                const double *B, int ldb, double beta, double *C, int ldc,
+                const GemmEpilogue *epilogue) {
+  GemmBiasActivation<GemmActivationNone> none;
+  GemmBiasActivation<GemmActivationReLU> relu;
+  GemmBiasActivation<GemmActivationGELU> gelu;
+  none.bias = relu.bias = gelu.bias = epilogue->bias;
+  none.rowScale = relu.rowScale = gelu.rowScale = epilogue->rowScale;
+
+  switch (epilogue->activation) {
+  case GemmActivationReLU:
+    gemmDispatch("dgemmFused", GemmRowMajor, transA, transB, m, n, k, alpha,
+                 A, lda, B, ldb, beta, C, ldc, relu);
+    break;
+  case GemmActivationGELU:
+    gemmDispatch("dgemmFused", GemmRowMajor, transA, transB, m, n, k, alpha,
+                 A, lda, B, ldb, beta, C, ldc, gelu);
+    break;
+  default:
+    gemmDispatch("dgemmFused", GemmRowMajor, transA, transB, m, n, k, alpha,
+                 A, lda, B, ldb, beta, C, ldc, none);
+    break;
+  }
+}
+
+void sgemm(GemmLayout layout, GemmTranspose transA, GemmTranspose transB,
+           int m, int n, int k, float alpha, const float *A, int lda,
+           const float *B, int ldb, float beta, float *C, int ldc) {
+  gemmDispatch("sgemm", layout, transA, transB, m, n, k, alpha, A, lda, B, ldb,
+               beta, C, ldc);
+}
+
+void sbgemm(GemmLayout layout, GemmTranspose transA, GemmTranspose transB,
+            int m, int n, int k, float alpha, const GemmBf16 *A, int lda,
+            const GemmBf16 *B, int ldb, float beta, float *C, int ldc) {
+  gemmDispatch("sbgemm", layout, transA, transB, m, n, k, alpha, A, lda, B,
+               ldb, beta, C, ldc);
+}
+
+void shgemm(GemmLayout layout, GemmTranspose transA, GemmTranspose transB,
+            int m, int n, int k, float alpha, const GemmFp16 *A, int lda,
+            const GemmFp16 *B, int ldb, float beta, float *C, int ldc) {
+  gemmDispatch("shgemm", layout, transA, transB, m, n, k, alpha, A, lda, B,
+               ldb, beta, C, ldc);
+}
+
+/**
+ * @brief Checks shared by the batched entry points
+ *
+ */
+template <typename T>
+static void gemmBatchedDispatch(const char *name, int m, int n, int k,
+                                T alpha, const T *A, int lda, long strideA,
+                                const T *B, int ldb, long strideB, T beta,
+                                T *C, int ldc, long strideC, int batchCount) {
+  if (m < 0 || n < 0 || k < 0 || batchCount < 0 || lda < (k > 1 ? k : 1) ||
+      ldb < (n > 1 ? n : 1) || ldc < (n > 1 ? n : 1)) {
+    fprintf(stderr, "%s: invalid arguments (m=%d n=%d k=%d lda=%d ldb=%d "
+                    "ldc=%d batch=%d)\n",
+            name, m, n, k, lda, ldb, ldc, batchCount);
+    return;
+  }
+  if (m == 0 || n == 0 || batchCount == 0) {
+    return;
+  }
+  if (k == 0 || alpha == 0) {
+    for (int b = 0; b < batchCount; b++) {
+      T *Cb = C + b * strideC;
+      for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+          Cb[i * ldc + j] = beta == 0 ? 0 : beta * Cb[i * ldc + j];
+        }
+      }
+    }
+    return;
+  }
+  GemmSmall<T>::gemmBatched(m, n, k, alpha, A, lda, strideA, B, ldb, strideB,
+                            beta, C, ldc, strideC, batchCount);
+}
+
+void dgemmBatched(int m, int n, int k, double alpha, const double *A, int lda,
+                  long strideA, const double *B, int ldb, long strideB,
+                  double beta, double *C, int ldc, long strideC,
+                  int batchCount) {
+  gemmBatchedDispatch("dgemmBatched", m, n, k, alpha, A, lda, strideA, B, ldb,
+                      strideB, beta, C, ldc, strideC, batchCount);
+}
+
+void sgemmBatched(int m, int n, int k, float alpha, const float *A, int lda,
+                  long strideA, const float *B, int ldb, long strideB,
+                  float beta, float *C, int ldc, long strideC,
+                  int batchCount) {
+  gemmBatchedDispatch("sgemmBatched", m, n, k, alpha, A, lda, strideA, B, ldb,
+                      strideB, beta, C, ldc, strideC, batchCount);
+}
+
+void dgemmStrassen(int m, int n, int k, double alpha, const double *A,
+                   int lda, const double *B, int ldb, double beta, double *C,
+                   int ldc) {
+  const char *error = NULL;
+  if (m < 0 || n < 0 || k < 0) {
+    error = "negative dimension";
+  } else if (lda < (k > 1 ? k : 1)) {
+    error = "lda is too small";
+  } else if (ldb < (n > 1 ? n : 1)) {
+    error = "ldb is too small";
+  } else if (ldc < (n > 1 ? n : 1)) {
+    error = "ldc is too small";
+  }
+  if (error != NULL) {
+    fprintf(stderr, "dgemmStrassen: %s (m=%d n=%d k=%d lda=%d ldb=%d ldc=%d)\n",
+            error, m, n, k, lda, ldb, ldc);
+    return;
+  }
+
+  if (m == 0 || n == 0) {
+    return;
+  }
+
+  if (k == 0 || alpha == 0) {
+    GemmStrassen::scale(m, n, C, ldc, beta);
+    return;
+  }
+
+  GemmStrassen::gemmUsingBlock(m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+float gemmBf16ToFloat(GemmBf16 x) { return widen(x); }
+
+float gemmFp16ToFloat(GemmFp16 x) { return widen(x); }
+
+GemmBf16 gemmFloatToBf16(float x) {
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  GemmBf16 result;
+  if ((bits & 0x7fffffff) > 0x7f800000) {
+    // Keep NaNs quiet, rounding could turn them into infinities
+    result.bits = static_cast<uint16_t>((bits >> 16) | 0x40);
+  } else {
+    // Round to nearest, ties to even
+    bits += 0x7fff + ((bits >> 16) & 1);
+    result.bits = static_cast<uint16_t>(bits >> 16);
+  }
+  return result;
+}
+
+GemmFp16 gemmFloatToFp16(float x) {
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+  bits &= 0x7fffffff;
+  GemmFp16 result;
+
+  if (bits >= 0x7f800000) {
+    // Infinity or NaN
+    result.bits = sign | 0x7c00 | (bits > 0x7f800000 ? 0x200 : 0);
+  } else if (bits >= 0x477ff000) {
+    // Rounds past 65504, the largest half
+    result.bits = sign | 0x7c00;
+  } else if (bits < 0x38800000) {
+    // Below 2^-14: a subnormal, counted in units of 2^-24
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    result.bits = sign | static_cast<uint16_t>(lrintf(f * 16777216.0f));
+  } else {
+    uint32_t half = ((bits >> 23) - 112) << 10 | ((bits >> 13) & 0x3ff);
+    uint32_t rest = bits & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+      half++;
+    }
+    result.bits = sign | static_cast<uint16_t>(half);
+  }
+  return result;
+}
+
+static void dgemmRowMajor(int m, int n, int k, double *A, double *B,
+                          double *C, double alpha, double beta) {
+  dgemm(GemmRowMajor, GemmNoTrans, GemmNoTrans, m, n, k, alpha, A, k, B, n,
+        beta, C, n);
+}
+
+// The naive variants would take minutes on the larger shapes
+static const GemmVariant variants[] = {
+    {"Gemm", Gemm::gemm, 1L << 27, false},
+    {"GemmBlock", GemmBlock::gemm, 1L << 28, false},
+    {"GemmBlockIJK", GemmBlockIJK::gemm, 1L << 28, false},
+    {"GemmBlockWithMemoryLayoutChange", GemmBlockWithMemoryLayoutChange::gemm,
+     1L << 28, false},
+    {"GemmBlockWithThreeCacheLevel",
+     GemmBlockWithThreeCacheLevel<double>::gemm, 0, false},
+    {"GemmParallel", GemmParallel<double>::gemm, 0, true},
+    {"GemmStrassen", GemmStrassen::gemm, 0, true},
+    {"dgemm", dgemmRowMajor, 0, true},
+};
+
+int gemmVariants(const GemmVariant **list) {
+  *list = variants;
+  return sizeof(variants) / sizeof(variants[0]);
+}
+
+void gemm(int m, int n, int k, double *A, double *B, double *C, double alpha, double beta){
+  // Brute Force
+  // Gemm::gemm(m, n, k, A, B, C, alpha, beta);
+
+  // SubMatrix Multiplication
+  // GemmBlock::gemm(m, n, k, A, B, C, alpha, beta);
+
+  // SubMatrix Multiplication
+  // GemmBlockIJK::gemm(m, n, k, A, B, C, alpha, beta);
+
+  // SubMatrix Multiplication with B memory layout change
+  // GemmBlockWithMemoryLayoutChange::gemm(m, n, k, A, B, C, alpha, beta);
+
+  // Packed five-loop GEMM with an AVX2/FMA micro-kernel
+  // GemmBlockWithThreeCacheLevel<double>::gemm(m, n, k, A, B, C, alpha, beta);
+
+  // The same, split across cores with the ISPC task system
+  // GemmParallel<double>::gemm(m, n, k, A, B, C, alpha, beta);
+
+  // Strassen-Winograd above GemmStrassen::cutoff, for very large squares
+  // GemmStrassen::gemm(m, n, k, A, B, C, alpha, beta);
 
-  // GemmBlockWithThreeCacheLevel::gemm(m, n, k, A, B, C, alpha, beta);
+  // Through the BLAS interface, which adds the k == 0 / alpha == 0 cases
+  dgemm(GemmRowMajor, GemmNoTrans, GemmNoTrans, m, n, k, alpha, A, k, B, n,
+        beta, C, n);
 }
@@ -0,0 +1,135 @@
+#ifndef __GEMM_H__
+#define __GEMM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// implement: C = alpha * A x B + beta * C
+void gemm(int m, int n, int k, double *A, double *B, double *C, double alpha, double beta);
+
+enum GemmLayout { GemmRowMajor, GemmColMajor };
+enum GemmTranspose { GemmNoTrans, GemmTrans };
+
+// BLAS dgemm: C = alpha * op(A) x op(B) + beta * C, with op(X) = X or X^T,
+// C m x n, op(A) m x k, op(B) k x n. lda, ldb and ldc are the leading
+// dimensions (row stride for row-major, column stride for column-major),
+// so sub-matrices of a larger matrix can be passed directly. With
+// beta == 0, C is not read.
+void dgemm(GemmLayout layout, GemmTranspose transA, GemmTranspose transB,
+           int m, int n, int k, double alpha, const double *A, int lda,
+           const double *B, int ldb, double beta, double *C, int ldc);
+
+// Row-major dgemm followed by an element-wise epilogue, applied to each
+// tile of C while it is still in registers:
+//   C(i, j) = rowScale[i] * activation(alpha * op(A) x op(B) + beta * C
+//                                      + bias[j])
+// bias (n values) and rowScale (m values) may be NULL.
+enum GemmActivation { GemmActivationNone, GemmActivationReLU, GemmActivationGELU };
+struct GemmEpilogue {
+    const double *bias;
+    GemmActivation activation;
+    const double *rowScale;
+};
+void dgemmFused(GemmTranspose transA, GemmTranspose transB, int m, int n,
+                int k, double alpha, const double *A, int lda,
+                const double *B, int ldb, double beta, double *C, int ldc,
+                const GemmEpilogue *epilogue);
+
+// Single precision, same arguments as dgemm.
+void sgemm(GemmLayout layout, GemmTranspose transA, GemmTranspose transB,
+           int m, int n, int k, float alpha, const float *A, int lda,
+           const float *B, int ldb, float beta, float *C, int ldc);
+
+// 16-bit storage formats: bfloat16 (8 exponent bits, the upper half of a
+// float) and IEEE half precision (5 exponent bits).
+struct GemmBf16 {
+    uint16_t bits;
+};
+struct GemmFp16 {
+    uint16_t bits;
+};
+
+float gemmBf16ToFloat(GemmBf16 x);
+float gemmFp16ToFloat(GemmFp16 x);
+// Round to nearest even
+GemmBf16 gemmFloatToBf16(float x);
+GemmFp16 gemmFloatToFp16(float x);
+
+// Mixed precision: A and B stored as bf16 (sbgemm) or fp16 (shgemm),
+// products accumulated and C stored in fp32.
+void sbgemm(GemmLayout layout, GemmTranspose transA, GemmTranspose transB,
+            int m, int n, int k, float alpha, const GemmBf16 *A, int lda,
+            const GemmBf16 *B, int ldb, float beta, float *C, int ldc);
+void shgemm(GemmLayout layout, GemmTranspose transA, GemmTranspose transB,
+            int m, int n, int k, float alpha, const GemmFp16 *A, int lda,
+            const GemmFp16 *B, int ldb, float beta, float *C, int ldc);
+
+// Strided batch of small row-major GEMMs: for b in [0, batchCount),
+// C_b = alpha * A_b x B_b + beta * C_b with X_b = X + b * strideX.
+// Meant for matrices up to 64x64, which skip packing entirely.
+void dgemmBatched(int m, int n, int k, double alpha, const double *A, int lda,
+                  long strideA, const double *B, int ldb, long strideB,
+                  double beta, double *C, int ldc, long strideC,
+                  int batchCount);
+void sgemmBatched(int m, int n, int k, float alpha, const float *A, int lda,
+                  long strideA, const float *B, int ldb, long strideB,
+                  float beta, float *C, int ldc, long strideC,
+                  int batchCount);
+
+// Row-major, non-transposed dgemm through Strassen-Winograd recursion:
+// sub-products with a dimension at or below the cutoff (default 512)
+// use the packed kernel. Faster for very large matrices, at the price of
+// a larger rounding error. Calls must not overlap, the workspace is shared.
+void dgemmStrassen(int m, int n, int k, double alpha, const double *A,
+                   int lda, const double *B, int ldb, double beta, double *C,
+                   int ldc);
+void gemmSetStrassenCutoff(int cutoff);
+
+// Memory used by the GEMM. hugePages backs buffers of 2MB and more with
+// transparent huge pages, cacheWorkspace keeps the packing buffers of
+// each thread between calls. Both default to on; change them between
+// calls only.
+void gemmSetMemoryOptions(bool hugePages, bool cacheWorkspace);
+
+// 64-byte aligned matrix storage (huge pages as above), zeroed by the
+// GEMM threads so every page starts on the NUMA node of a thread that
+// uses it. Release with gemmFree.
+void *gemmAlloc(size_t bytes);
+void gemmFree(void *ptr);
+
+// Number of threads used by the multithreaded GEMM, 0 (the default)
+// means one per online core.
+void gemmSetNumThreads(int numThreads);
+
+// Fills gflops[t] with the rate achieved by thread t during the last
+// multithreaded GEMM call and returns the number of threads it used.
+int gemmThreadGFLOPS(double *gflops, int maxThreads);
+
+// Cache sizes (bytes) and the packed GEMM blocks chosen from them:
+// an mc x kc block of A, a kc x nc panel of B. source is "analytic",
+// "tuned" or "cached".
+struct GemmBlockingInfo {
+    long l1, l2, l3;
+    int mc, kc, nc;
+    const char *source;
+};
+void gemmGetBlocking(GemmBlockingInfo *info);
+
+// Refines the analytical blocking with a short timing sweep. The result
+// is appended to cacheFile (NULL: no file) under the cache sizes, so the
+// sweep runs once per CPU type even when machines share the file.
+void gemmAutotune(const char *cacheFile);
+
+// The implementations gemm() can dispatch to, for benchmarking. maxWork
+// is the largest m * n * k worth timing (0: no limit), threaded tells
+// whether gemmSetNumThreads() applies.
+struct GemmVariant {
+    const char *name;
+    void (*gemm)(int m, int n, int k, double *A, double *B, double *C,
+                 double alpha, double beta);
+    long maxWork;
+    bool threaded;
+};
+int gemmVariants(const GemmVariant **variants);
+
+#endif /* __GEMM_H__ */
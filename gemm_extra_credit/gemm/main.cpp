@@ -2,8 +2,18 @@
 #include <stdlib.h>
 #include <algorithm>
 #include <stdint.h>
+#include <string.h>
+#include <cmath>
 #include <fstream>
 #include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
 
 #include "CycleTimer.h"
 
@@ -11,13 +21,12 @@
 #include "mkl.h"
 #endif
 
+#include "gemm.h"
 #include "gemm_ispc.h"
 #include "ref_gemm_ispc.h"
 
 #define N_ITERS 3 // how many times to run implementaions for timing
-
-// implement: C = alpha * A x B + beta * C
-extern void gemm(int m, int n, int k, double *A, double *B, double *C, double alpha, double beta);
+#define MAX_REPORTED_THREADS 256
 
 static float toBW(uint64_t bytes, float sec) {
     return static_cast<float>(bytes) / (1024. * 1024. * 1024.) / sec;
@@ -52,9 +61,10 @@ int allocMatrices(int m, int n, int k, double **A, double **B, double **C){
         return 1;
     }
 #else
-    *A = (double *)malloc( m*k*sizeof( double ));
-    *B = (double *)malloc( k*n*sizeof( double ));
-    *C = (double *)malloc( m*n*sizeof( double ));
+    // 64-byte aligned, huge pages, first touched by the GEMM threads
+    *A = (double *)gemmAlloc( m*k*sizeof( double ));
+    *B = (double *)gemmAlloc( k*n*sizeof( double ));
+    *C = (double *)gemmAlloc( m*n*sizeof( double ));
     if (*A == NULL || *B == NULL || *C == NULL) {
         return 1;
     }
@@ -78,11 +88,880 @@ void fillMatrices(int m, int n, int k, double **A, double **B, double **C){
     }
 }
 
+// Naive dgemm with the same arguments, the reference when MKL is absent
+static void referenceDgemm(GemmLayout layout, GemmTranspose transA,
+                           GemmTranspose transB, int m, int n, int k,
+                           double alpha, const double *A, int lda,
+                           const double *B, int ldb, double beta, double *C,
+                           int ldc) {
+#if MKL_INSTALLED
+    cblas_dgemm(layout == GemmRowMajor ? CblasRowMajor : CblasColMajor,
+                transA == GemmNoTrans ? CblasNoTrans : CblasTrans,
+                transB == GemmNoTrans ? CblasNoTrans : CblasTrans,
+                m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+#else
+    // Element (i, j) of a matrix with leading dimension ld
+    auto at = [layout](long i, long j, long ld) {
+        return layout == GemmRowMajor ? i * ld + j : j * ld + i;
+    };
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            double sum = 0;
+            for (int p = 0; p < k; p++) {
+                double a = transA == GemmNoTrans ? A[at(i, p, lda)] : A[at(p, i, lda)];
+                double b = transB == GemmNoTrans ? B[at(p, j, ldb)] : B[at(j, p, ldb)];
+                sum += a * b;
+            }
+            double *c = &C[at(i, j, ldc)];
+            *c = beta == 0.0 ? alpha * sum : alpha * sum + beta * *c;
+        }
+    }
+#endif
+}
+
+// One call of the BLAS interface. Every matrix is a sub-matrix starting
+// at (offset, offset) of a larger one whose leading dimension has `pad`
+// extra elements, so strides and offsets are exercised as well.
+struct InterfaceCase {
+    GemmLayout layout;
+    GemmTranspose transA, transB;
+    int m, n, k;
+    int offset, pad;
+    double alpha, beta;
+};
+
+// A stored rows x cols matrix: returns the buffer, sets the leading
+// dimension and the start of the sub-matrix.
+static double *allocStored(GemmLayout layout, int rows, int cols, int offset,
+                           int pad, int *ld, double **start, size_t *count) {
+    int inner = layout == GemmRowMajor ? cols : rows;
+    int outer = layout == GemmRowMajor ? rows : cols;
+    *ld = inner + offset + pad;
+    *count = (size_t)(outer + offset) * *ld;
+    double *buf = (double *)malloc(*count * sizeof(double));
+    for (size_t i = 0; i < *count; i++) {
+        buf[i] = ((double)rand() / (double)RAND_MAX) - 0.5;
+    }
+    *start = buf + (size_t)offset * *ld + offset;
+    return buf;
+}
+
+// Run every case through dgemm and the reference and compare the whole
+// C buffers, which also catches writes outside the sub-matrix.
+static bool testInterface() {
+    const InterfaceCase cases[] = {
+        {GemmRowMajor, GemmNoTrans, GemmNoTrans, 37, 53, 71, 0, 0, 1.0, 1.0},
+        {GemmRowMajor, GemmTrans, GemmNoTrans, 64, 17, 300, 3, 5, 0.5, -1.0},
+        {GemmRowMajor, GemmNoTrans, GemmTrans, 101, 29, 13, 1, 7, -2.0, 0.25},
+        {GemmRowMajor, GemmTrans, GemmTrans, 5, 130, 257, 2, 0, 1.0, 0.0},
+        {GemmColMajor, GemmNoTrans, GemmNoTrans, 99, 45, 30, 0, 3, 1.0, 1.0},
+        {GemmColMajor, GemmTrans, GemmNoTrans, 19, 77, 61, 4, 1, 1.5, 0.5},
+        {GemmColMajor, GemmNoTrans, GemmTrans, 200, 9, 520, 1, 1, 1.0, -0.5},
+        {GemmColMajor, GemmTrans, GemmTrans, 1, 1, 1, 0, 0, 3.0, 2.0},
+        {GemmRowMajor, GemmNoTrans, GemmNoTrans, 310, 150, 530, 5, 3, 0.75, 1.0},
+        {GemmRowMajor, GemmNoTrans, GemmNoTrans, 8, 8, 0, 1, 1, 1.0, 0.5},
+        {GemmColMajor, GemmNoTrans, GemmTrans, 12, 7, 9, 2, 2, 0.0, 3.0},
+    };
+    const int numCases = sizeof(cases) / sizeof(cases[0]);
+
+    int passed = 0;
+    for (int c = 0; c < numCases; c++) {
+        const InterfaceCase &t = cases[c];
+        int rowsA = t.transA == GemmNoTrans ? t.m : t.k;
+        int colsA = t.transA == GemmNoTrans ? t.k : t.m;
+        int rowsB = t.transB == GemmNoTrans ? t.k : t.n;
+        int colsB = t.transB == GemmNoTrans ? t.n : t.k;
+        int lda, ldb, ldc;
+        double *A, *B, *C;
+        size_t countA, countB, countC;
+        double *bufA = allocStored(t.layout, rowsA, colsA, t.offset, t.pad, &lda, &A, &countA);
+        double *bufB = allocStored(t.layout, rowsB, colsB, t.offset, t.pad, &ldb, &B, &countB);
+        double *bufC = allocStored(t.layout, t.m, t.n, t.offset, t.pad, &ldc, &C, &countC);
+        double *bufRef = (double *)malloc(countC * sizeof(double));
+        memcpy(bufRef, bufC, countC * sizeof(double));
+
+        dgemm(t.layout, t.transA, t.transB, t.m, t.n, t.k, t.alpha, A, lda,
+              B, ldb, t.beta, C, ldc);
+        referenceDgemm(t.layout, t.transA, t.transB, t.m, t.n, t.k, t.alpha,
+                       A, lda, B, ldb, t.beta, bufRef + (C - bufC), ldc);
+
+        double maxErr = 0;
+        for (size_t i = 0; i < countC; i++) {
+            maxErr = std::max(maxErr, std::abs(bufC[i] - bufRef[i]));
+        }
+        bool ok = maxErr <= 1e-12 * (t.k + 1);
+        passed += ok;
+        printf("  %s %c%c m=%d n=%d k=%d offset=%d pad=%d: max error %g%s\n",
+               t.layout == GemmRowMajor ? "row" : "col",
+               t.transA == GemmNoTrans ? 'N' : 'T',
+               t.transB == GemmNoTrans ? 'N' : 'T', t.m, t.n, t.k, t.offset,
+               t.pad, maxErr, ok ? "" : "  *** FAILED");
+
+        free(bufA);
+        free(bufB);
+        free(bufC);
+        free(bufRef);
+    }
+
+    printf("[dgemm interface]:\t%d/%d cases passed\n", passed, numCases);
+    return passed == numCases;
+}
+
+// Low-precision modes: time one storage format against dgemm on the
+// same (already rounded) values and report the relative error.
+static int runPrecisionMode(const std::string &mode, int size) {
+    const int m = size, n = size, k = size;
+    const uint64_t TOTAL_FLOPS = 2*m*((uint64_t) n*k);
+    std::vector<float> A(m*k), B(k*n), C0(m*n), C(m*n);
+    std::vector<GemmBf16> Abf(m*k), Bbf(k*n);
+    std::vector<GemmFp16> Ahf(m*k), Bhf(k*n);
+    std::vector<double> Ad(m*k), Bd(k*n), Cd(m*n);
+
+    for (int i = 0; i < m*k; i++) {
+        A[i] = ((float)rand() / (float)RAND_MAX);
+    }
+    for (int i = 0; i < k*n; i++) {
+        B[i] = ((float)rand() / (float)RAND_MAX);
+    }
+    for (int i = 0; i < m*n; i++) {
+        C0[i] = ((float)rand() / (float)RAND_MAX);
+        Cd[i] = C0[i];
+    }
+
+    // The reference multiplies exactly the values the format can hold
+    for (int i = 0; i < m*k; i++) {
+        Abf[i] = gemmFloatToBf16(A[i]);
+        Ahf[i] = gemmFloatToFp16(A[i]);
+        Ad[i] = mode == "sbgemm" ? gemmBf16ToFloat(Abf[i])
+              : mode == "shgemm" ? gemmFp16ToFloat(Ahf[i]) : A[i];
+    }
+    for (int i = 0; i < k*n; i++) {
+        Bbf[i] = gemmFloatToBf16(B[i]);
+        Bhf[i] = gemmFloatToFp16(B[i]);
+        Bd[i] = mode == "sbgemm" ? gemmBf16ToFloat(Bbf[i])
+              : mode == "shgemm" ? gemmFp16ToFloat(Bhf[i]) : B[i];
+    }
+    dgemm(GemmRowMajor, GemmNoTrans, GemmNoTrans, m, n, k, 1.0, Ad.data(), k,
+          Bd.data(), n, 1.0, Cd.data(), n);
+
+    printf("Running %s %d times...\n", mode.c_str(), N_ITERS);
+    double minTime = 1e30;
+    for (int i = 0; i < N_ITERS; ++i) {
+        C = C0;
+        double startTime = CycleTimer::currentSeconds();
+        if (mode == "sgemm") {
+            sgemm(GemmRowMajor, GemmNoTrans, GemmNoTrans, m, n, k, 1.0f,
+                  A.data(), k, B.data(), n, 1.0f, C.data(), n);
+        } else if (mode == "sbgemm") {
+            sbgemm(GemmRowMajor, GemmNoTrans, GemmNoTrans, m, n, k, 1.0f,
+                   Abf.data(), k, Bbf.data(), n, 1.0f, C.data(), n);
+        } else {
+            shgemm(GemmRowMajor, GemmNoTrans, GemmNoTrans, m, n, k, 1.0f,
+                   Ahf.data(), k, Bhf.data(), n, 1.0f, C.data(), n);
+        }
+        double endTime = CycleTimer::currentSeconds();
+        printf("  %.2lfms\n", (endTime - startTime)*1000);
+        minTime = std::min(minTime, endTime - startTime);
+    }
+
+    double maxErr = 0, maxRef = 0;
+    for (int i = 0; i < m*n; i++) {
+        maxErr = std::max(maxErr, std::abs(C[i] - Cd[i]));
+        maxRef = std::max(maxRef, std::abs(Cd[i]));
+    }
+    double relErr = maxErr / maxRef;
+    // fp32 accumulation of k products loses about log2(k) bits
+    bool ok = relErr < 1e-6 * std::sqrt((double)k);
+
+    printf("[%s]:\t\t[%.3f] ms\t[%.2f] GFLOPS\n", mode.c_str(),
+           minTime * 1000, toGFLOPS(TOTAL_FLOPS, minTime));
+    printf("Max relative error vs dgemm: %g%s\n", relErr, ok ? "" : "  *** FAILED");
+    return ok ? 0 : 1;
+}
+
+// Time one batched call against a loop of single GEMM calls on the same
+// matrices, for double and float.
+template <typename T>
+static bool runBatched(const char *name, int size, int count,
+                       void (*batched)(int, int, int, T, const T *, int, long,
+                                       const T *, int, long, T, T *, int, long,
+                                       int),
+                       void (*single)(GemmLayout, GemmTranspose, GemmTranspose,
+                                      int, int, int, T, const T *, int,
+                                      const T *, int, T, T *, int)) {
+    const long elems = (long)size * size;
+    const uint64_t TOTAL_FLOPS = 2 * (uint64_t)elems * size * count;
+    std::vector<T> A(elems * count), B(elems * count), C0(elems * count);
+    std::vector<T> C(elems * count), Cref(elems * count);
+    for (long i = 0; i < elems * count; i++) {
+        A[i] = (T)rand() / (T)RAND_MAX;
+        B[i] = (T)rand() / (T)RAND_MAX;
+        C0[i] = (T)rand() / (T)RAND_MAX;
+    }
+
+    double minBatched = 1e30, minLoop = 1e30;
+    for (int i = 0; i < N_ITERS; ++i) {
+        C = C0;
+        double startTime = CycleTimer::currentSeconds();
+        batched(size, size, size, 1, A.data(), size, elems, B.data(), size,
+                elems, 1, C.data(), size, elems, count);
+        minBatched = std::min(minBatched, CycleTimer::currentSeconds() - startTime);
+
+        Cref = C0;
+        startTime = CycleTimer::currentSeconds();
+        for (int b = 0; b < count; b++) {
+            single(GemmRowMajor, GemmNoTrans, GemmNoTrans, size, size, size, 1,
+                   A.data() + b * elems, size, B.data() + b * elems, size, 1,
+                   Cref.data() + b * elems, size);
+        }
+        minLoop = std::min(minLoop, CycleTimer::currentSeconds() - startTime);
+    }
+
+    double maxErr = 0;
+    for (long i = 0; i < elems * count; i++) {
+        maxErr = std::max(maxErr, (double)std::abs(C[i] - Cref[i]));
+    }
+    double tolerance = (sizeof(T) == sizeof(float) ? 1e-5 : 1e-12) * size;
+
+    printf("[%s]:\t[%.3f] ms\t[%.2f] GFLOPS\t(%d single calls: [%.3f] ms, %.1fx)\n",
+           name, minBatched * 1000, toGFLOPS(TOTAL_FLOPS, minBatched), count,
+           minLoop * 1000, minLoop / minBatched);
+    printf("Max error vs single calls: %g%s\n", maxErr,
+           maxErr <= tolerance ? "" : "  *** FAILED");
+    return maxErr <= tolerance;
+}
+
+static int runBatchedMode(int size, int count) {
+    printf("Running batches of %d %dx%d matrices %d times...\n", count, size,
+           size, N_ITERS);
+    bool ok = runBatched<double>("dgemmBatched", size, count, dgemmBatched, dgemm);
+    ok = runBatched<float>("sgemmBatched", size, count, sgemmBatched, sgemm) && ok;
+    return ok ? 0 : 1;
+}
+
+// Strassen mode: time dgemmStrassen against the classical dgemm for one
+// cutoff, or a sweep of them, and report the error Strassen adds.
+static int runStrassenMode(int size, int cutoff) {
+    const int m = size, n = size, k = size;
+    const uint64_t TOTAL_FLOPS = 2*m*((uint64_t) n*k);
+    std::vector<double> A((long)m*k), B((long)k*n), C0((long)m*n);
+    std::vector<double> C((long)m*n), Cref((long)m*n);
+    for (long i = 0; i < (long)m*k; i++) {
+        A[i] = ((double)rand() / (double)RAND_MAX);
+    }
+    for (long i = 0; i < (long)k*n; i++) {
+        B[i] = ((double)rand() / (double)RAND_MAX);
+    }
+    for (long i = 0; i < (long)m*n; i++) {
+        C0[i] = ((double)rand() / (double)RAND_MAX);
+    }
+
+    double minClassical = 1e30;
+    for (int i = 0; i < N_ITERS; ++i) {
+        Cref = C0;
+        double startTime = CycleTimer::currentSeconds();
+        dgemm(GemmRowMajor, GemmNoTrans, GemmNoTrans, m, n, k, 1.0, A.data(),
+              k, B.data(), n, 1.0, Cref.data(), n);
+        minClassical = std::min(minClassical, CycleTimer::currentSeconds() - startTime);
+    }
+    printf("[dgemm]:		[%.3f] ms	[%.2f] GFLOPS\n", minClassical * 1000,
+           toGFLOPS(TOTAL_FLOPS, minClassical));
+
+    std::vector<int> cutoffs;
+    if (cutoff > 0) {
+        cutoffs.push_back(cutoff);
+    } else {
+        cutoffs = {256, 512, 1024, 2048};
+    }
+
+    bool ok = true;
+    for (int c : cutoffs) {
+        gemmSetStrassenCutoff(c);
+        double minTime = 1e30;
+        for (int i = 0; i < N_ITERS; ++i) {
+            C = C0;
+            double startTime = CycleTimer::currentSeconds();
+            dgemmStrassen(m, n, k, 1.0, A.data(), k, B.data(), n, 1.0,
+                          C.data(), n);
+            minTime = std::min(minTime, CycleTimer::currentSeconds() - startTime);
+        }
+
+        double maxErr = 0, maxRef = 0;
+        for (long i = 0; i < (long)m*n; i++) {
+            maxErr = std::max(maxErr, std::abs(C[i] - Cref[i]));
+            maxRef = std::max(maxRef, std::abs(Cref[i]));
+        }
+        double relErr = maxErr / maxRef;
+        // Each level multiplies the classical error bound by a small
+        // constant; anything near single precision is a bug
+        bool passed = relErr < 1e-10;
+        ok = ok && passed;
+
+        printf("[Strassen cutoff %d]:\t[%.3f] ms\t[%.2f] effective GFLOPS\t(%.2fx)\n",
+               c, minTime * 1000, toGFLOPS(TOTAL_FLOPS, minTime),
+               minClassical / minTime);
+        printf("  Max error vs dgemm: %g absolute, %g relative%s\n", maxErr,
+               relErr, passed ? "" : "  *** FAILED");
+    }
+    return ok ? 0 : 1;
+}
+
+// Hardware counters for the sweep. They are opened with inherit before
+// the first GEMM, so the task system threads started later are counted
+// as well. Without perf_event_open (or with a strict
+// perf_event_paranoid) the counters read as -1.
+enum { COUNTER_L1D, COUNTER_LLC, COUNTER_DTLB, NUM_COUNTERS };
+static const char *counterNames[NUM_COUNTERS] = {"l1d_misses", "llc_misses",
+                                                 "dtlb_misses"};
+
+struct Counters {
+    int fd[NUM_COUNTERS];
+};
+
+static void openCounters(Counters *counters) {
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        counters->fd[c] = -1;
+    }
+#ifdef __linux__
+    const uint32_t types[NUM_COUNTERS] = {PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE,
+                                          PERF_TYPE_HW_CACHE};
+    const uint64_t configs[NUM_COUNTERS] = {
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = types[c];
+        attr.config = configs[c];
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        counters->fd[c] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (counters->fd[c] < 0) {
+            fprintf(stderr, "perf_event_open(%s) failed, reporting -1\n",
+                    counterNames[c]);
+        }
+    }
+#endif
+}
+
+static void readCounters(const Counters &counters, long long *values) {
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        uint64_t value;
+        values[c] = -1;
+        if (counters.fd[c] >= 0 &&
+            read(counters.fd[c], &value, sizeof(value)) == sizeof(value)) {
+            values[c] = (long long)value;
+        }
+    }
+}
+
+static void closeCounters(Counters *counters) {
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        if (counters->fd[c] >= 0) {
+            close(counters->fd[c]);
+        }
+    }
+}
+
+// Clock frequency in GHz: the maximum from cpufreq, else the current one
+// from /proc/cpuinfo, else 0 (unknown)
+static double detectGHz() {
+    FILE *file = fopen("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq", "r");
+    if (file != NULL) {
+        long khz = 0;
+        int found = fscanf(file, "%ld", &khz);
+        fclose(file);
+        if (found == 1 && khz > 0) {
+            return khz / 1e6;
+        }
+    }
+    file = fopen("/proc/cpuinfo", "r");
+    if (file != NULL) {
+        char line[256];
+        double mhz = 0;
+        while (fgets(line, sizeof(line), file) != NULL) {
+            if (sscanf(line, "cpu MHz : %lf", &mhz) == 1) {
+                break;
+            }
+        }
+        fclose(file);
+        return mhz / 1e3;
+    }
+    return 0;
+}
+
+// Double-precision FLOPs per cycle and core of the instruction set this
+// binary was built for, assuming two vector pipes: two FMAs (4 FLOPs per
+// lane) with FMA, one add and one multiply (2 FLOPs per lane) without.
+static int flopsPerCycle() {
+#if defined(__AVX512F__)
+    const int lanes = 8;
+#elif defined(__AVX__)
+    const int lanes = 4;
+#else
+    const int lanes = 2;
+#endif
+#ifdef __FMA__
+    return lanes * 4;
+#else
+    return lanes * 2;
+#endif
+}
+
+// A benchmarked implementation. threads is -1 when the variant follows
+// gemmSetNumThreads, else the number of threads it always uses.
+struct SweepVariant {
+    const char *name;
+    void (*gemm)(int, int, int, double *, double *, double *, double, double);
+    long maxWork;
+    int threads;
+    bool refShapesOnly;
+};
+
+struct SweepShape {
+    int m, n, k;
+};
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const std::vector<double> &sorted, double p) {
+    size_t rank = (size_t)std::ceil(p * sorted.size());
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// Sweep mode: every variant on square and rectangular shapes and, for the
+// multithreaded ones, 1, 2, 4, ... up to maxThreads threads. Reports the
+// median and p95 time, the fraction of peak FLOP rate, cache and TLB
+// misses per call and the error against dgemm, one CSV row per run.
+static int runSweepMode(const char *csvFile, int iterations, int maxThreads) {
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (maxThreads <= 0) {
+        maxThreads = cores;
+    }
+    if (iterations <= 0) {
+        iterations = 10;
+    }
+
+    const SweepShape shapes[] = {
+        {256, 256, 256},   {512, 512, 512},   {1024, 1024, 1024},
+        {2048, 2048, 2048}, {4096, 4096, 4096}, {2048, 2048, 64},
+        {64, 2048, 2048},  {2048, 64, 2048},  {4096, 256, 512},
+        {509, 509, 509},   {1000, 1003, 997},
+    };
+    const int numShapes = sizeof(shapes) / sizeof(shapes[0]);
+
+    std::vector<SweepVariant> variants;
+    const GemmVariant *library;
+    int numLibrary = gemmVariants(&library);
+    for (int v = 0; v < numLibrary; v++) {
+        variants.push_back({library[v].name, library[v].gemm,
+                            library[v].maxWork, library[v].threaded ? -1 : 1,
+                            false});
+    }
+    // The ISPC versions always launch on the whole task system. The
+    // prebuilt reference reads out of bounds unless m == n == k, and is
+    // wrong unless that size is a multiple of 8
+    variants.push_back({"gemm_ispc_ref", ispc::gemm_ispc_ref, 0, cores, true});
+    variants.push_back({"gemm_ispc", ispc::gemm_ispc, 0, cores, false});
+
+    std::vector<int> threadCounts;
+    for (int t = 1; t < maxThreads; t *= 2) {
+        threadCounts.push_back(t);
+    }
+    threadCounts.push_back(maxThreads);
+
+    double ghz = detectGHz();
+    printf("[Peak]:\t\t\t%.2f GHz x %d FLOPs/cycle = %.2f GFLOPS per core\n",
+           ghz, flopsPerCycle(), ghz * flopsPerCycle());
+
+    FILE *csv = NULL;
+    if (csvFile != NULL) {
+        csv = fopen(csvFile, "w");
+        if (csv == NULL) {
+            fprintf(stderr, "Cannot open %s for writing\n", csvFile);
+            return 1;
+        }
+        fprintf(csv, "variant,m,n,k,threads,iterations,min_ms,median_ms,p95_ms,"
+                     "gflops,peak_gflops,peak_fraction,%s,%s,%s,max_rel_error\n",
+                counterNames[0], counterNames[1], counterNames[2]);
+    }
+
+    Counters counters;
+    openCounters(&counters);
+
+    bool ok = true;
+    for (int s = 0; s < numShapes; s++) {
+        const int m = shapes[s].m, n = shapes[s].n, k = shapes[s].k;
+        const uint64_t TOTAL_FLOPS = 2*m*((uint64_t) n*k);
+        std::vector<double> A((long)m*k), B((long)k*n), C0((long)m*n);
+        std::vector<double> C((long)m*n), Cref((long)m*n);
+        for (long i = 0; i < (long)m*k; i++) {
+            A[i] = ((double)rand() / (double)RAND_MAX);
+        }
+        for (long i = 0; i < (long)k*n; i++) {
+            B[i] = ((double)rand() / (double)RAND_MAX);
+        }
+        for (long i = 0; i < (long)m*n; i++) {
+            C0[i] = ((double)rand() / (double)RAND_MAX);
+        }
+        gemmSetNumThreads(0);
+        Cref = C0;
+        dgemm(GemmRowMajor, GemmNoTrans, GemmNoTrans, m, n, k, 1.0, A.data(),
+              k, B.data(), n, 1.0, Cref.data(), n);
+        double maxRef = 0;
+        for (long i = 0; i < (long)m*n; i++) {
+            maxRef = std::max(maxRef, std::abs(Cref[i]));
+        }
+
+        for (const SweepVariant &variant : variants) {
+            if ((variant.maxWork > 0 && (long)m * n * k > variant.maxWork) ||
+                (variant.refShapesOnly && (m != n || n != k || m % 8 != 0))) {
+                continue;
+            }
+            std::vector<int> runs(1, variant.threads);
+            if (variant.threads < 0) {
+                runs = threadCounts;
+            }
+
+            for (int threads : runs) {
+                gemmSetNumThreads(variant.threads < 0 ? threads : 0);
+                std::vector<double> times;
+                long long misses[NUM_COUNTERS] = {0, 0, 0};
+                for (int i = 0; i < iterations; i++) {
+                    C = C0;
+                    long long before[NUM_COUNTERS], after[NUM_COUNTERS];
+                    readCounters(counters, before);
+                    double startTime = CycleTimer::currentSeconds();
+                    variant.gemm(m, n, k, A.data(), B.data(), C.data(), 1.0, 1.0);
+                    double endTime = CycleTimer::currentSeconds();
+                    readCounters(counters, after);
+                    times.push_back(endTime - startTime);
+                    for (int c = 0; c < NUM_COUNTERS; c++) {
+                        misses[c] = before[c] < 0 ? -1 : misses[c] + after[c] - before[c];
+                    }
+                }
+                std::sort(times.begin(), times.end());
+                double median = percentile(times, 0.5);
+                double p95 = percentile(times, 0.95);
+                for (int c = 0; c < NUM_COUNTERS; c++) {
+                    if (misses[c] >= 0) {
+                        misses[c] /= iterations;
+                    }
+                }
+
+                double maxErr = 0;
+                for (long i = 0; i < (long)m*n; i++) {
+                    maxErr = std::max(maxErr, std::abs(C[i] - Cref[i]));
+                }
+                double relErr = maxErr / maxRef;
+                bool passed = relErr < 1e-10;
+                ok = ok && passed;
+
+                double gflops = toGFLOPS(TOTAL_FLOPS, median);
+                double peak = ghz * flopsPerCycle() * std::min(threads, cores);
+                double fraction = peak > 0 ? gflops / peak : 0;
+                printf("[%s]:\t%dx%dx%d\t%d threads\t[%.3f] ms median\t[%.3f] ms p95\t"
+                       "[%.2f] GFLOPS\t%.1f%% of peak%s\n",
+                       variant.name, m, n, k, threads, median * 1000, p95 * 1000,
+                       gflops, fraction * 100, passed ? "" : "  *** FAILED");
+                if (csv != NULL) {
+                    fprintf(csv, "%s,%d,%d,%d,%d,%d,%.4f,%.4f,%.4f,%.3f,%.3f,%.4f,"
+                                 "%lld,%lld,%lld,%g\n",
+                            variant.name, m, n, k, threads, iterations,
+                            times[0] * 1000, median * 1000, p95 * 1000, gflops,
+                            peak, fraction, misses[0], misses[1], misses[2],
+                            relErr);
+                    fflush(csv);
+                }
+            }
+        }
+    }
+
+    closeCounters(&counters);
+    if (csv != NULL) {
+        fclose(csv);
+    }
+    gemmSetNumThreads(0);
+    return ok ? 0 : 1;
+}
+
+// The separate passes dgemmFused replaces, each one a sweep over C
+static void unfusedEpilogue(int m, int n, double *C, const GemmEpilogue &epilogue) {
+    const long elems = (long)m * n;
+    if (epilogue.bias != NULL) {
+        for (long i = 0; i < elems; i++) {
+            C[i] += epilogue.bias[i % n];
+        }
+    }
+    if (epilogue.activation == GemmActivationReLU) {
+        for (long i = 0; i < elems; i++) {
+            C[i] = C[i] > 0 ? C[i] : 0;
+        }
+    } else if (epilogue.activation == GemmActivationGELU) {
+        for (long i = 0; i < elems; i++) {
+            double x = C[i];
+            C[i] = 0.5 * x * (1 + std::tanh(0.7978845608028654 * (x + 0.044715 * x * x * x)));
+        }
+    }
+    if (epilogue.rowScale != NULL) {
+        for (long i = 0; i < elems; i++) {
+            C[i] *= epilogue.rowScale[i / n];
+        }
+    }
+}
+
+// Epilogue mode: dense layers (C = X W, X is tokens x inputs) followed by
+// bias, ReLU or GELU and a per-row scale, fused into the GEMM against
+// dgemm plus separate passes.
+static int runEpilogueMode() {
+    const SweepShape shapes[] = {
+        {64, 4096, 1024}, {256, 4096, 1024}, {1024, 4096, 1024},
+        {1024, 1024, 4096}, {2048, 768, 768},
+    };
+    const int numShapes = sizeof(shapes) / sizeof(shapes[0]);
+    const GemmActivation activations[] = {GemmActivationReLU, GemmActivationGELU};
+
+    bool ok = true;
+    for (int s = 0; s < numShapes; s++) {
+        const int m = shapes[s].m, n = shapes[s].n, k = shapes[s].k;
+        const uint64_t TOTAL_FLOPS = 2*m*((uint64_t) n*k);
+        std::vector<double> A((long)m*k), B((long)k*n), bias(n), rowScale(m);
+        std::vector<double> C((long)m*n), Cref((long)m*n);
+        for (long i = 0; i < (long)m*k; i++) {
+            A[i] = ((double)rand() / (double)RAND_MAX) - 0.5;
+        }
+        for (long i = 0; i < (long)k*n; i++) {
+            B[i] = ((double)rand() / (double)RAND_MAX) - 0.5;
+        }
+        for (int j = 0; j < n; j++) {
+            bias[j] = ((double)rand() / (double)RAND_MAX) - 0.5;
+        }
+        for (int i = 0; i < m; i++) {
+            rowScale[i] = ((double)rand() / (double)RAND_MAX) + 0.5;
+        }
+
+        for (GemmActivation activation : activations) {
+            GemmEpilogue epilogue = {bias.data(), activation, rowScale.data()};
+
+            double minUnfused = 1e30, minFused = 1e30;
+            for (int i = 0; i < N_ITERS; ++i) {
+                double startTime = CycleTimer::currentSeconds();
+                dgemm(GemmRowMajor, GemmNoTrans, GemmNoTrans, m, n, k, 1.0,
+                      A.data(), k, B.data(), n, 0.0, Cref.data(), n);
+                unfusedEpilogue(m, n, Cref.data(), epilogue);
+                minUnfused = std::min(minUnfused, CycleTimer::currentSeconds() - startTime);
+
+                startTime = CycleTimer::currentSeconds();
+                dgemmFused(GemmNoTrans, GemmNoTrans, m, n, k, 1.0, A.data(), k,
+                           B.data(), n, 0.0, C.data(), n, &epilogue);
+                minFused = std::min(minFused, CycleTimer::currentSeconds() - startTime);
+            }
+
+            double maxErr = 0, maxRef = 0;
+            for (long i = 0; i < (long)m*n; i++) {
+                maxErr = std::max(maxErr, std::abs(C[i] - Cref[i]));
+                maxRef = std::max(maxRef, std::abs(Cref[i]));
+            }
+            bool passed = maxErr <= 1e-13 * maxRef;
+            ok = ok && passed;
+
+            printf("[%s %dx%dx%d]:\tfused [%.3f] ms [%.2f] GFLOPS\tunfused [%.3f] ms\t(%.2fx)\tmax error %g%s\n",
+                   activation == GemmActivationReLU ? "bias+ReLU+scale" : "bias+GELU+scale",
+                   m, n, k, minFused * 1000, toGFLOPS(TOTAL_FLOPS, minFused),
+                   minUnfused * 1000, minUnfused / minFused, maxErr,
+                   passed ? "" : "  *** FAILED");
+        }
+    }
+    return ok ? 0 : 1;
+}
+
+// Kilobytes of this process backed by transparent huge pages, -1 if the
+// kernel does not say
+static long hugePageKB() {
+    FILE *file = fopen("/proc/self/smaps_rollup", "r");
+    if (file == NULL) {
+        return -1;
+    }
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(file);
+    return kb;
+}
+
+// Memory mode: repeated dgemm calls on malloc'd matrices with per-call
+// packing buffers, then on gemmAlloc'd matrices with huge pages and
+// cached workspaces. Reports the first and the following calls and the
+// dTLB misses per call.
+static int runMemoryMode(int size, int calls) {
+    const int m = size, n = size, k = size;
+    const size_t elems = (size_t)size * size;
+    const uint64_t TOTAL_FLOPS = 2*m*((uint64_t) n*k);
+
+    Counters counters;
+    openCounters(&counters);
+
+    double *Cfirst = NULL;
+    bool ok = true;
+    for (int optimized = 0; optimized < 2; optimized++) {
+        gemmSetMemoryOptions(optimized, optimized);
+        double *A, *B, *C;
+        if (optimized) {
+            A = (double *)gemmAlloc(elems * sizeof(double));
+            B = (double *)gemmAlloc(elems * sizeof(double));
+            C = (double *)gemmAlloc(elems * sizeof(double));
+        } else {
+            A = (double *)malloc(elems * sizeof(double));
+            B = (double *)malloc(elems * sizeof(double));
+            C = (double *)malloc(elems * sizeof(double));
+        }
+        // Same data for both runs
+        srand(1);
+        for (size_t i = 0; i < elems; i++) {
+            A[i] = ((double)rand() / (double)RAND_MAX);
+            B[i] = ((double)rand() / (double)RAND_MAX);
+            C[i] = 0;
+        }
+
+        double firstTime = 0, restTime = 0;
+        long long tlbMisses = 0;
+        for (int call = 0; call < calls; call++) {
+            long long before[NUM_COUNTERS], after[NUM_COUNTERS];
+            readCounters(counters, before);
+            double startTime = CycleTimer::currentSeconds();
+            dgemm(GemmRowMajor, GemmNoTrans, GemmNoTrans, m, n, k, 1.0, A, k,
+                  B, n, 0.0, C, n);
+            double endTime = CycleTimer::currentSeconds();
+            readCounters(counters, after);
+            if (call == 0) {
+                firstTime = endTime - startTime;
+            } else {
+                restTime += endTime - startTime;
+            }
+            tlbMisses = before[COUNTER_DTLB] < 0
+                            ? -1 : tlbMisses + after[COUNTER_DTLB] - before[COUNTER_DTLB];
+        }
+        double meanRest = calls > 1 ? restTime / (calls - 1) : firstTime;
+
+        printf("[%s]:\t[%.3f] ms first call\t[%.3f] ms per later call\t[%.2f] GFLOPS\n",
+               optimized ? "gemmAlloc, huge pages, cached" : "malloc, per-call buffers",
+               firstTime * 1000, meanRest * 1000, toGFLOPS(TOTAL_FLOPS, meanRest));
+        printf("  dTLB read misses per call: %lld\thuge pages in use: %ld KB\n",
+               tlbMisses < 0 ? -1 : tlbMisses / calls, hugePageKB());
+
+        if (optimized) {
+            double maxErr = 0;
+            for (size_t i = 0; i < elems; i++) {
+                maxErr = std::max(maxErr, std::abs(C[i] - Cfirst[i]));
+            }
+            ok = maxErr == 0;
+            printf("Max difference between the two runs: %g%s\n", maxErr,
+                   ok ? "" : "  *** FAILED");
+            free(Cfirst);
+            gemmFree(A);
+            gemmFree(B);
+            gemmFree(C);
+        } else {
+            Cfirst = C;
+            free(A);
+            free(B);
+        }
+    }
+
+    closeCounters(&counters);
+    gemmSetMemoryOptions(true, true);
+    return ok ? 0 : 1;
+}
+
 // Compute C=alpha*A*B+beta*C using Intel MKL and your implementation
 int main(int argc, char *argv[]) {
     // Problem size calculations
     int m, n, k;
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <size> [num_threads] [tuning_cache_file]\n", argv[0]);
+        fprintf(stderr, "       %s sgemm|sbgemm|shgemm <size> [num_threads]\n", argv[0]);
+        fprintf(stderr, "       %s batched <size> <batch_count> [num_threads]\n", argv[0]);
+        fprintf(stderr, "       %s strassen <size> [cutoff] [num_threads]\n", argv[0]);
+        fprintf(stderr, "       %s sweep [csv_file] [iterations] [max_threads]\n", argv[0]);
+        fprintf(stderr, "       %s memory <size> [calls] [num_threads]\n", argv[0]);
+        fprintf(stderr, "       %s epilogue [num_threads]\n", argv[0]);
+        return 1;
+    }
+
+    std::string mode = argv[1];
+    if (mode == "sgemm" || mode == "sbgemm" || mode == "shgemm") {
+        if (argc < 3) {
+            fprintf(stderr, "Usage: %s %s <size> [num_threads]\n", argv[0], argv[1]);
+            return 1;
+        }
+        if (argc > 3) {
+            gemmSetNumThreads(atoi(argv[3]));
+        }
+        return runPrecisionMode(mode, atoi(argv[2]));
+    }
+    if (mode == "batched") {
+        if (argc < 4) {
+            fprintf(stderr, "Usage: %s batched <size> <batch_count> [num_threads]\n", argv[0]);
+            return 1;
+        }
+        if (argc > 4) {
+            gemmSetNumThreads(atoi(argv[4]));
+        }
+        return runBatchedMode(atoi(argv[2]), atoi(argv[3]));
+    }
+    if (mode == "strassen") {
+        if (argc < 3) {
+            fprintf(stderr, "Usage: %s strassen <size> [cutoff] [num_threads]\n", argv[0]);
+            return 1;
+        }
+        if (argc > 4) {
+            gemmSetNumThreads(atoi(argv[4]));
+        }
+        return runStrassenMode(atoi(argv[2]), argc > 3 ? atoi(argv[3]) : 0);
+    }
+    if (mode == "memory") {
+        if (argc < 3) {
+            fprintf(stderr, "Usage: %s memory <size> [calls] [num_threads]\n", argv[0]);
+            return 1;
+        }
+        if (argc > 4) {
+            gemmSetNumThreads(atoi(argv[4]));
+        }
+        return runMemoryMode(atoi(argv[2]), argc > 3 ? atoi(argv[3]) : 5);
+    }
+    if (mode == "epilogue") {
+        if (argc > 2) {
+            gemmSetNumThreads(atoi(argv[2]));
+        }
+        return runEpilogueMode();
+    }
+    if (mode == "sweep") {
+        return runSweepMode(argc > 2 ? argv[2] : NULL,
+                            argc > 3 ? atoi(argv[3]) : 0,
+                            argc > 4 ? atoi(argv[4]) : 0);
+    }
     int size = atoi(argv[1]);
+    if (argc > 2) {
+        gemmSetNumThreads(atoi(argv[2]));
+    }
+    if (argc > 3) {
+        printf("Autotuning the GEMM blocking...\n");
+        gemmAutotune(argv[3]);
+    }
+
+    GemmBlockingInfo blocking;
+    gemmGetBlocking(&blocking);
+    printf("[Blocking]:\t\tL1 %ld KB, L2 %ld KB, L3 %ld KB -> mc=%d kc=%d nc=%d (%s)\n",
+           blocking.l1 >> 10, blocking.l2 >> 10, blocking.l3 >> 10,
+           blocking.mc, blocking.kc, blocking.nc, blocking.source);
     m = size, k = size, n = size;
     const uint64_t TOTAL_BYTES = (m*k + k*n + 2*m*n) * sizeof(double);
     const uint64_t TOTAL_FLOPS = 2*m*((uint64_t) n*k);
@@ -94,6 +973,7 @@ int main(int argc, char *argv[]) {
     double *A1, *B1, *C1; // for MKL library implementation
     double *A2, *B2, *C2; // for your implementation
     double *A3, *B3, *C3; // for ispc implementation
+    double *A4, *B4, *C4; // for your ispc implementation
     if(allocMatrices(m,n,k,&A1,&B1,&C1) == 1){
         return 1;
     }
@@ -103,16 +983,23 @@ int main(int argc, char *argv[]) {
     if(allocMatrices(m,n,k,&A3,&B3,&C3) == 1){
         return 1;
     }
+    if(allocMatrices(m,n,k,&A4,&B4,&C4) == 1){
+        return 1;
+    }
     //
     // Repeat N_ITERS times for robust timing.
     //
 #if MKL_INSTALLED
     double minMKL = 1e30;
-    double totalsqerr_ispc = 0; // keep track of total squared error over all iterations
 #endif
+    double totalsqerr_ispc = 0; // keep track of total squared error over all iterations
     double minGEMM = 1e30;
     double minISPC = 1e30;
+    double minUserISPC = 1e30;
     double totalsqerr_user = 0; // keep track of total squared error over all iterations
+    double totalsqerr_user_ispc = 0;
+    double threadGFLOPS[MAX_REPORTED_THREADS];
+    int numThreads = 0;
 
     printf("Running each implementation %d times...\n", N_ITERS);
     
@@ -131,6 +1018,10 @@ int main(int argc, char *argv[]) {
         memcpy(B3,B1,k*n*sizeof(double));
         memcpy(C3,C1,m*n*sizeof(double));
 
+        memcpy(A4,A1,m*k*sizeof(double));
+        memcpy(B4,B1,k*n*sizeof(double));
+        memcpy(C4,C1,m*n*sizeof(double));
+
         // Run the Intel MKL matrix multiply implementation.
 #if MKL_INSTALLED
         printf("Running Intel MKL... ");
@@ -140,6 +1031,11 @@ int main(int argc, char *argv[]) {
         endTime = CycleTimer::currentSeconds();
         printf("%.2lfms\n", (endTime - startTime)*1000);
         minMKL = std::min(minMKL, endTime - startTime);
+#else
+        // Without MKL every implementation is checked against dgemm: the
+        // prebuilt reference is wrong for sizes that are not a multiple of 8
+        dgemm(GemmRowMajor, GemmNoTrans, GemmNoTrans, m, n, k, alpha, A1, k,
+              B1, n, beta, C1, n);
 #endif
 
         // Run your matrix multiply implementation. 
@@ -149,6 +1045,9 @@ int main(int argc, char *argv[]) {
         gemm(m, n, k, A2, B2, C2, alpha, beta);
         endTime = CycleTimer::currentSeconds();
         printf("%.2lfms\n", (endTime - startTime)*1000);
+        if (endTime - startTime < minGEMM) {
+            numThreads = gemmThreadGFLOPS(threadGFLOPS, MAX_REPORTED_THREADS);
+        }
         minGEMM = std::min(minGEMM, endTime - startTime);
 
         // Run reference ISPC matrix multiply implementation. 
@@ -159,20 +1058,24 @@ int main(int argc, char *argv[]) {
         printf("%.2lfms\n", (endTime - startTime)*1000);
         minISPC = std::min(minISPC, endTime - startTime);
 
+        // Run your ISPC matrix multiply implementation.
+        printf("Running student ispc GEMM... ");
+        startTime = CycleTimer::currentSeconds();
+        ispc::gemm_ispc(m, n, k, A4, B4, C4, alpha, beta);
+        endTime = CycleTimer::currentSeconds();
+        printf("%.2lfms\n", (endTime - startTime)*1000);
+        minUserISPC = std::min(minUserISPC, endTime - startTime);
+
         // Compare output for correctness
         for (int i = 0; i < m; i++) {
             for ( int j = 0; j < n; j++ ) {
-#if MKL_INSTALLED
-                double mkl_output = C1[i*n+j];
-                double sol_output = C2[i*n+j];
-                double ispc_output = C3[i*n+j];
-                totalsqerr_user += (mkl_output - sol_output) * (mkl_output - sol_output);
-                totalsqerr_ispc += (mkl_output - ispc_output) * (mkl_output - ispc_output);
-#else
+                double expected_output = C1[i*n+j];
                 double sol_output = C2[i*n+j];
                 double ispc_output = C3[i*n+j];
-                totalsqerr_user += (ispc_output - sol_output) * (ispc_output - sol_output);
-#endif
+                double user_ispc_output = C4[i*n+j];
+                totalsqerr_user += (expected_output - sol_output) * (expected_output - sol_output);
+                totalsqerr_ispc += (expected_output - ispc_output) * (expected_output - ispc_output);
+                totalsqerr_user_ispc += (expected_output - user_ispc_output) * (expected_output - user_ispc_output);
             }
         }
     }
@@ -191,16 +1094,27 @@ int main(int argc, char *argv[]) {
            minGEMM * 1000,
            toBW(TOTAL_BYTES, minGEMM),
            toGFLOPS(TOTAL_FLOPS, minGEMM));
+    for (int t = 0; t < numThreads; t++) {
+        printf("  [thread %d]:\t\t[%.2f] GFLOPS\n", t, threadGFLOPS[t]);
+    }
 
     printf("[Ref ISPC GEMM]:\t[%.3f] ms\t[%.3f] GB/s\t[%.2f] GFLOPS\n",
            minISPC * 1000,
            toBW(TOTAL_BYTES, minISPC),
            toGFLOPS(TOTAL_FLOPS, minISPC));
 
+    printf("[Student ISPC GEMM]:\t[%.3f] ms\t[%.3f] GB/s\t[%.2f] GFLOPS\n",
+           minUserISPC * 1000,
+           toBW(TOTAL_BYTES, minUserISPC),
+           toGFLOPS(TOTAL_FLOPS, minUserISPC));
+
     printf("Total squared error student sol: %lf\n", totalsqerr_user);
-#if MKL_INSTALLED
+    printf("Total squared error student ispc: %lf\n", totalsqerr_user_ispc);
     printf("Total squared error ref ispc: %lf\n", totalsqerr_ispc);
-#endif
+
+    // Non-square, transposed, column-major and strided calls
+    printf("Testing the dgemm interface...\n");
+    bool interfaceOk = testInterface();
 
     // Deallocate matrices
 #if MKL_INSTALLED
@@ -210,15 +1124,27 @@ int main(int argc, char *argv[]) {
     mkl_free(A2);
     mkl_free(B2);
     mkl_free(C2);
+    mkl_free(A3);
+    mkl_free(B3);
+    mkl_free(C3);
+    mkl_free(A4);
+    mkl_free(B4);
+    mkl_free(C4);
 #else
-    free(A1);
-    free(B1);
-    free(C1);
-    free(A2);
-    free(B2);
-    free(C2);
+    gemmFree(A1);
+    gemmFree(B1);
+    gemmFree(C1);
+    gemmFree(A2);
+    gemmFree(B2);
+    gemmFree(C2);
+    gemmFree(A3);
+    gemmFree(B3);
+    gemmFree(C3);
+    gemmFree(A4);
+    gemmFree(B4);
+    gemmFree(C4);
 #endif
 
-    return 0;
+    return interfaceOk ? 0 : 1;
 }
 